@@ -339,7 +339,7 @@ void get_pgm_info(pgm_info_t * pi) {
 }
 
 
-static arg_struct pgm_arg;
+static CORE_TLS arg_struct pgm_arg;
 
 
 void pgm_line_init(pgm_line_t * p, char * buf, int buflen) {
@@ -374,7 +374,7 @@ int is_mode_pause() {
   return mode_pause;
 }
 
-extern int no_menu_key_this_time;
+extern CORE_TLS int no_menu_key_this_time;
 
 bool core_keydown_ex(int key, bool *enqueued, int *repeat, int no_menu_key) {
   no_menu_key_this_time = no_menu_key;
@@ -426,7 +426,7 @@ int get_dynstack_size() {
 }
 
 
-extern unsigned int printer_delay;
+extern CORE_TLS unsigned int printer_delay;
 
 /* docmd_delay()...
 #ifdef BCD_MATH
@@ -319,7 +319,7 @@ int docmd_rcl(arg_struct *arg) {
 }
 
 /* Temporary for use by docmd_rcl_div() & docmd_rcl_mul() */
-static vartype *temp_v;
+static CORE_TLS vartype *temp_v;
 
 static int docmd_rcl_div_completion(int error, vartype *res) {
     free_vartype(temp_v);
@@ -883,13 +883,14 @@ int docmd_to_rad(arg_struct *arg) {
     return err;
 }
 
+#ifdef BCD_MATH
+static const phloat point01(1, 100);
+static const phloat point36(36, 100);
+#endif
+
 static int mappable_to_hr(phloat x, phloat *y) {
     int neg = x < 0;
     phloat res;
-#ifdef BCD_MATH
-    const phloat point01(1, 100);
-    const phloat point36(36, 100);
-#endif
     if (neg)
         x = -x;
 
@@ -1049,7 +1050,7 @@ int docmd_to_pol(arg_struct *arg) {
         return ERR_INVALID_TYPE;
 }
 
-static int mappable_ip(phloat x, phloat *y) {
+int mappable_ip(phloat x, phloat *y) {
     if (x < 0)
         *y = -floor(-x);
     else
@@ -1065,7 +1066,7 @@ int docmd_ip(arg_struct *arg) {
     return err;
 }
 
-static int mappable_fp(phloat x, phloat *y) {
+int mappable_fp(phloat x, phloat *y) {
     if (x < 0)
         *y = x + floor(-x);
     else
@@ -1081,7 +1082,7 @@ int docmd_fp(arg_struct *arg) {
     return err;
 }
 
-static phloat rnd_multiplier;
+static CORE_TLS phloat rnd_multiplier;
 
 static int mappable_rnd_r(phloat x, phloat *y) {
     if (flags.f.fix_or_all && !flags.f.eng_or_all) {
@@ -1108,7 +1109,7 @@ static int mappable_rnd_r(phloat x, phloat *y) {
                 neg = 1;
             } else
                 neg = 0;
-            scale = pow(10, floor(log10(t)));
+            scale = p_pow10(to_int(floor(log10(t))));
             if (scale > t) {
                 /* Theoretically, this can't happen, but due to limited
                  * precision, the log of something like 9.999999999+
@@ -1151,7 +1152,7 @@ int docmd_rnd(arg_struct *arg) {
         if (flags.f.digits_bit1) digits += 2;
         if (flags.f.digits_bit0) digits += 1;
     }
-    rnd_multiplier = pow(10.0, digits);
+    rnd_multiplier = p_pow10(digits);
     err = map_unary(stack[sp], &v, mappable_rnd_r, mappable_rnd_c);
     if (err == ERR_NONE)
         unary_result(v);
@@ -176,7 +176,7 @@ int docmd_comb(arg_struct *arg) {
     if (x > y / 2)
         x = y - x;
     #ifdef BCD_MATH
-        s = x == 0 ? 1 : pow(10, 1 + floor(log10(x)));
+        s = x == 0 ? 1 : p_pow10(1 + to_int(floor(log10(x))));
     #elif ANDROID
         s = x == 0 ? 1 : pow(2, 1 + floor(log(x) / log(phloat(2))));
     #else
@@ -305,7 +305,7 @@ int docmd_seed(arg_struct *arg) {
         const phloat e12(1000000000000LL);
         if (x >= 1) {
             int exp = to_int(floor(log10(x)));
-            Phloat mant = floor(x * pow(Phloat(10), 11 - exp) + 0.5);
+            Phloat mant = floor(x * p_pow10(11 - exp) + 0.5);
             if (mant >= Phloat(1000000000000LL)) {
                 mant /= 10;
                 exp++;
@@ -324,7 +324,7 @@ int docmd_seed(arg_struct *arg) {
     #else
         if (x >= 1) {
             int exp = (int) floor(log10(x));
-            int8 mant = (int8) floor(x * pow(10.0, 11 - exp) + 0.5);
+            int8 mant = (int8) floor(x * p_pow10(11 - exp) + 0.5);
             if (mant >= 1000000000000LL) {
                 mant /= 10;
                 exp++;
@@ -1139,9 +1139,9 @@ int docmd_prp(arg_struct *arg) {
     return print_program(prgm_index, -1, -1, false);
 }
 
-static vartype *prv_var;
-static int4 prv_index;
-static bool prv_prreg;
+static CORE_TLS vartype *prv_var;
+static CORE_TLS int4 prv_index;
+static CORE_TLS bool prv_prreg;
 static int prv_worker(bool interrupted);
 
 int docmd_prv(arg_struct *arg) {
@@ -1507,8 +1507,8 @@ int docmd_prx(arg_struct *arg) {
     }
 }
 
-static int prusr_state;
-static int prusr_index;
+static CORE_TLS int prusr_state;
+static CORE_TLS int prusr_index;
 static int prusr_worker(bool interrupted);
 
 int docmd_prusr(arg_struct *arg) {
@@ -1626,7 +1626,7 @@ int docmd_prlcd(arg_struct *arg) {
     }
 }
 
-unsigned int printer_delay = 1800; // Default 1800ms
+CORE_TLS unsigned int printer_delay = 1800; // Default 1800ms
 
 int docmd_delay(arg_struct *arg) {
     phloat x = ((vartype_real *) stack[sp])->x;
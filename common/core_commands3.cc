@@ -656,14 +656,15 @@ int docmd_dot(arg_struct *arg) {
         vartype_realmatrix *rm2 = (vartype_realmatrix *) stack[sp - 1];
         int4 size = rm1->rows * rm1->columns;
         int4 i;
-        phloat dot = 0;
+        phloat dot = 0, comp = 0;
         int inf;
         if (size != rm2->rows * rm2->columns)
             return ERR_DIMENSION_ERROR;
         if (contains_strings(rm1) || contains_strings(rm2))
             return ERR_ALPHA_DATA_IS_INVALID;
         for (i = 0; i < size; i++)
-            dot += rm1->array->data[i] * rm2->array->data[i];
+            linalg_add_product(&dot, &comp, rm1->array->data[i], rm2->array->data[i]);
+        dot = linalg_sum(dot, comp);
         if ((inf = p_isinf(dot)) != 0) {
             if (flags.f.range_error_ignore)
                 dot = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
@@ -679,7 +680,7 @@ int docmd_dot(arg_struct *arg) {
         vartype_realmatrix *rm;
         vartype_complexmatrix *cm;
         int4 size, i;
-        phloat dot_re = 0, dot_im = 0;
+        phloat dot_re = 0, dot_im = 0, comp_re = 0, comp_im = 0;
         int inf;
         if (stack[sp]->type == TYPE_REALMATRIX) {
             rm = (vartype_realmatrix *) stack[sp];
@@ -694,9 +695,11 @@ int docmd_dot(arg_struct *arg) {
         if (contains_strings(rm))
             return ERR_ALPHA_DATA_IS_INVALID;
         for (i = 0; i < size; i++) {
-            dot_re += rm->array->data[i] * cm->array->data[2 * i];
-            dot_im += rm->array->data[i] * cm->array->data[2 * i + 1];
+            linalg_add_product(&dot_re, &comp_re, rm->array->data[i], cm->array->data[2 * i]);
+            linalg_add_product(&dot_im, &comp_im, rm->array->data[i], cm->array->data[2 * i + 1]);
         }
+        dot_re = linalg_sum(dot_re, comp_re);
+        dot_im = linalg_sum(dot_im, comp_im);
         if ((inf = p_isinf(dot_re)) != 0) {
             if (flags.f.range_error_ignore)
                 dot_re = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
@@ -1089,12 +1092,12 @@ static int fnrm(vartype *m, phloat *norm) {
         if (s > max_exp)
             max_exp = s;
     }
-    phloat nrm = 0;
+    phloat nrm = 0, comp = 0;
     for (int4 i = 0; i < size; i++) {
         phloat x = scalbn(data[i], -max_exp);
-        nrm += x * x;
+        linalg_add_product(&nrm, &comp, x, x);
     }
-    nrm = scalbn(sqrt(nrm), max_exp);
+    nrm = scalbn(sqrt(linalg_sum(nrm, comp)), max_exp);
     if (p_isinf(nrm)) {
         if (flags.f.range_error_ignore)
             nrm = POS_HUGE_PHLOAT;
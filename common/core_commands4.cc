@@ -1419,7 +1419,7 @@ int docmd_percent_ch(arg_struct *arg) {
     return ERR_NONE;
 }
 
-static vartype *matx_v;
+static CORE_TLS vartype *matx_v;
 
 static int matx_completion(int error, vartype *res) {
     if (error != ERR_NONE) {
@@ -381,7 +381,7 @@ int docmd_basechs(arg_struct *arg) {
     return ERR_NONE;
 }
 
-static struct sum_struct {
+static CORE_TLS struct sum_struct {
     phloat x;
     phloat x2;
     phloat y;
@@ -435,7 +435,7 @@ static int get_summation() {
     return ERR_NONE;
 }
 
-static struct model_struct {
+static CORE_TLS struct model_struct {
     phloat x;
     phloat x2;
     phloat y;
@@ -548,7 +548,7 @@ int docmd_e_pow_x(arg_struct *arg) {
     return err;
 }
 
-static int mappable_sqrt_r(phloat x, phloat *y) {
+int mappable_sqrt_r(phloat x, phloat *y) {
     if (x < 0)
         return ERR_INVALID_DATA;
     else {
@@ -581,7 +581,7 @@ int docmd_sqrt(arg_struct *arg) {
     }
 }
 
-static int mappable_square_r(phloat x, phloat *y) {
+int mappable_square_r(phloat x, phloat *y) {
     phloat r = x * x;
     int inf;
     if ((inf = p_isinf(r)) != 0) {
@@ -623,7 +623,7 @@ int docmd_square(arg_struct *arg) {
     return err;
 }
 
-static int mappable_inv_r(phloat x, phloat *y) {
+int mappable_inv_r(phloat x, phloat *y) {
     int inf;
     if (x == 0)
         return ERR_DIVIDE_BY_0;
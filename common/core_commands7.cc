@@ -27,6 +27,7 @@
 #include "core_globals.h"
 #include "core_helpers.h"
 #include "core_main.h"
+#include "core_math2.h"
 #include "core_sto_rcl.h"
 #include "core_variables.h"
 #include "shell.h"
@@ -705,7 +706,7 @@ int docmd_getkeya(arg_struct *arg) {
 
 #ifdef FREE42_FPTEST
 
-static int tests_lineno;
+static CORE_TLS int tests_lineno;
 extern const char *readtest_lines[];
 
 extern "C" {
@@ -2310,3 +2311,47 @@ int docmd_height(arg_struct *arg) {
         return ERR_INSUFFICIENT_MEMORY;
     return recall_result(v);
 }
+
+int docmd_ranm(arg_struct *arg) {
+    // Real matrix: returns a matrix of the same size, filled with random
+    // numbers, row by row. Real number n: returns a list of n random numbers.
+    // Either way, the numbers are the same ones that RAN, repeated, would
+    // have returned.
+    if (stack[sp]->type == TYPE_REALMATRIX) {
+        vartype_realmatrix *src = (vartype_realmatrix *) stack[sp];
+        vartype_realmatrix *rm = (vartype_realmatrix *) new_realmatrix(src->rows, src->columns);
+        if (rm == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
+        math_random_fill(rm->array->data, rm->rows * rm->columns);
+        unary_result((vartype *) rm);
+        return ERR_NONE;
+    }
+    int4 n;
+    if (!dim_to_int4(stack[sp], &n))
+        return ERR_DIMENSION_ERROR;
+    n++;
+    phloat *data = (phloat *) malloc((size_t) n * sizeof(phloat));
+    if (data == NULL)
+        return ERR_INSUFFICIENT_MEMORY;
+    vartype_list *list = (vartype_list *) new_list(n);
+    if (list == NULL) {
+        free(data);
+        return ERR_INSUFFICIENT_MEMORY;
+    }
+    int8 saved_low = random_number_low;
+    int8 saved_high = random_number_high;
+    math_random_fill(data, n);
+    for (int4 i = 0; i < n; i++) {
+        list->array->data[i] = new_real(data[i]);
+        if (list->array->data[i] == NULL) {
+            free(data);
+            free_vartype((vartype *) list);
+            random_number_low = saved_low;
+            random_number_high = saved_high;
+            return ERR_INSUFFICIENT_MEMORY;
+        }
+    }
+    free(data);
+    unary_result((vartype *) list);
+    return ERR_NONE;
+}
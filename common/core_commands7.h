@@ -132,4 +132,6 @@ int docmd_from_list(arg_struct *arg);
 int docmd_width(arg_struct *arg);
 int docmd_height(arg_struct *arg);
 
+int docmd_ranm(arg_struct *arg);
+
 #endif
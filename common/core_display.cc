@@ -585,7 +585,7 @@ static char smallchars_map[131] =
 
 
 
-static char display[272];
+static CORE_TLS char display[272];
 
 #ifdef ARM
 char* core_display_buffer() {
@@ -593,29 +593,29 @@ char* core_display_buffer() {
 }
 #endif
 
-static bool is_dirty = false;
-static int dirty_top, dirty_left, dirty_bottom, dirty_right;
+static CORE_TLS bool is_dirty = false;
+static CORE_TLS int dirty_top, dirty_left, dirty_bottom, dirty_right;
 
-static int catalogmenu_section[5];
-static int catalogmenu_rows[5];
-static int catalogmenu_row[5];
-static int catalogmenu_item[5][6];
+static CORE_TLS int catalogmenu_section[5];
+static CORE_TLS int catalogmenu_rows[5];
+static CORE_TLS int catalogmenu_row[5];
+static CORE_TLS int catalogmenu_item[5][6];
 
-static int custommenu_length[3][6];
-static char custommenu_label[3][6][7];
+static CORE_TLS int custommenu_length[3][6];
+static CORE_TLS char custommenu_label[3][6][7];
 
-static arg_struct progmenu_arg[9];
-static bool progmenu_is_gto[9];
-static int progmenu_length[6];
-static char progmenu_label[6][7];
+static CORE_TLS arg_struct progmenu_arg[9];
+static CORE_TLS bool progmenu_is_gto[9];
+static CORE_TLS int progmenu_length[6];
+static CORE_TLS char progmenu_label[6][7];
 
-static int appmenu_exitcallback;
+static CORE_TLS int appmenu_exitcallback;
 
 /* Menu keys that should respond to certain hardware
  * keyboard keys, in addition to the keymap:
  * 0:none 1:left 2:shift-left 3:right 4:shift-right 5:del
  */
-static char special_key[6] = { 0, 0, 0, 0, 0, 0 };
+static CORE_TLS char special_key[6] = { 0, 0, 0, 0, 0, 0 };
 
 
 /*******************************/
@@ -813,7 +813,7 @@ void draw_pattern(phloat dx, phloat dy, const char *pattern, int pattern_width){
 }
 
 void fly_goose() {
-    static uint4 lastgoosetime = 0;
+    static CORE_TLS uint4 lastgoosetime = 0;
     uint4 goosetime = shell_milliseconds();
     if (goosetime < lastgoosetime)
         // shell_millisends() wrapped around
@@ -1147,14 +1147,32 @@ void tb_write_null(textbuf *tb) {
     tb_write(tb, &c, 1);
 }
 
+static void tb_write_prgmline(textbuf *tb, int4 line, int cmd, arg_struct *arg, const char *orig_num) {
+    char buf[100];
+    char utf8buf[500];
+    char *xstr = NULL;
+    int len = prgmline2buf(buf, 100, line, cmd == CMD_LBL, cmd, arg, orig_num, false, false, &xstr);
+    char *buf2 = xstr == NULL ? buf : xstr;
+    for (int i = 0; i < len; i++)
+        if (buf2[i] == 10)
+            buf2[i] = 138;
+    int off = 0;
+    while (len > 0) {
+        int slen = len <= 100 ? len : 100;
+        int utf8len = hp2ascii(utf8buf, buf2 + off, slen);
+        tb_write(tb, utf8buf, utf8len);
+        off += slen;
+        len -= slen;
+    }
+    free(xstr);
+}
+
 void tb_print_current_program(textbuf *tb) {
     int4 pc = 0;
     int line = 0;
     int cmd;
     arg_struct arg;
     bool end = false;
-    char buf[100];
-    char utf8buf[500];
     do {
         const char *orig_num;
         if (line > 0) {
@@ -1162,26 +1180,24 @@ void tb_print_current_program(textbuf *tb) {
             if (cmd == CMD_END)
                 end = true;
         }
-        char *xstr = NULL;
-        int len = prgmline2buf(buf, 100, line, cmd == CMD_LBL, cmd, &arg, orig_num, false, false, &xstr);
-        char *buf2 = xstr == NULL ? buf : xstr;
-        for (int i = 0; i < len; i++)
-            if (buf2[i] == 10)
-                buf2[i] = 138;
-        int off = 0;
-        while (len > 0) {
-            int slen = len <= 100 ? len : 100;
-            int utf8len = hp2ascii(utf8buf, buf2 + off, slen);
-            tb_write(tb, utf8buf, utf8len);
-            off += slen;
-            len -= slen;
-        }
+        tb_write_prgmline(tb, line, cmd, &arg, orig_num);
         tb_write(tb, "\r\n", 2);
-        free(xstr);
         line++;
     } while (!end);
 }
 
+void tb_print_program_line(textbuf *tb, int prgm, int4 pc) {
+    int saved_prgm = current_prgm;
+    current_prgm = prgm;
+    int4 line = pc2line(pc);
+    int cmd;
+    arg_struct arg;
+    const char *orig_num;
+    get_next_command(&pc, &cmd, &arg, 0, &orig_num);
+    current_prgm = saved_prgm;
+    tb_write_prgmline(tb, line, cmd, &arg, orig_num);
+}
+
 void display_prgm_line(int row, int line_offset) {
     int4 tmppc = pc;
     int4 tmpline = pc2line(pc);
@@ -1643,16 +1659,17 @@ static int ext_stk_cat[] = {
 static int ext_misc_cat[] = {
     CMD_A2LINE, CMD_A2PLINE, CMD_CAPS,   CMD_C_LN_1_X, CMD_C_E_POW_X_1, CMD_FMA,
     CMD_GETLI,  CMD_GETMI,   CMD_HEIGHT, CMD_LOCK,     CMD_MIXED,       CMD_PCOMPLX,
-    CMD_PRREG,  CMD_PUTLI,   CMD_PUTMI,  CMD_RCOMPLX,  CMD_STRACE,      CMD_UNLOCK,
-    CMD_WIDTH,  CMD_X2LINE,  CMD_ACCEL,  CMD_LOCAT,    CMD_HEADING,     CMD_FPTEST
+    CMD_PRREG,  CMD_PUTLI,   CMD_PUTMI,  CMD_RANM,     CMD_RCOMPLX,     CMD_STRACE,
+    CMD_UNLOCK, CMD_WIDTH,   CMD_X2LINE, CMD_ACCEL,    CMD_LOCAT,       CMD_HEADING,
+    CMD_FPTEST, CMD_NULL,    CMD_NULL,   CMD_NULL,     CMD_NULL,        CMD_NULL
 };
-#define MISC_CAT_ROWS 4
+#define MISC_CAT_ROWS 5
 #else
 static int ext_misc_cat[] = {
     CMD_A2LINE, CMD_A2PLINE, CMD_CAPS,   CMD_C_LN_1_X, CMD_C_E_POW_X_1, CMD_FMA,
     CMD_GETLI,  CMD_GETMI,   CMD_HEIGHT, CMD_LOCK,     CMD_MIXED,       CMD_PCOMPLX,
-    CMD_PRREG,  CMD_PUTLI,   CMD_PUTMI,  CMD_RCOMPLX,  CMD_STRACE,      CMD_UNLOCK,
-    CMD_WIDTH,  CMD_X2LINE,  CMD_ACCEL,  CMD_LOCAT,    CMD_HEADING,     CMD_NULL
+    CMD_PRREG,  CMD_PUTLI,   CMD_PUTMI,  CMD_RANM,     CMD_RCOMPLX,     CMD_STRACE,
+    CMD_UNLOCK, CMD_WIDTH,   CMD_X2LINE, CMD_ACCEL,    CMD_LOCAT,       CMD_HEADING
 };
 #define MISC_CAT_ROWS 4
 #endif
@@ -1661,16 +1678,16 @@ static int ext_misc_cat[] = {
 static int ext_misc_cat[] = {
     CMD_A2LINE, CMD_A2PLINE, CMD_CAPS,   CMD_C_LN_1_X, CMD_C_E_POW_X_1, CMD_FMA,
     CMD_GETLI,  CMD_GETMI,   CMD_HEIGHT, CMD_LOCK,     CMD_MIXED,       CMD_PCOMPLX,
-    CMD_PRREG,  CMD_PUTLI,   CMD_PUTMI,  CMD_RCOMPLX,  CMD_STRACE,      CMD_UNLOCK,
-    CMD_WIDTH,  CMD_X2LINE,  CMD_FPTEST, CMD_NULL,     CMD_NULL,        CMD_NULL
+    CMD_PRREG,  CMD_PUTLI,   CMD_PUTMI,  CMD_RANM,     CMD_RCOMPLX,     CMD_STRACE,
+    CMD_UNLOCK, CMD_WIDTH,   CMD_X2LINE, CMD_FPTEST,   CMD_NULL,        CMD_NULL
 };
 #define MISC_CAT_ROWS 4
 #else
 static int ext_misc_cat[] = {
     CMD_A2LINE, CMD_A2PLINE, CMD_CAPS,   CMD_C_LN_1_X, CMD_C_E_POW_X_1, CMD_FMA,
     CMD_GETLI,  CMD_GETMI,   CMD_HEIGHT, CMD_LOCK,     CMD_MIXED,       CMD_PCOMPLX,
-    CMD_PRREG,  CMD_PUTLI,   CMD_PUTMI,  CMD_RCOMPLX,  CMD_STRACE,      CMD_UNLOCK,
-    CMD_WIDTH,  CMD_X2LINE,  CMD_NULL,   CMD_NULL,     CMD_NULL,        CMD_NULL
+    CMD_PRREG,  CMD_PUTLI,   CMD_PUTMI,  CMD_RANM,     CMD_RCOMPLX,     CMD_STRACE,
+    CMD_UNLOCK, CMD_WIDTH,   CMD_X2LINE, CMD_NULL,     CMD_NULL,        CMD_NULL
 };
 #define MISC_CAT_ROWS 4
 #endif
@@ -2113,7 +2130,7 @@ void redisplay() {
     int i;
 
 #if defined(ANDROID) || defined(IPHONE)
-    static bool popup_keyboard_visible;
+    static CORE_TLS bool popup_keyboard_visible;
     bool popup_kb = core_alpha_menu();
     if (mode_popup_unknown || popup_keyboard_visible != popup_kb) {
         mode_popup_unknown = false;
@@ -2461,7 +2478,7 @@ struct prp_data_struct {
     bool full_xstr;
 };
 
-static prp_data_struct *prp_data;
+static CORE_TLS prp_data_struct *prp_data;
 static int print_program_worker(bool interrupted);
 
 int print_program(int prgm_index, int4 pc, int4 lines, bool normal) {
@@ -39,7 +39,7 @@
 // File used for reading and writing the state file, and for importing and
 // exporting programs. Since only one of these operations can be active at one
 // time, having one FILE pointer for all of them is sufficient.
-FILE *gfile = NULL;
+CORE_TLS FILE *gfile = NULL;
 
 const error_spec errors[] = {
     { /* NONE */                   NULL,                       0 },
@@ -568,143 +568,143 @@ const menu_spec menus[] = {
 #define LABELS_INCREMENT 10
 
 /* Registers */
-vartype **stack = NULL;
-int sp = -1;
-int stack_capacity = 0;
-vartype *lastx = NULL;
-int reg_alpha_length = 0;
-char reg_alpha[44];
+CORE_TLS vartype **stack = NULL;
+CORE_TLS int sp = -1;
+CORE_TLS int stack_capacity = 0;
+CORE_TLS vartype *lastx = NULL;
+CORE_TLS int reg_alpha_length = 0;
+CORE_TLS char reg_alpha[44];
 
 /* Flags */
-flags_struct flags;
+CORE_TLS flags_struct flags;
 const char *virtual_flags =
     /* 00-49 */ "00000000000000000000000000010000000000000000111111"
     /* 50-99 */ "00010000000000010000000001000000000000000000000000";
 
 /* Variables */
-int vars_capacity = 0;
-int vars_count = 0;
-var_struct *vars = NULL;
+CORE_TLS int vars_capacity = 0;
+CORE_TLS int vars_count = 0;
+CORE_TLS var_struct *vars = NULL;
 
 /* Programs */
-int prgms_capacity = 0;
-int prgms_count = 0;
-prgm_struct *prgms = NULL;
-int labels_capacity = 0;
-int labels_count = 0;
-label_struct *labels = NULL;
-
-int current_prgm = -1;
-int4 pc;
-int prgm_highlight_row = 0;
-
-int varmenu_length;
-char varmenu[7];
-int varmenu_rows;
-int varmenu_row;
-int varmenu_labellength[6];
-char varmenu_labeltext[6][7];
-int varmenu_role;
-
-bool mode_clall;
-int (*mode_interruptible)(bool) = NULL;
-bool mode_stoppable;
-bool mode_command_entry;
-char mode_number_entry;
-bool mode_alpha_entry;
-bool mode_shift;
-int mode_appmenu;
-int mode_plainmenu;
-bool mode_plainmenu_sticky;
-int mode_transientmenu;
-int mode_alphamenu;
-int mode_commandmenu;
-bool mode_running;
-bool mode_getkey;
-bool mode_getkey1;
-bool mode_pause = false;
-bool mode_disable_stack_lift; /* transient */
-bool mode_caller_stack_lift_disabled;
-bool mode_varmenu;
-bool mode_updown;
-int4 mode_sigma_reg;
-int mode_goose;
-bool mode_time_clktd;
-bool mode_time_clk24;
-int mode_wsize;
-bool mode_menu_caps;
+CORE_TLS int prgms_capacity = 0;
+CORE_TLS int prgms_count = 0;
+CORE_TLS prgm_struct *prgms = NULL;
+CORE_TLS int labels_capacity = 0;
+CORE_TLS int labels_count = 0;
+CORE_TLS label_struct *labels = NULL;
+
+CORE_TLS int current_prgm = -1;
+CORE_TLS int4 pc;
+CORE_TLS int prgm_highlight_row = 0;
+
+CORE_TLS int varmenu_length;
+CORE_TLS char varmenu[7];
+CORE_TLS int varmenu_rows;
+CORE_TLS int varmenu_row;
+CORE_TLS int varmenu_labellength[6];
+CORE_TLS char varmenu_labeltext[6][7];
+CORE_TLS int varmenu_role;
+
+CORE_TLS bool mode_clall;
+CORE_TLS int (*mode_interruptible)(bool) = NULL;
+CORE_TLS bool mode_stoppable;
+CORE_TLS bool mode_command_entry;
+CORE_TLS char mode_number_entry;
+CORE_TLS bool mode_alpha_entry;
+CORE_TLS bool mode_shift;
+CORE_TLS int mode_appmenu;
+CORE_TLS int mode_plainmenu;
+CORE_TLS bool mode_plainmenu_sticky;
+CORE_TLS int mode_transientmenu;
+CORE_TLS int mode_alphamenu;
+CORE_TLS int mode_commandmenu;
+CORE_TLS bool mode_running;
+CORE_TLS bool mode_getkey;
+CORE_TLS bool mode_getkey1;
+CORE_TLS bool mode_pause = false;
+CORE_TLS bool mode_disable_stack_lift; /* transient */
+CORE_TLS bool mode_caller_stack_lift_disabled;
+CORE_TLS bool mode_varmenu;
+CORE_TLS bool mode_updown;
+CORE_TLS int4 mode_sigma_reg;
+CORE_TLS int mode_goose;
+CORE_TLS bool mode_time_clktd;
+CORE_TLS bool mode_time_clk24;
+CORE_TLS int mode_wsize;
+CORE_TLS bool mode_menu_caps;
 #if defined(ANDROID) || defined(IPHONE)
-bool mode_popup_unknown = true;
+CORE_TLS bool mode_popup_unknown = true;
 #endif
 
-phloat entered_number;
-int entered_string_length;
-char entered_string[15];
+CORE_TLS phloat entered_number;
+CORE_TLS int entered_string_length;
+CORE_TLS char entered_string[15];
 
-int pending_command;
-arg_struct pending_command_arg;
-int xeq_invisible;
+CORE_TLS int pending_command;
+CORE_TLS arg_struct pending_command_arg;
+CORE_TLS int xeq_invisible;
 
 /* Multi-keystroke commands -- edit state */
 /* Relevant when mode_command_entry != 0 */
-int incomplete_command;
-bool incomplete_ind;
-bool incomplete_alpha;
-int incomplete_length;
-int incomplete_maxdigits;
-int incomplete_argtype;
-int incomplete_num;
-char incomplete_str[22];
-int4 incomplete_saved_pc;
-int4 incomplete_saved_highlight_row;
+CORE_TLS int incomplete_command;
+CORE_TLS bool incomplete_ind;
+CORE_TLS bool incomplete_alpha;
+CORE_TLS int incomplete_length;
+CORE_TLS int incomplete_maxdigits;
+CORE_TLS int incomplete_argtype;
+CORE_TLS int incomplete_num;
+CORE_TLS char incomplete_str[22];
+CORE_TLS int4 incomplete_saved_pc;
+CORE_TLS int4 incomplete_saved_highlight_row;
 
 /* Command line handling temporaries */
-char cmdline[100];
-int cmdline_length;
-int cmdline_row;
+CORE_TLS char cmdline[100];
+CORE_TLS int cmdline_length;
+CORE_TLS int cmdline_row;
 
 /* Matrix editor / matrix indexing */
-int matedit_mode; /* 0=off, 1=index, 2=edit, 3=editn */
-int matedit_level;
-char matedit_name[7];
-int matedit_length;
-vartype *matedit_x;
-int4 matedit_i;
-int4 matedit_j;
-int matedit_prev_appmenu;
-int4 *matedit_stack = NULL;
-int matedit_stack_depth = 0;
-bool matedit_is_list;
+CORE_TLS int matedit_mode; /* 0=off, 1=index, 2=edit, 3=editn */
+CORE_TLS int matedit_level;
+CORE_TLS char matedit_name[7];
+CORE_TLS int matedit_length;
+CORE_TLS vartype *matedit_x;
+CORE_TLS int4 matedit_i;
+CORE_TLS int4 matedit_j;
+CORE_TLS int matedit_prev_appmenu;
+CORE_TLS int4 *matedit_stack = NULL;
+CORE_TLS int matedit_stack_depth = 0;
+CORE_TLS bool matedit_is_list;
 
 /* INPUT */
-char input_name[11];
-int input_length;
-arg_struct input_arg;
+CORE_TLS char input_name[11];
+CORE_TLS int input_length;
+CORE_TLS arg_struct input_arg;
 
 /* ERRMSG/ERRNO */
-int lasterr = 0;
-int lasterr_length;
-char lasterr_text[22];
+CORE_TLS int lasterr = 0;
+CORE_TLS int lasterr_length;
+CORE_TLS char lasterr_text[22];
 
 /* BASE application */
-int baseapp = 0;
+CORE_TLS int baseapp = 0;
 
 /* Random number generator */
-int8 random_number_low, random_number_high;
+CORE_TLS int8 random_number_low, random_number_high;
 
 /* NORM & TRACE mode: number waiting to be printed */
-int deferred_print = 0;
+CORE_TLS int deferred_print = 0;
 
 /* Keystroke buffer - holds keystrokes received while
  * there is a program running.
  */
-int keybuf_head = 0;
-int keybuf_tail = 0;
-int keybuf[16];
+CORE_TLS int keybuf_head = 0;
+CORE_TLS int keybuf_tail = 0;
+CORE_TLS int keybuf[16];
 
-int remove_program_catalog = 0;
+CORE_TLS int remove_program_catalog = 0;
 
-int state_file_number_format;
+CORE_TLS int state_file_number_format;
 
 /* No user interaction: we keep track of whether or not the user
  * has pressed any keys since powering up, and we don't allow
@@ -715,7 +715,7 @@ int state_file_number_format;
  *
  * from locking the user out.
  */
-bool no_keystrokes_yet;
+CORE_TLS bool no_keystrokes_yet;
 
 
 /* Version number for the state file.
@@ -746,8 +746,10 @@ bool no_keystrokes_yet;
  * Version 47: 3.1    Back-port of Plus42 RTN stack; FUNC stack hiding
  * Version 48: 3.1    Matrix editor nested lists
  * Version 49: 3.1.13 Program locking
+ * Version 50:        Binary engine, accumulation, mixed-precision, and
+ *                    transcendental cache settings
  */
-#define FREE42_VERSION 49
+#define FREE42_VERSION 50
 
 
 /*******************/
@@ -796,21 +798,26 @@ struct rtn_stack_entry {
 };
 
 #define MAX_RTN_LEVEL 1024
-static int rtn_stack_capacity = 0;
-static rtn_stack_entry *rtn_stack = NULL;
-static int rtn_level = 0;
-static bool rtn_level_0_has_matrix_entry;
-static bool rtn_level_0_has_func_state;
-static int rtn_stop_level = -1;
-static bool rtn_solve_active = false;
-static bool rtn_integ_active = false;
+static CORE_TLS int rtn_stack_capacity = 0;
+static CORE_TLS rtn_stack_entry *rtn_stack = NULL;
+static CORE_TLS int rtn_level = 0;
+static CORE_TLS bool rtn_level_0_has_matrix_entry;
+static CORE_TLS bool rtn_level_0_has_func_state;
+static CORE_TLS int rtn_stop_level = -1;
+static CORE_TLS bool rtn_solve_active = false;
+static CORE_TLS bool rtn_integ_active = false;
+
+static void update_phloat_memo() {
+    phloat_memo_enable(core_settings.transcendental_cache
+                       && (rtn_solve_active || rtn_integ_active));
+}
 
 #ifdef IPHONE
 /* For iPhone, we disable OFF by default, to satisfy App Store
  * policy, but we allow users to enable it using a magic value
  * in the X register. This flag determines OFF behavior.
  */
-bool off_enable_flag = false;
+CORE_TLS bool off_enable_flag = false;
 #endif
 
 struct matrix_persister {
@@ -819,9 +826,9 @@ struct matrix_persister {
     int4 columns;
 };
 
-static int array_count;
-static int array_list_capacity;
-static void **array_list;
+static CORE_TLS int array_count;
+static CORE_TLS int array_list_capacity;
+static CORE_TLS void **array_list;
 
 
 static bool array_list_grow();
@@ -829,7 +836,15 @@ static int array_list_search(void *array);
 static bool persist_vartype(vartype *v);
 static bool unpersist_vartype(vartype **v);
 static void update_label_table(int prgm, int4 pc, int inserted);
+static int label_search(int prgm, int4 pc);
+static bool insert_label(int index, int prgm, int4 pc, const char *name, int length);
+static void remove_label(int index);
+static void invalidate_label_hash();
 static void invalidate_lclbls(int prgm_index, bool force);
+static void invalidate_decoded(int prgm_index);
+static void detach_compiled_prgm(int prgm_index);
+static void detach_compiled_prgms();
+static void free_compiled_states();
 static int pc_line_convert(int4 loc, int loc_is_pc);
 
 #ifdef BCD_MATH
@@ -1021,11 +1036,11 @@ struct old_vartype_string {
 // should then clean up what has already been read, rewind the state file,
 // and try again in mode 2.
 
-int bug_mode;
+CORE_TLS int bug_mode;
 
 // Using a global for 'ver' so we don't have to pass it around all the time
 
-int4 ver;
+CORE_TLS int4 ver;
 
 static bool unpersist_vartype(vartype **v) {
     char type;
@@ -1366,7 +1381,7 @@ static bool persist_globals() {
     return ret;
 }
 
-bool loading_state = false;
+CORE_TLS bool loading_state = false;
 
 static bool unpersist_globals() {
     int i;
@@ -1466,6 +1481,7 @@ static bool unpersist_globals() {
         free(prgms);
         prgms = NULL;
     }
+    detach_compiled_prgms();
     int nprogs;
     if (!read_int(&nprogs)) {
         goto done;
@@ -1534,6 +1550,7 @@ static bool unpersist_globals() {
         }
     }
     vars_capacity = vars_count;
+    invalidate_var_index();
 
     if (!read_int(&varmenu_length)) {
         varmenu_length = 0;
@@ -1665,6 +1682,7 @@ static bool unpersist_globals() {
                 vars[pos].flags = VAR_PRIVATE;
                 vars[pos].value = (vartype *) list;
                 vars_count++;
+                invalidate_var_index();
             }
         }
         current_prgm = saved_prgm;
@@ -1673,6 +1691,7 @@ static bool unpersist_globals() {
         goto done;
     if (!read_bool(&rtn_integ_active))
         goto done;
+    update_phloat_memo();
 
     ret = true;
 
@@ -1684,9 +1703,11 @@ static bool unpersist_globals() {
 void clear_all_prgms() {
     if (prgms != NULL) {
         int i;
-        for (i = 0; i < prgms_count; i++)
+        for (i = 0; i < prgms_count; i++) {
             if (prgms[i].text != NULL)
                 free(prgms[i].text);
+            free(prgms[i].decoded);
+        }
         free(prgms);
     }
     prgms = NULL;
@@ -1697,6 +1718,9 @@ void clear_all_prgms() {
     labels = NULL;
     labels_capacity = 0;
     labels_count = 0;
+    invalidate_label_hash();
+    free_compiled_states();
+    profiler_discard_lines();
 }
 
 int clear_prgm(const arg_struct *arg) {
@@ -1710,12 +1734,8 @@ int clear_prgm(const arg_struct *arg) {
             prgm_index = current_prgm;
         } else {
             int i;
-            for (i = labels_count - 1; i >= 0; i--)
-                if (string_equals(arg->val.text, arg->length,
-                                 labels[i].name, labels[i].length))
-                    goto found;
-            return ERR_LABEL_NOT_FOUND;
-            found:
+            if (!find_global_label_index(arg, &i))
+                return ERR_LABEL_NOT_FOUND;
             prgm_index = labels[i].prgm;
         }
     }
@@ -1732,9 +1752,11 @@ int clear_prgm_by_index(int prgm_index) {
     else if (current_prgm > prgm_index)
         current_prgm--;
     free(prgms[prgm_index].text);
+    free(prgms[prgm_index].decoded);
     for (i = prgm_index; i < prgms_count - 1; i++)
         prgms[i] = prgms[i + 1];
     prgms_count--;
+    detach_compiled_prgms();
     i = j = 0;
     while (j < labels_count) {
         if (j > i)
@@ -1747,6 +1769,7 @@ int clear_prgm_by_index(int prgm_index) {
             i++;
     }
     labels_count = i;
+    invalidate_label_hash();
     if (prgms_count == 0 || prgm_index == prgms_count) {
         int saved_prgm = current_prgm;
         int saved_pc = pc;
@@ -1795,9 +1818,13 @@ void clear_prgm_lines(int4 count) {
         } else
             i++;
     }
-    labels_count = i;
+    if (labels_count != i) {
+        labels_count = i;
+        invalidate_label_hash();
+    }
 
     invalidate_lclbls(current_prgm, false);
+    invalidate_decoded(current_prgm);
     clear_all_rtns();
 }
 
@@ -1832,6 +1859,10 @@ void goto_dot_dot(bool force_new) {
     prgms[current_prgm].lclbl_invalid = true;
     prgms[current_prgm].locked = false;
     prgms[current_prgm].text = NULL;
+    prgms[current_prgm].decoded = NULL;
+    prgms[current_prgm].decoded_count = 0;
+    prgms[current_prgm].decoded_last = -1;
+    prgms[current_prgm].compiled = -2;
     command = CMD_END;
     arg.type = ARGTYPE_NONE;
     store_command(0, command, &arg, NULL);
@@ -2029,15 +2060,283 @@ void get_next_command(int4 *pc, int *command, arg_struct *arg, int find_target,
     }
 }
 
+static bool decode_prgm(prgm_struct *prgm) {
+    int4 count = 0;
+    int4 p = 0;
+    while (p < prgm->size) {
+        p += get_command_length(current_prgm, p);
+        count++;
+    }
+    decoded_cmd *d = (decoded_cmd *) malloc(count * sizeof(decoded_cmd));
+    if (d == NULL)
+        return false;
+    p = 0;
+    for (int4 i = 0; i < count; i++) {
+        d[i].pc = p;
+        get_next_command(&p, &d[i].cmd, &d[i].arg, 0, NULL);
+        d[i].next_pc = p;
+        if ((d[i].cmd == CMD_GTO || d[i].cmd == CMD_XEQ)
+                && (d[i].arg.type == ARGTYPE_NUM
+                    || d[i].arg.type == ARGTYPE_LCLBL
+                    || d[i].arg.type == ARGTYPE_STK)) {
+            /* get_next_command() doesn't fill in the target when not
+             * asked to find it; copy whatever is cached in the program
+             * text, which may be -1 ('unknown'), in which case the
+             * target will be resolved the first time the line is
+             * executed.
+             */
+            int4 target_pc = 0;
+            for (int j = 2; j < 6; j++)
+                target_pc = (target_pc << 8) | prgm->text[d[i].pc + j];
+            d[i].arg.target = target_pc;
+        }
+    }
+    prgm->decoded = d;
+    prgm->decoded_count = count;
+    prgm->decoded_last = -1;
+    return true;
+}
+
+void get_next_command_cached(int4 *pc, int *command, arg_struct *arg) {
+    /* Equivalent to get_next_command(pc, command, arg, 1, NULL), but using
+     * the program's decode cache, which is built when this is first called
+     * for the current program. The cached arg is copied, since handlers are
+     * allowed to modify the arg they are passed, e.g. in resolve_ind_arg().
+     */
+    prgm_struct *prgm = prgms + current_prgm;
+    if (!core_settings.decode_cache
+            || prgm->decoded == NULL && !decode_prgm(prgm)) {
+        get_next_command(pc, command, arg, 1, NULL);
+        return;
+    }
+    decoded_cmd *d = prgm->decoded;
+    int4 i = prgm->decoded_last + 1;
+    if (i >= prgm->decoded_count || d[i].pc != *pc) {
+        /* Not sequential; we got here via a jump or a return */
+        int4 lo = 0, hi = prgm->decoded_count - 1;
+        i = -1;
+        while (lo <= hi) {
+            int4 mid = (lo + hi) >> 1;
+            if (d[mid].pc < *pc)
+                lo = mid + 1;
+            else if (d[mid].pc > *pc)
+                hi = mid - 1;
+            else {
+                i = mid;
+                break;
+            }
+        }
+        if (i == -1) {
+            get_next_command(pc, command, arg, 1, NULL);
+            return;
+        }
+    }
+    prgm->decoded_last = i;
+    d += i;
+    if (d->arg.target == -1 && (d->cmd == CMD_GTO || d->cmd == CMD_XEQ)
+            && (d->arg.type == ARGTYPE_NUM
+                || d->arg.type == ARGTYPE_LCLBL
+                || d->arg.type == ARGTYPE_STK)) {
+        /* Local label target not resolved yet; let get_next_command()
+         * find it, and remember the result.
+         */
+        get_next_command(pc, command, arg, 1, NULL);
+        d->arg.target = arg->target;
+        return;
+    }
+    *command = d->cmd;
+    *arg = d->arg;
+    *pc = d->next_pc;
+}
+
+static void invalidate_decoded(int prgm_index) {
+    prgm_struct *prgm = prgms + prgm_index;
+    free(prgm->decoded);
+    prgm->decoded = NULL;
+    prgm->decoded_count = 0;
+    prgm->decoded_last = -1;
+    detach_compiled_prgm(prgm_index);
+}
+
+/* Compiled programs
+ *
+ * Programs translated to C++ by raw2cc register themselves through
+ * core_register_compiled_programs(). When a program is run, we look for a
+ * registered program with the same text, and if there is one, its code is
+ * run instead of the interpreter, until it returns control.
+ * prgm_struct.compiled caches the result of that search: -2 means not
+ * searched yet, -1 means no match, and anything else is an index into
+ * compiled_prgms[]. A compiled program works on copies of its instructions'
+ * arguments, decoded from the program it is attached to, in the same way as
+ * decode_prgm() does it; the attached field tracks which program that is, so
+ * the arguments can be decoded again when that changes. The registry is
+ * shared by all calculators, while the decoded arguments belong to just one,
+ * so those are kept separately, in compiled_states[].
+ */
+
+struct compiled_prgm_state {
+    arg_struct *args;
+    int attached;
+};
+
+static const core_compiled_program **compiled_prgms = NULL;
+static int compiled_prgms_count = 0;
+static CORE_TLS compiled_prgm_state *compiled_states = NULL;
+static CORE_TLS int compiled_states_count = 0;
+
+void core_register_compiled_programs(const core_compiled_program *progs, int count) {
+    const core_compiled_program **newprgms = (const core_compiled_program **)
+            realloc(compiled_prgms, (compiled_prgms_count + count) * sizeof(core_compiled_program *));
+    if (newprgms == NULL)
+        return;
+    compiled_prgms = newprgms;
+    for (int i = 0; i < count; i++)
+        compiled_prgms[compiled_prgms_count++] = progs + i;
+    detach_compiled_prgms();
+}
+
+static void detach_compiled_prgm(int prgm_index) {
+    /* Called when a program's text changes */
+    prgm_struct *prgm = prgms + prgm_index;
+    if (prgm->compiled >= 0 && prgm->compiled < compiled_states_count
+            && compiled_states[prgm->compiled].attached == prgm_index)
+        compiled_states[prgm->compiled].attached = -1;
+    prgm->compiled = -2;
+    profiler_discard_lines();
+}
+
+static void detach_compiled_prgms() {
+    /* Called when programs are added, removed, or renumbered */
+    for (int i = 0; i < compiled_states_count; i++)
+        compiled_states[i].attached = -1;
+    for (int i = 0; i < prgms_count; i++)
+        prgms[i].compiled = -2;
+    profiler_discard_lines();
+}
+
+static void free_compiled_states() {
+    for (int i = 0; i < compiled_states_count; i++)
+        free(compiled_states[i].args);
+    free(compiled_states);
+    compiled_states = NULL;
+    compiled_states_count = 0;
+}
+
+static bool compiled_text_matches(const core_compiled_program *cp) {
+    /* Compares the current program's text to that of a compiled program,
+     * ignoring the parts that the interpreter rewrites while running: the
+     * cached targets of local GTO and XEQ, and the decimal separators in
+     * numbers as originally entered.
+     */
+    prgm_struct *prgm = prgms + current_prgm;
+    if (prgm->size != cp->size)
+        return false;
+    int4 pc = 0;
+    while (pc < prgm->size) {
+        int4 next = pc;
+        int cmd;
+        arg_struct arg;
+        const char *num_str = NULL;
+        get_next_command(&next, &cmd, &arg, 0, &num_str);
+        int4 target_pos = -1;
+        if ((cmd == CMD_GTO || cmd == CMD_XEQ)
+                && (arg.type == ARGTYPE_NUM
+                    || arg.type == ARGTYPE_LCLBL
+                    || arg.type == ARGTYPE_STK))
+            target_pos = pc + 2;
+        int4 num_pos = num_str == NULL ? next : (int4) ((const unsigned char *) num_str - prgm->text);
+        for (int4 i = pc; i < next; i++) {
+            if (i >= target_pos && i < target_pos + 4)
+                continue;
+            unsigned char a = prgm->text[i];
+            unsigned char b = cp->text[i];
+            if (a != b && !(i >= num_pos && (a == '.' || a == ',') && (b == '.' || b == ',')))
+                return false;
+        }
+        pc = next;
+    }
+    return true;
+}
+
+int run_compiled_prgm(int4 *instr_pc) {
+    /* Runs the current program, starting at pc, using compiled code, if
+     * there is any. Returns COMPILED_INTERPRET, with *instr_pc == pc, when it
+     * reaches an instruction that wasn't compiled, or right away if there is
+     * no compiled code for the program. Otherwise, the return value and
+     * *instr_pc are the error code and pc of the last instruction executed,
+     * and it is up to the caller to act on the error code, like it would
+     * after calling handle().
+     */
+    prgm_struct *prgm = prgms + current_prgm;
+    if (prgm->compiled == -2) {
+        prgm->compiled = -1;
+        for (int i = 0; i < compiled_prgms_count; i++)
+            if (compiled_text_matches(compiled_prgms[i])) {
+                prgm->compiled = i;
+                break;
+            }
+    }
+    if (prgm->compiled == -1) {
+        *instr_pc = pc;
+        return COMPILED_INTERPRET;
+    }
+    const core_compiled_program *cp = compiled_prgms[prgm->compiled];
+    if (prgm->compiled >= compiled_states_count) {
+        compiled_prgm_state *newstates = (compiled_prgm_state *)
+                realloc(compiled_states, compiled_prgms_count * sizeof(compiled_prgm_state));
+        if (newstates == NULL) {
+            *instr_pc = pc;
+            return COMPILED_INTERPRET;
+        }
+        for (int i = compiled_states_count; i < compiled_prgms_count; i++) {
+            newstates[i].args = NULL;
+            newstates[i].attached = -1;
+        }
+        compiled_states = newstates;
+        compiled_states_count = compiled_prgms_count;
+    }
+    compiled_prgm_state *e = compiled_states + prgm->compiled;
+    if (e->attached != current_prgm) {
+        if (e->attached != -1)
+            prgms[e->attached].compiled = -2;
+        if (e->args == NULL) {
+            e->args = (arg_struct *) malloc(cp->lines * sizeof(arg_struct));
+            if (e->args == NULL) {
+                *instr_pc = pc;
+                return COMPILED_INTERPRET;
+            }
+        }
+        arg_struct *args = e->args;
+        int4 p = 0;
+        for (int4 i = 0; i < cp->lines; i++) {
+            int4 line_pc = p;
+            int cmd;
+            get_next_command(&p, &cmd, args + i, 0, NULL);
+            if ((cmd == CMD_GTO || cmd == CMD_XEQ)
+                    && (args[i].type == ARGTYPE_NUM
+                        || args[i].type == ARGTYPE_LCLBL
+                        || args[i].type == ARGTYPE_STK)) {
+                int4 target_pc = 0;
+                for (int j = 2; j < 6; j++)
+                    target_pc = (target_pc << 8) | prgm->text[line_pc + j];
+                args[i].target = target_pc;
+            }
+        }
+        e->attached = current_prgm;
+    }
+    return cp->run(e->args, instr_pc);
+}
+
 void rebuild_label_table() {
-    /* TODO -- this is *not* efficient; inserting and deleting ENDs and
-     * global LBLs should not cause every single program to get rescanned!
-     * But, I don't feel like dealing with that at the moment, so just
-     * this ugly brute force approach for now.
+    /* Rebuilds the label table from scratch, by scanning all programs.
+     * store_command() and delete_command() keep the table up to date
+     * incrementally, so this is only needed after bulk changes, such as
+     * importing programs.
      */
     int prgm_index;
     int4 pc;
     labels_count = 0;
+    invalidate_label_hash();
     for (prgm_index = 0; prgm_index < prgms_count; prgm_index++) {
         prgm_struct *prgm = prgms + prgm_index;
         pc = 0;
@@ -2082,12 +2381,124 @@ void rebuild_label_table() {
 
 static void update_label_table(int prgm, int4 pc, int inserted) {
     int i;
-    for (i = 0; i < labels_count; i++) {
+    for (i = label_search(prgm, pc); i < labels_count; i++) {
         if (labels[i].prgm > prgm)
             return;
-        if (labels[i].prgm == prgm && labels[i].pc >= pc)
-            labels[i].pc += inserted;
+        labels[i].pc += inserted;
+    }
+}
+
+/* Returns the index of the first label at or after the given
+ * program and pc. The label table is always ordered by program index
+ * first, and pc second; the END of each program comes last.
+ */
+static int label_search(int prgm, int4 pc) {
+    int lo = 0, hi = labels_count;
+    while (lo < hi) {
+        int mid = (lo + hi) >> 1;
+        if (labels[mid].prgm < prgm
+                || labels[mid].prgm == prgm && labels[mid].pc < pc)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Name index for find_global_label(). Each bucket holds the highest label
+ * index with that hash; label_hash_chain[i] holds the next lower index
+ * with the same hash as label i. Walking a chain thus visits labels from
+ * the end of the table toward the start, so the last definition of a name
+ * still wins.
+ * Appending a label (which is what happens when programs are imported or
+ * typed in at the end of memory) updates the index in place; any other
+ * change that shifts label indexes just marks it invalid, and it is
+ * rebuilt from the label table on the next lookup. That never involves
+ * rescanning the program text.
+ */
+static CORE_TLS int *label_hash = NULL;
+static CORE_TLS int *label_hash_chain = NULL;
+static CORE_TLS int label_hash_size = 0;
+static CORE_TLS int label_hash_chain_capacity = 0;
+static CORE_TLS bool label_hash_valid = false;
+
+static int label_name_hash(const char *name, int length) {
+    uint4 h = 2166136261U;
+    for (int i = 0; i < length; i++)
+        h = (h ^ (unsigned char) name[i]) * 16777619U;
+    return (int) (h & (label_hash_size - 1));
+}
+
+static void invalidate_label_hash() {
+    label_hash_valid = false;
+}
+
+static bool rebuild_label_hash() {
+    if (label_hash_chain_capacity < labels_capacity) {
+        int *new_chain = (int *) realloc(label_hash_chain, labels_capacity * sizeof(int));
+        if (new_chain == NULL)
+            return false;
+        label_hash_chain = new_chain;
+        label_hash_chain_capacity = labels_capacity;
     }
+    int size = 64;
+    while (size < labels_count * 2)
+        size <<= 1;
+    if (size != label_hash_size) {
+        int *new_hash = (int *) realloc(label_hash, size * sizeof(int));
+        if (new_hash == NULL)
+            return false;
+        label_hash = new_hash;
+        label_hash_size = size;
+    }
+    for (int i = 0; i < label_hash_size; i++)
+        label_hash[i] = -1;
+    for (int i = 0; i < labels_count; i++) {
+        int h = label_name_hash(labels[i].name, labels[i].length);
+        label_hash_chain[i] = label_hash[h];
+        label_hash[h] = i;
+    }
+    label_hash_valid = true;
+    return true;
+}
+
+static bool insert_label(int index, int prgm, int4 pc, const char *name, int length) {
+    if (labels_count == labels_capacity) {
+        int new_capacity = labels_capacity + 50;
+        label_struct *new_labels = (label_struct *)
+                    realloc(labels, new_capacity * sizeof(label_struct));
+        if (new_labels == NULL)
+            return false;
+        labels = new_labels;
+        labels_capacity = new_capacity;
+    }
+    if (index < labels_count)
+        memmove(labels + index + 1, labels + index,
+                (labels_count - index) * sizeof(label_struct));
+    label_struct *lbl = labels + index;
+    lbl->length = length;
+    memcpy(lbl->name, name, length);
+    lbl->prgm = prgm;
+    lbl->pc = pc;
+    labels_count++;
+    if (label_hash_valid) {
+        if (index == labels_count - 1
+                && labels_count <= label_hash_chain_capacity
+                && labels_count * 2 <= label_hash_size) {
+            int h = label_name_hash(name, length);
+            label_hash_chain[index] = label_hash[h];
+            label_hash[h] = index;
+        } else
+            label_hash_valid = false;
+    }
+    return true;
+}
+
+static void remove_label(int index) {
+    labels_count--;
+    memmove(labels + index, labels + index + 1,
+            (labels_count - index) * sizeof(label_struct));
+    label_hash_valid = false;
 }
 
 static void invalidate_lclbls(int prgm_index, bool force) {
@@ -2134,6 +2545,15 @@ void delete_command(int4 pc) {
             return;
         nextprgm = prgm + 1;
         prgm->size -= 2;
+        /* Fix up the label table: the END goes away, the next program's
+         * labels move into this one, and later programs move down by one.
+         */
+        remove_label(label_search(current_prgm, pc));
+        for (int i = label_search(current_prgm + 1, 0); i < labels_count; i++) {
+            if (labels[i].prgm == current_prgm + 1)
+                labels[i].pc += prgm->size;
+            labels[i].prgm--;
+        }
         newsize = prgm->size + nextprgm->size;
         if (newsize > prgm->capacity) {
             int4 newcapacity = (newsize + 511) & ~511;
@@ -2148,11 +2568,13 @@ void delete_command(int4 pc) {
         for (pos = 0; pos < nextprgm->size; pos++)
             prgm->text[prgm->size++] = nextprgm->text[pos];
         free(nextprgm->text);
+        free(nextprgm->decoded);
         for (pos = current_prgm + 1; pos < prgms_count - 1; pos++)
             prgms[pos] = prgms[pos + 1];
         prgms_count--;
-        rebuild_label_table();
+        detach_compiled_prgms();
         invalidate_lclbls(current_prgm, true);
+        invalidate_decoded(current_prgm);
         clear_all_rtns();
         draw_varmenu();
         return;
@@ -2162,10 +2584,10 @@ void delete_command(int4 pc) {
         prgm->text[pos] = prgm->text[pos + length];
     prgm->size -= length;
     if (command == CMD_LBL && argtype == ARGTYPE_STR)
-        rebuild_label_table();
-    else
-        update_label_table(current_prgm, pc, -length);
+        remove_label(label_search(current_prgm, pc));
+    update_label_table(current_prgm, pc, -length);
     invalidate_lclbls(current_prgm, false);
+    invalidate_decoded(current_prgm);
     clear_all_rtns();
     draw_varmenu();
 }
@@ -2286,6 +2708,11 @@ bool store_command(int4 pc, int command, arg_struct *arg, const char *num_str) {
         // TODO - handle memory allocation failure
         for (i = pc; i < prgm->size; i++)
             new_prgm->text[i - pc] = prgm->text[i];
+        new_prgm->decoded = NULL;
+        new_prgm->decoded_count = 0;
+        new_prgm->decoded_last = -1;
+        new_prgm->compiled = -2;
+        detach_compiled_prgms();
         current_prgm++;
 
         /* Truncate the previously 'current' program and append an END.
@@ -2299,9 +2726,23 @@ bool store_command(int4 pc, int command, arg_struct *arg, const char *num_str) {
         if (flags.f.printer_exists && (flags.f.trace_print || flags.f.normal_print))
             print_program_line(current_prgm - 1, pc);
 
-        rebuild_label_table();
+        /* Fix up the label table: labels from the split point onward,
+         * including the old END, move to the new program, later programs
+         * move up by one, and the new END is added to the old program.
+         */
+        int li = label_search(current_prgm - 1, pc);
+        for (i = li; i < labels_count; i++) {
+            if (labels[i].prgm == current_prgm - 1)
+                labels[i].pc -= pc;
+            labels[i].prgm++;
+        }
+        if (!insert_label(li, current_prgm - 1, pc, "", 0))
+            rebuild_label_table();
+        invalidate_label_hash();
+
         invalidate_lclbls(current_prgm, true);
         invalidate_lclbls(current_prgm - 1, true);
+        invalidate_decoded(current_prgm - 1);
         clear_all_rtns();
         draw_varmenu();
         return true;
@@ -2405,12 +2846,14 @@ bool store_command(int4 pc, int command, arg_struct *arg, const char *num_str) {
     if (command != CMD_END && flags.f.printer_exists && (flags.f.trace_print || flags.f.normal_print))
         print_program_line(current_prgm, pc);
 
-    if (command == CMD_END ||
+    update_label_table(current_prgm, pc, bufptr);
+    if ((command == CMD_END ||
             (command == CMD_LBL && arg->type == ARGTYPE_STR))
+            && !insert_label(label_search(current_prgm, pc), current_prgm, pc,
+                        arg->val.text, command == CMD_END ? 0 : arg->length))
         rebuild_label_table();
-    else
-        update_label_table(current_prgm, pc, bufptr);
     invalidate_lclbls(current_prgm, false);
+    invalidate_decoded(current_prgm);
     clear_all_rtns();
     if (!loading_state)
         draw_varmenu();
@@ -2436,6 +2879,7 @@ static bool ensure_prgm_space(int n) {
     if (newtext == NULL)
         return false;
     prgm->text = newtext;
+    invalidate_decoded(current_prgm);
     prgm->capacity = newcapacity;
     return true;
 }
@@ -2657,6 +3101,22 @@ static int find_global_label_2(const arg_struct *arg, int *prgm, int4 *pc, int *
     int i;
     const char *name = arg->val.text;
     int namelen = arg->length;
+    if (label_hash_valid || rebuild_label_hash()) {
+        for (i = label_hash[label_name_hash(name, namelen)]; i != -1; i = label_hash_chain[i]) {
+            if (labels[i].length != namelen
+                    || memcmp(labels[i].name, name, namelen) != 0)
+                continue;
+            if (prgm != NULL)
+                *prgm = labels[i].prgm;
+            if (pc != NULL)
+                *pc = labels[i].pc;
+            if (idx != NULL)
+                *idx = i;
+            return 1;
+        }
+        return 0;
+    }
+    /* Couldn't allocate the index; fall back on a linear search */
     for (i = labels_count - 1; i >= 0; i--) {
         int j;
         char *labelname;
@@ -2704,6 +3164,7 @@ int push_rtn_addr(int prgm, int4 pc) {
         rtn_solve_active = true;
     else if (prgm == -3)
         rtn_integ_active = true;
+    update_phloat_memo();
     return ERR_NONE;
 }
 
@@ -3204,51 +3665,6 @@ bool should_i_stop_at_this_level() {
     return stop;
 }
 
-static void remove_locals() {
-    if (matedit_mode == 3 && matedit_level >= rtn_level)
-        leave_matrix_editor();
-    int last = -1;
-    for (int i = vars_count - 1; i >= 0; i--) {
-        if (vars[i].level == -1)
-            continue;
-        if (vars[i].level < rtn_level)
-            break;
-        if ((matedit_mode == 1 || matedit_mode == 3)
-                && vars[i].level == matedit_level
-                && string_equals(vars[i].name, vars[i].length, matedit_name, matedit_length)) {
-            if (matedit_mode == 3) {
-                set_appmenu_exitcallback(0);
-                set_menu(MENULEVEL_APP, MENU_NONE);
-            }
-            matedit_mode = 0;
-            free(matedit_stack);
-            matedit_stack = NULL;
-            matedit_stack_depth = 0;
-        }
-        if ((vars[i].flags & VAR_HIDING) != 0) {
-            for (int j = i - 1; j >= 0; j--)
-                if ((vars[j].flags & VAR_HIDDEN) != 0 && string_equals(vars[i].name, vars[i].length, vars[j].name, vars[j].length)) {
-                    vars[j].flags &= ~VAR_HIDDEN;
-                    break;
-                }
-        }
-        free_vartype(vars[i].value);
-        vars[i].length = 100;
-        last = i;
-    }
-    if (last == -1)
-        return;
-    int from = last;
-    int to = last;
-    while (from < vars_count) {
-        if (vars[from].length != 100)
-            vars[to++] = vars[from];
-        from++;
-    }
-    vars_count -= from - to;
-    update_catalog();
-}
-
 int rtn(int err) {
     // NOTE: 'err' should be one of ERR_NONE, ERR_YES, or ERR_NO.
     // For any actual *error*, i.e. anything that should actually
@@ -3331,7 +3747,7 @@ void pop_rtn_addr(int *prgm, int4 *pc, bool *stop) {
         else
             rtn_stack[rtn_level - 1].set_has_matrix(false);
     }
-    remove_locals();
+    purge_locals(rtn_level);
     if (rtn_level == 0) {
         *prgm = -1;
         *pc = -1;
@@ -3350,6 +3766,7 @@ void pop_rtn_addr(int *prgm, int4 *pc, bool *stop) {
             rtn_solve_active = false;
         else if (*prgm == -3)
             rtn_integ_active = false;
+        update_phloat_memo();
     }
 }
 
@@ -3759,6 +4176,17 @@ static bool load_state2(bool *clear, bool *too_new) {
     if (!read_bool(&bdummy)) return false;
     if (!read_bool(&bdummy)) return false;
     if (!read_bool(&bdummy)) return false;
+    if (ver < 50) {
+        core_settings.binary_engine = false;
+        core_settings.accumulation = ACCUMULATE_PLAIN;
+        core_settings.mixed_precision = false;
+        core_settings.transcendental_cache = true;
+    } else {
+        if (!read_bool(&core_settings.binary_engine)) return false;
+        if (!read_int(&core_settings.accumulation)) return false;
+        if (!read_bool(&core_settings.mixed_precision)) return false;
+        if (!read_bool(&core_settings.transcendental_cache)) return false;
+    }
 
     if (!read_bool(&mode_clall)) return false;
     if (!read_bool(&mode_command_entry)) return false;
@@ -3965,6 +4393,10 @@ void save_state(bool *success) {
     if (!write_bool(core_settings.matrix_singularmatrix)) return;
     if (!write_bool(core_settings.matrix_outofrange)) return;
     if (!write_bool(core_settings.auto_repeat)) return;
+    if (!write_bool(core_settings.binary_engine)) return;
+    if (!write_int(core_settings.accumulation)) return;
+    if (!write_bool(core_settings.mixed_precision)) return;
+    if (!write_bool(core_settings.transcendental_cache)) return;
     if (!write_bool(mode_clall)) return;
     if (!write_bool(mode_command_entry)) return;
     if (!write_char(mode_number_entry)) return;
@@ -4087,6 +4519,7 @@ void hard_reset(int reason) {
     rtn_stop_level = -1;
     rtn_solve_active = false;
     rtn_integ_active = false;
+    update_phloat_memo();
 
     /* Clear programs */
     if (prgms != NULL) {
@@ -4101,6 +4534,8 @@ void hard_reset(int reason) {
         labels_capacity = 0;
         labels_count = 0;
     }
+    invalidate_label_hash();
+    detach_compiled_prgms();
     goto_dot_dot(false);
 
     pending_command = CMD_NONE;
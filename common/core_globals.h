@@ -27,9 +27,9 @@
 #include "core_variables.h"
 
 #ifdef ARM
-extern int* gfile;
+extern CORE_TLS int* gfile;
 #else
-extern FILE *gfile;
+extern CORE_TLS FILE *gfile;
 #endif
 
 /**********/
@@ -227,19 +227,19 @@ extern const menu_spec menus[];
 /******************/
 
 /* Suppress menu updates while state loading is in progress */
-extern bool loading_state;
+extern CORE_TLS bool loading_state;
 
 /* Registers */
 #define REG_T 0
 #define REG_Z 1
 #define REG_Y 2
 #define REG_X 3
-extern vartype **stack;
-extern int sp;
-extern int stack_capacity;
-extern vartype *lastx;
-extern int reg_alpha_length;
-extern char reg_alpha[44];
+extern CORE_TLS vartype **stack;
+extern CORE_TLS int sp;
+extern CORE_TLS int stack_capacity;
+extern CORE_TLS vartype *lastx;
+extern CORE_TLS int reg_alpha_length;
+extern CORE_TLS char reg_alpha[44];
 
 /* FLAGS
  * Note: flags whose names start with VIRTUAL_ are named here for reference
@@ -327,7 +327,7 @@ typedef union {
         char f95; char f96; char f97; char f98; char f99;
     } f;
 } flags_struct;
-extern flags_struct flags;
+extern CORE_TLS flags_struct flags;
 extern const char *virtual_flags;
 
 /* For var_struct.flags */
@@ -343,101 +343,114 @@ struct var_struct {
     int2 flags;
     vartype *value;
 };
-extern int vars_capacity;
-extern int vars_count;
-extern var_struct *vars;
+extern CORE_TLS int vars_capacity;
+extern CORE_TLS int vars_count;
+extern CORE_TLS var_struct *vars;
 
 /* Programs */
+/* Decode cache: one entry per program line, in pc order, built on demand
+ * when a program is run, and discarded whenever its text changes.
+ */
+struct decoded_cmd {
+    int4 pc;
+    int4 next_pc;
+    int cmd;
+    arg_struct arg;
+};
 struct prgm_struct {
     int4 capacity;
     int4 size;
     bool lclbl_invalid;
     bool locked;
     unsigned char *text;
+    decoded_cmd *decoded;
+    int4 decoded_count;
+    int4 decoded_last;
+    int compiled; // see run_compiled_prgm()
     inline bool is_end(int4 pc) {
         return text[pc] == CMD_END && (text[pc + 1] & 112) == 0;
     }
 };
-extern int prgms_capacity;
-extern int prgms_count;
-extern prgm_struct *prgms;
+extern CORE_TLS int prgms_capacity;
+extern CORE_TLS int prgms_count;
+extern CORE_TLS prgm_struct *prgms;
 struct label_struct {
     unsigned char length;
     char name[7];
     int prgm;
     int4 pc;
 };
-extern int labels_capacity;
-extern int labels_count;
-extern label_struct *labels;
+extern CORE_TLS int labels_capacity;
+extern CORE_TLS int labels_count;
+extern CORE_TLS label_struct *labels;
 
-extern int current_prgm;
-extern int4 pc;
-extern int prgm_highlight_row;
+extern CORE_TLS int current_prgm;
+extern CORE_TLS int4 pc;
+extern CORE_TLS int prgm_highlight_row;
 
-extern int varmenu_length;
-extern char varmenu[7];
-extern int varmenu_rows;
-extern int varmenu_row;
-extern int varmenu_labellength[6];
-extern char varmenu_labeltext[6][7];
-extern int varmenu_role;
+extern CORE_TLS int varmenu_length;
+extern CORE_TLS char varmenu[7];
+extern CORE_TLS int varmenu_rows;
+extern CORE_TLS int varmenu_row;
+extern CORE_TLS int varmenu_labellength[6];
+extern CORE_TLS char varmenu_labeltext[6][7];
+extern CORE_TLS int varmenu_role;
 
 
 /****************/
 /* More globals */
 /****************/
 
-extern bool mode_clall;
-extern int (*mode_interruptible)(bool);
-extern bool mode_stoppable;
-extern bool mode_command_entry;
-extern char mode_number_entry;
-extern bool mode_alpha_entry;
-extern bool mode_shift;
-extern int mode_appmenu;
-extern int mode_plainmenu;
-extern bool mode_plainmenu_sticky;
-extern int mode_transientmenu;
-extern int mode_alphamenu;
-extern int mode_commandmenu;
-extern bool mode_running;
-extern bool mode_getkey;
-extern bool mode_getkey1;
-extern bool mode_pause;
-extern bool mode_disable_stack_lift;
-extern bool mode_varmenu;
-extern bool mode_updown;
-extern int4 mode_sigma_reg;
-extern int mode_goose;
-extern bool mode_time_clktd;
-extern bool mode_time_clk24;
-extern int mode_wsize;
-extern bool mode_menu_caps;
+extern CORE_TLS bool mode_clall;
+extern CORE_TLS int (*mode_interruptible)(bool);
+extern CORE_TLS bool mode_stoppable;
+extern CORE_TLS bool mode_command_entry;
+extern CORE_TLS char mode_number_entry;
+extern CORE_TLS bool mode_alpha_entry;
+extern CORE_TLS bool mode_shift;
+extern CORE_TLS int mode_appmenu;
+extern CORE_TLS int mode_plainmenu;
+extern CORE_TLS bool mode_plainmenu_sticky;
+extern CORE_TLS int mode_transientmenu;
+extern CORE_TLS int mode_alphamenu;
+extern CORE_TLS int mode_commandmenu;
+extern CORE_TLS bool mode_running;
+extern CORE_TLS bool mode_getkey;
+extern CORE_TLS bool mode_getkey1;
+extern CORE_TLS bool mode_pause;
+extern CORE_TLS bool mode_disable_stack_lift;
+extern CORE_TLS bool mode_varmenu;
+extern CORE_TLS bool mode_updown;
+extern CORE_TLS int4 mode_sigma_reg;
+extern CORE_TLS int mode_goose;
+extern CORE_TLS bool mode_time_clktd;
+extern CORE_TLS bool mode_time_clk24;
+extern CORE_TLS int mode_wsize;
+extern CORE_TLS bool mode_menu_caps;
 #if defined(ANDROID) || defined(IPHONE)
-extern bool mode_popup_unknown;
+extern CORE_TLS bool mode_popup_unknown;
 #endif
 
-extern phloat entered_number;
-extern int entered_string_length;
-extern char entered_string[15];
+extern CORE_TLS phloat entered_number;
+extern CORE_TLS int entered_string_length;
+extern CORE_TLS char entered_string[15];
 
-extern int pending_command;
-extern arg_struct pending_command_arg;
-extern int xeq_invisible;
+extern CORE_TLS int pending_command;
+extern CORE_TLS arg_struct pending_command_arg;
+extern CORE_TLS int xeq_invisible;
 
 /* Multi-keystroke commands -- edit state */
 /* Relevant when mode_command_entry != 0 */
-extern int incomplete_command;
-extern bool incomplete_ind;
-extern bool incomplete_alpha;
-extern int incomplete_length;
-extern int incomplete_maxdigits;
-extern int incomplete_argtype;
-extern int incomplete_num;
-extern char incomplete_str[22];
-extern int4 incomplete_saved_pc;
-extern int4 incomplete_saved_highlight_row;
+extern CORE_TLS int incomplete_command;
+extern CORE_TLS bool incomplete_ind;
+extern CORE_TLS bool incomplete_alpha;
+extern CORE_TLS int incomplete_length;
+extern CORE_TLS int incomplete_maxdigits;
+extern CORE_TLS int incomplete_argtype;
+extern CORE_TLS int incomplete_num;
+extern CORE_TLS char incomplete_str[22];
+extern CORE_TLS int4 incomplete_saved_pc;
+extern CORE_TLS int4 incomplete_saved_highlight_row;
 
 #define CATSECT_TOP 0
 #define CATSECT_FCN 1
@@ -470,58 +483,58 @@ extern int4 incomplete_saved_highlight_row;
 #define CATSECT_LIST_ONLY 28
 
 /* Command line handling temporaries */
-extern char cmdline[100];
-extern int cmdline_length;
-extern int cmdline_row;
+extern CORE_TLS char cmdline[100];
+extern CORE_TLS int cmdline_length;
+extern CORE_TLS int cmdline_row;
 
 /* Matrix editor / matrix indexing */
-extern int matedit_mode; /* 0=off, 1=index, 2=edit, 3=editn */
-extern int matedit_level;
-extern char matedit_name[7];
-extern int matedit_length;
-extern vartype *matedit_x;
-extern int4 matedit_i;
-extern int4 matedit_j;
-extern int matedit_prev_appmenu;
-extern int4 *matedit_stack;
-extern int matedit_stack_depth;
-extern bool matedit_is_list;
+extern CORE_TLS int matedit_mode; /* 0=off, 1=index, 2=edit, 3=editn */
+extern CORE_TLS int matedit_level;
+extern CORE_TLS char matedit_name[7];
+extern CORE_TLS int matedit_length;
+extern CORE_TLS vartype *matedit_x;
+extern CORE_TLS int4 matedit_i;
+extern CORE_TLS int4 matedit_j;
+extern CORE_TLS int matedit_prev_appmenu;
+extern CORE_TLS int4 *matedit_stack;
+extern CORE_TLS int matedit_stack_depth;
+extern CORE_TLS bool matedit_is_list;
 
 /* INPUT */
-extern char input_name[11];
-extern int input_length;
-extern arg_struct input_arg;
+extern CORE_TLS char input_name[11];
+extern CORE_TLS int input_length;
+extern CORE_TLS arg_struct input_arg;
 
 /* ERRMSG/ERRNO */
-extern int lasterr;
-extern int lasterr_length;
-extern char lasterr_text[22];
+extern CORE_TLS int lasterr;
+extern CORE_TLS int lasterr_length;
+extern CORE_TLS char lasterr_text[22];
 
 /* BASE application */
-extern int baseapp;
+extern CORE_TLS int baseapp;
 
 /* Random number generator */
-extern int8 random_number_low, random_number_high;
+extern CORE_TLS int8 random_number_low, random_number_high;
 
 /* NORM & TRACE mode: number waiting to be printed */
-extern int deferred_print;
+extern CORE_TLS int deferred_print;
 
 /* Keystroke buffer - holds keystrokes received while
  * there is a program running.
  */
-extern int keybuf_head;
-extern int keybuf_tail;
-extern int keybuf[16];
+extern CORE_TLS int keybuf_head;
+extern CORE_TLS int keybuf_tail;
+extern CORE_TLS int keybuf[16];
 
-extern int remove_program_catalog;
+extern CORE_TLS int remove_program_catalog;
 
 #define NUMBER_FORMAT_BINARY 0
 #define NUMBER_FORMAT_BCD20_OLD 1 // obsolete
 #define NUMBER_FORMAT_BCD20_NEW 2 // obsolete
 #define NUMBER_FORMAT_BID128 3
-extern int state_file_number_format;
+extern CORE_TLS int state_file_number_format;
 
-extern bool no_keystrokes_yet;
+extern CORE_TLS bool no_keystrokes_yet;
 
 
 /*********************/
@@ -537,6 +550,12 @@ int mvar_prgms_exist();
 int label_has_mvar(int lblindex);
 int get_command_length(int prgm, int4 pc);
 void get_next_command(int4 *pc, int *command, arg_struct *arg, int find_target, const char **num_str);
+void get_next_command_cached(int4 *pc, int *command, arg_struct *arg);
+/* Returned by run_compiled_prgm() when the line at pc should be executed by
+ * the interpreter.
+ */
+#define COMPILED_INTERPRET -1
+int run_compiled_prgm(int4 *instr_pc);
 void rebuild_label_table();
 void delete_command(int4 pc);
 bool store_command(int4 pc, int command, arg_struct *arg, const char *num_str);
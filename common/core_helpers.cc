@@ -62,12 +62,17 @@ int resolve_ind_arg(arg_struct *arg, char *buf, int *buflen) {
                     return ERR_SIZE_ERROR;
                 if (rm->array->is_string[num] == 0) {
                     phloat x = rm->array->data[num];
-                    if (x < 0)
-                        x = -x;
-                    if (x >= 2147483648.0)
-                        arg->val.num = 2147483647;
-                    else
-                        arg->val.num = to_int4(x);
+                    int4 n;
+                    if (is_small_int(x, &n))
+                        arg->val.num = n < 0 ? -n : n;
+                    else {
+                        if (x < 0)
+                            x = -x;
+                        if (x >= 2147483648.0)
+                            arg->val.num = 2147483647;
+                        else
+                            arg->val.num = to_int4(x);
+                    }
                     arg->type = ARGTYPE_NUM;
                 } else {
                     char *text;
@@ -115,12 +120,17 @@ int resolve_ind_arg(arg_struct *arg, char *buf, int *buflen) {
             finish_resolve:
             if (v->type == TYPE_REAL) {
                 phloat x = ((vartype_real *) v)->x;
-                if (x < 0)
-                    x = -x;
-                if (x >= 2147483648.0)
-                    arg->val.num = 2147483647;
-                else
-                    arg->val.num = to_int4(x);
+                int4 n;
+                if (is_small_int(x, &n))
+                    arg->val.num = n < 0 ? -n : n;
+                else {
+                    if (x < 0)
+                        x = -x;
+                    if (x >= 2147483648.0)
+                        arg->val.num = 2147483647;
+                    else
+                        arg->val.num = to_int4(x);
+                }
                 arg->type = ARGTYPE_NUM;
                 return ERR_NONE;
             } else if (v->type == TYPE_STRING) {
@@ -368,17 +378,17 @@ phloat rad_to_angle(phloat x) {
     if (flags.f.rad)
         return x;
     else if (flags.f.grad)
-        return x * (200 / PI);
+        return x * GRAD_PER_RAD_PHLOAT;
     else
-        return x * (180 / PI);
+        return x * DEG_PER_RAD_PHLOAT;
 }
 
 phloat rad_to_deg(phloat x) {
-    return x * (180 / PI);
+    return x * DEG_PER_RAD_PHLOAT;
 }
 
 phloat deg_to_rad(phloat x) {
-    return x / (180 / PI);
+    return x / DEG_PER_RAD_PHLOAT;
 }
 
 void append_alpha_char(char c) {
@@ -647,7 +657,7 @@ int anum(const char *text, int len, phloat *res) {
 }
 
 #if (!defined(ANDROID) && !defined(IPHONE))
-static bool always_on = false;
+static CORE_TLS bool always_on = false;
 bool shell_always_on(int ao) {
     bool ret = always_on;
     if (ao != -1)
@@ -894,7 +904,7 @@ bool phloat2base(phloat p, int8 *res) {
     int wsize = effective_wsize();
     if (flags.f.base_wrap) {
         phloat ip = p < 0 ? -floor(-p) : floor(p);
-        phloat d = pow(phloat(2), wsize);
+        phloat d = p_pow2(wsize);
         phloat r = fmod(ip, d);
         if (r < 0)
             r += d;
@@ -911,7 +921,7 @@ bool phloat2base(phloat p, int8 *res) {
         }
         *res = n;
     } else if (flags.f.base_signed) {
-        phloat high = pow(phloat(2), wsize - 1);
+        phloat high = p_pow2(wsize - 1);
         phloat low = -high;
         high--;
         if (p > high || p < low)
@@ -925,7 +935,7 @@ bool phloat2base(phloat p, int8 *res) {
     } else {
         if (p < 0)
             return false;
-        phloat high = pow(phloat(2), wsize) - 1;
+        phloat high = p_pow2(wsize) - 1;
         if (p > high)
             return false;
         *res = (int8) to_uint8(p);
@@ -1263,7 +1273,7 @@ static phloat sin_or_cos_deg(phloat x, bool do_sin) {
             x = 90 - x;
             do_sin = !do_sin;
         }
-        x /= 180 / PI;
+        x /= DEG_PER_RAD_PHLOAT;
         r = do_sin ? sin(x) : cos(x);
     }
     return neg ? -r : r;
@@ -1303,7 +1313,7 @@ static phloat sin_or_cos_grad(phloat x, bool do_sin) {
             x = 100 - x;
             do_sin = !do_sin;
         }
-        x /= 200 / PI;
+        x /= GRAD_PER_RAD_PHLOAT;
         r = do_sin ? sin(x) : cos(x);
     }
     return neg ? -r : r;
@@ -1595,18 +1605,21 @@ int dimension_array_ref(vartype *matrix, int4 rows, int4 columns) {
     }
 }
 
-phloat fix_hms(phloat x) {
 #ifdef BCD_MATH
-    const phloat sec_corr(4, 1000);
-    const phloat min_corr(4, 10);
+static const phloat sec_corr(4, 1000);
+static const phloat min_corr(4, 10);
+static const phloat hms_min(59, 10000);
+#else
+static const phloat hms_min = 0.0059;
 #endif
 
+phloat fix_hms(phloat x) {
     bool neg = x < 0;
     if (neg)
         x = -x;
     if (x == x + 1)
         return neg ? -x : x;
-    if (x < 0.0059)
+    if (x < hms_min)
         return neg ? -x : x;
     #ifdef BCD_MATH
         if (floor(fmod(x * 10000, 100)) == 60)
@@ -1843,8 +1856,8 @@ const char *phloat2program(phloat d) {
     /* Converts a phloat to its most compact representation;
      * used for generating HP-42S style number literals in programs.
      */
-    static char allbuf[50];
-    static char scibuf[50];
+    static CORE_TLS char allbuf[50];
+    static CORE_TLS char scibuf[50];
     int alllen;
     int scilen;
     char dot = flags.f.decimal_point ? '.' : ',';
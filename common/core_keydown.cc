@@ -30,7 +30,7 @@
 #include "core_variables.h"
 #include "shell.h"
 
-int no_menu_key_this_time = 0;
+CORE_TLS int no_menu_key_this_time = 0;
 
 static bool is_number_key(int shift, int key, bool *invalid) {
     *invalid = false;
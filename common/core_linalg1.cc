@@ -15,7 +15,17 @@
  * along with this program; if not, see http://www.gnu.org/licenses/.
  *****************************************************************************/
 
+#include <math.h>
 #include <stdlib.h>
+#ifdef LINALG_THREADS
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <system_error>
+#include <thread>
+#endif
 
 #include "core_globals.h"
 #include "core_linalg1.h"
@@ -28,10 +38,14 @@
 /***** Matrix-matrix division *****/
 /**********************************/
 
-static int (*linalg_div_completion)(int, vartype *);
-static const vartype *linalg_div_left;
-static vartype *linalg_div_result;
+static CORE_TLS int (*linalg_div_completion)(int, vartype *);
+static CORE_TLS const vartype *linalg_div_left;
+static CORE_TLS vartype *linalg_div_result;
 
+#ifdef BCD_MATH
+static int div_rr_refined_completion(int error, const vartype_realmatrix *a,
+                                    vartype_realmatrix *x, bool solved);
+#endif
 static int div_rr_completion1(int error, vartype_realmatrix *a, int4 *perm,
                                     phloat det);
 static int div_rr_completion2(int error, vartype_realmatrix *a, int4 *perm,
@@ -61,6 +75,19 @@ int linalg_div(const vartype *left, const vartype *right,
             int4 *perm;
             if (denom->rows != rows || denom->columns != rows)
                 return completion(ERR_DIMENSION_ERROR, NULL);
+#ifdef BCD_MATH
+            if (core_settings.mixed_precision) {
+                res = new_realmatrix(rows, columns);
+                if (res == NULL)
+                    return completion(ERR_INSUFFICIENT_MEMORY, NULL);
+                linalg_div_completion = completion;
+                linalg_div_left = left;
+                linalg_div_result = res;
+                return lu_solve_rr_refined(denom, num,
+                                           (vartype_realmatrix *) res,
+                                           div_rr_refined_completion);
+            }
+#endif
             perm = (int4 *) malloc(rows * sizeof(int4));
             if (perm == NULL)
                 return completion(ERR_INSUFFICIENT_MEMORY, NULL);
@@ -174,6 +201,32 @@ int linalg_div(const vartype *left, const vartype *right,
     }
 }
 
+#ifdef BCD_MATH
+static int div_rr_refined_completion(int error, const vartype_realmatrix *a,
+                                     vartype_realmatrix *x, bool solved) {
+    if (error != ERR_NONE || solved) {
+        if (error != ERR_NONE)
+            free_vartype(linalg_div_result); /* Note: linalg_div_result == x */
+        return linalg_div_completion(error, linalg_div_result);
+    }
+    // The refinement couldn't do it; decompose A in Decimal after all
+    int4 rows = a->rows;
+    int4 *perm = (int4 *) malloc(rows * sizeof(int4));
+    if (perm == NULL) {
+        free_vartype(linalg_div_result);
+        return linalg_div_completion(ERR_INSUFFICIENT_MEMORY, NULL);
+    }
+    vartype *lu = new_realmatrix(rows, rows);
+    if (lu == NULL) {
+        free(perm);
+        free_vartype(linalg_div_result);
+        return linalg_div_completion(ERR_INSUFFICIENT_MEMORY, NULL);
+    }
+    matrix_copy(lu, (const vartype *) a);
+    return lu_decomp_r((vartype_realmatrix *) lu, perm, div_rr_completion1);
+}
+#endif
+
 static int div_rr_completion1(int error, vartype_realmatrix *a, int4 *perm,
                                          phloat det) {
     if (error != ERR_NONE) {
@@ -275,19 +328,184 @@ static int div_cc_completion2(int error, vartype_complexmatrix *a, int4 *perm,
 /***** Matrix-matrix multiplication *****/
 /****************************************/
 
+/* The multiplication workers compute the product one block of columns at a
+ * time. The columns of the right-hand matrix that make up the current block
+ * are copied into a panel, one column after another, so that the inner loop
+ * runs through both the row of the left-hand matrix and the column of the
+ * panel sequentially, and the panel stays in the cache while it is used for
+ * every row of the left-hand matrix. The elements of the product are summed in
+ * the same order as without the blocking, so the results are the same.
+ * The block width is core_settings.matrix_block_size, which
+ * core_calibrate_matrix_block_size() tunes for the host.
+ * 'size' is the number of phloats per element: 1 for real, 2 for complex,
+ * and 3 for complex panels in planes, for Gauss's trick (see below).
+ */
+static phloat *mul_panel_alloc(int4 q, int4 n, int size, int4 *width) {
+    int4 w = core_settings.matrix_block_size;
+    if (w <= 0 || w > n)
+        w = n;
+    *width = w;
+    return (phloat *) malloc(q * w * size * sizeof(phloat));
+}
+
+static void mul_panel_fill(phloat *panel, const phloat *r, int4 q, int4 n,
+                           int size, int4 j0, int4 j1) {
+    if (size == 3) {
+        for (int4 j = j0; j < j1; j++) {
+            for (int4 k = 0; k < q; k++) {
+                phloat re = r[2 * (k * n + j)];
+                phloat im = r[2 * (k * n + j) + 1];
+                panel[k] = re;
+                panel[q + k] = im;
+                panel[2 * q + k] = re + im;
+            }
+            panel += 3 * q;
+        }
+        return;
+    }
+    for (int4 j = j0; j < j1; j++)
+        for (int4 k = 0; k < q; k++)
+            for (int s = 0; s < size; s++)
+                *panel++ = r[size * (k * n + j) + s];
+}
+
+/* Products of complex matrices with an inner dimension of at least
+ * MUL_GAUSS_MIN use Gauss's trick, which takes three real multiplications
+ * per term instead of four. The rows of the left-hand matrix and the columns
+ * of the right-hand one are split into planes: the real parts, the
+ * imaginary parts, and their sums; then each element of the product is
+ *
+ *   re = sum(l_re * r_re) - sum(l_im * r_im)
+ *   im = sum((l_re + l_im) * (r_re + r_im)) - sum(l_re * r_re)
+ *                                           - sum(l_im * r_im)
+ *
+ * The imaginary part is the difference of sums much larger than itself
+ * when it is small compared to sum(l_re * r_re) and sum(l_im * r_im), and
+ * then cancellation can take all of its digits, e.g. for (1 + 1e-20 i)^2.
+ * So when it comes out smaller than 2^-10 times |sum(l_re * r_re)| +
+ * |sum(l_im * r_im)| (above that, cancellation costs at most ten bits), the
+ * element is computed again the usual way. The same happens when one of
+ * the three sums overflows, so overflow is handled the same as without the
+ * trick. Smaller products, where the savings don't matter much, are done
+ * the usual way to begin with.
+ * When the imaginary parts of both a row and the right-hand matrix are no
+ * more than 2^-10 times their largest real parts, which includes real
+ * numbers stored as complex ones, nearly every element of that row would
+ * have to be computed again, so the whole row is done the usual way, from
+ * the real and imaginary planes.
+ */
+#define MUL_GAUSS_MIN 32
+
+static bool mul_nearly_real(const phloat *z, int4 count) {
+    phloat re = 0, im = 0;
+    for (int4 k = 0; k < count; k++) {
+        phloat a = fabs(z[2 * k]);
+        phloat b = fabs(z[2 * k + 1]);
+        if (a > re)
+            re = a;
+        if (b > im)
+            im = b;
+    }
+    return im * 1024 <= re;
+}
+
+// Returns whether the row is nearly real, as above
+static bool mul_row_fill_gauss(phloat *row, const phloat *l, int4 q, int4 i) {
+    l += 2 * i * q;
+    for (int4 k = 0; k < q; k++) {
+        row[k] = l[2 * k];
+        row[q + k] = l[2 * k + 1];
+        row[2 * q + k] = l[2 * k] + l[2 * k + 1];
+    }
+    return mul_nearly_real(l, q);
+}
+
+static void mul_gauss_finish(phloat sum_rr, phloat sum_ii, phloat sum_ss,
+                             const phloat *lrow, const phloat *r,
+                             int4 q, int4 n, int4 j, phloat *re, phloat *im) {
+    phloat sum_im = sum_ss - sum_rr - sum_ii;
+    if (p_isinf(sum_rr) || p_isnan(sum_rr) || p_isinf(sum_ii)
+            || p_isnan(sum_ii) || p_isinf(sum_ss) || p_isnan(sum_ss)
+            || fabs(sum_im) * 1024 < fabs(sum_rr) + fabs(sum_ii)) {
+        phloat sum_re = 0;
+        sum_im = 0;
+        for (int4 k = 0; k < q; k++) {
+            phloat l_re = lrow[2 * k];
+            phloat l_im = lrow[2 * k + 1];
+            phloat r_re = r[2 * (k * n + j)];
+            phloat r_im = r[2 * (k * n + j) + 1];
+            sum_re += l_re * r_re - l_im * r_im;
+            sum_im += l_im * r_re + l_re * r_im;
+        }
+        *re = sum_re;
+        *im = sum_im;
+    } else {
+        *re = sum_rr - sum_ii;
+        *im = sum_im;
+    }
+}
+
+#ifdef LINALG_THREADS
+static bool matrix_mul_team(const phloat *left, int lsize,
+                            const phloat *right, int rsize,
+                            int4 m, int4 n, int4 q,
+                            int (*completion)(int, vartype *));
+#endif
+
 struct mul_rr_data_struct {
     vartype_realmatrix *left;
     vartype_realmatrix *right;
     vartype *result;
-    int4 i, j, k;
-    phloat sum;
+    phloat *panel;
+    int4 i, j, k, j0, width;
+    phloat sum, comp;
     int (*completion)(int error, vartype *result);
 };
 
-static mul_rr_data_struct *mul_rr_data;
+static CORE_TLS mul_rr_data_struct *mul_rr_data;
 
 static int matrix_mul_rr_worker(bool interrupted);
 
+#ifdef BCD_MATH
+/* Binary engine: multiplies in double precision, in one go, without the
+ * interruptible worker. Returns NULL if the numbers don't fit in doubles,
+ * if the result overflows, or if we run out of memory; the caller then
+ * falls back on the Decimal multiplication.
+ */
+static vartype *matrix_mul_rr_binary(vartype_realmatrix *left,
+                                     vartype_realmatrix *right) {
+    int4 m = left->rows;
+    int4 n = right->columns;
+    int4 q = left->columns;
+    double *l = (double *) malloc((m * q + q * n + m * n) * sizeof(double));
+    if (l == NULL)
+        return NULL;
+    double *r = l + m * q;
+    double *p = r + q * n;
+    vartype *result = NULL;
+    if (!to_doubles(left->array->data, l, m * q)
+            || !to_doubles(right->array->data, r, q * n))
+        goto done;
+    for (int4 i = 0; i < m * n; i++)
+        p[i] = 0;
+    for (int4 i = 0; i < m; i++)
+        for (int4 k = 0; k < q; k++) {
+            double lik = l[i * q + k];
+            for (int4 j = 0; j < n; j++)
+                p[i * n + j] += lik * r[k * n + j];
+        }
+    for (int4 i = 0; i < m * n; i++)
+        if (!isfinite(p[i]))
+            goto done;
+    result = new_realmatrix(m, n);
+    if (result != NULL)
+        from_doubles(p, ((vartype_realmatrix *) result)->array->data, m * n);
+    done:
+    free(l);
+    return result;
+}
+#endif
+
 static int matrix_mul_rr(vartype_realmatrix *left, vartype_realmatrix *right,
                          int (*completion)(int, vartype *)) {
 
@@ -304,14 +522,38 @@ static int matrix_mul_rr(vartype_realmatrix *left, vartype_realmatrix *right,
         goto finished;
     }
 
+#ifdef BCD_MATH
+    if (core_settings.binary_engine) {
+        vartype *result = matrix_mul_rr_binary(left, right);
+        if (result != NULL)
+            return completion(ERR_NONE, result);
+    }
+#endif
+
+#ifdef LINALG_THREADS
+    if (linalg_team_size((double) left->rows * right->columns * left->columns) > 1
+            && matrix_mul_team(left->array->data, 1, right->array->data, 1,
+                               left->rows, right->columns, left->columns,
+                               completion))
+        return ERR_INTERRUPTIBLE;
+#endif
+
     dat = (mul_rr_data_struct *) malloc(sizeof(mul_rr_data_struct));
     if (dat == NULL) {
         error = ERR_INSUFFICIENT_MEMORY;
         goto finished;
     }
 
+    dat->panel = mul_panel_alloc(left->columns, right->columns, 1, &dat->width);
+    if (dat->panel == NULL) {
+        free(dat);
+        error = ERR_INSUFFICIENT_MEMORY;
+        goto finished;
+    }
+
     dat->result = new_realmatrix(left->rows, right->columns);
     if (dat->result == NULL) {
+        free(dat->panel);
         free(dat);
         error = ERR_INSUFFICIENT_MEMORY;
         goto finished;
@@ -322,8 +564,12 @@ static int matrix_mul_rr(vartype_realmatrix *left, vartype_realmatrix *right,
     dat->i = 0;
     dat->j = 0;
     dat->k = 0;
+    dat->j0 = 0;
     dat->sum = 0;
+    dat->comp = 0;
     dat->completion = completion;
+    mul_panel_fill(dat->panel, right->array->data, left->columns,
+                   right->columns, 1, 0, dat->width);
 
     mul_rr_data = dat;
     mode_interruptible = matrix_mul_rr_worker;
@@ -339,7 +585,7 @@ static int matrix_mul_rr_worker(bool interrupted) {
     int count = 0;
     int inf;
     phloat *l = dat->left->array->data;
-    phloat *r = dat->right->array->data;
+    phloat *c = dat->panel;
     phloat *p = ((vartype_realmatrix *) dat->result)->array->data;
     int4 i = dat->i;
     int4 j = dat->j;
@@ -347,24 +593,36 @@ static int matrix_mul_rr_worker(bool interrupted) {
     int4 m = dat->left->rows;
     int4 n = dat->right->columns;
     int4 q = dat->left->columns;
+    int4 j0 = dat->j0;
+    int4 j1 = j0 + dat->width < n ? j0 + dat->width : n;
     phloat sum = dat->sum;
+    phloat comp = dat->comp;
 
     if (interrupted) {
         int err = dat->completion(ERR_INTERRUPTED, NULL);
         free_vartype(dat->result);
+        free(dat->panel);
         free(dat);
         return err;
     }
 
-    while (count++ < 1000) {
-        sum += l[i * q + k] * r[k * n + j];
-        if (++k < q)
-            continue;
+    while (count < 1000) {
+        int4 kn = k + 1000 - count < q ? k + 1000 - count : q;
+        phloat *lrow = l + i * q;
+        phloat *ccol = c + (j - j0) * q;
+        count += kn - k;
+        for (; k < kn; k++)
+            linalg_add_product(&sum, &comp, lrow[k], ccol[k]);
+        if (k < q)
+            break;
         k = 0;
+        sum = linalg_sum(sum, comp);
+        comp = 0;
         if ((inf = p_isinf(sum)) != 0) {
             if (core_settings.matrix_outofrange && !flags.f.range_error_ignore){
                 int err = dat->completion(ERR_OUT_OF_RANGE, NULL);
                 free_vartype(dat->result);
+                free(dat->panel);
                 free(dat);
                 return err;
             } else
@@ -372,13 +630,20 @@ static int matrix_mul_rr_worker(bool interrupted) {
         }
         p[i * n + j] = sum;
         sum = 0;
-        if (++j < n)
+        if (++j < j1)
             continue;
-        j = 0;
+        j = j0;
         if (++i < m)
             continue;
-        else {
+        i = 0;
+        if (j1 < n) {
+            j = j0 = j1;
+            j1 = j0 + dat->width < n ? j0 + dat->width : n;
+            mul_panel_fill(c, dat->right->array->data, q, n, 1, j0, j1);
+            continue;
+        } else {
             int err = dat->completion(ERR_NONE, dat->result);
+            free(dat->panel);
             free(dat);
             return err;
         }
@@ -387,157 +652,23 @@ static int matrix_mul_rr_worker(bool interrupted) {
     dat->i = i;
     dat->j = j;
     dat->k = k;
+    dat->j0 = j0;
     dat->sum = sum;
+    dat->comp = comp;
     return ERR_INTERRUPTIBLE;
 }
 
-#if 0
-/* TODO: Blocked matrix multiplication
- * This commented-out function implements a working blocked matrix
- * multiplication algorithm. It works by breaking up the multiplication into
- * multiplications of submatrices of the multiplicands. If the submatrices are
- * sufficiently small, they can be made to fit entirely in the CPU's L1 cache.
- * With block sizes of around 45, I have observed a speed-up factor of circa
- * 1.7 on a Pentium MMX, and with block sizes of about 90, I have observed a
- * speed-up factor of circa 3 on a Duron. (Those were the optimum block sizes
- * observed for each processor.) These numbers suggest the Pentium MMX has a 32
- * kilobyte L1 cache, and the Duron has a 128 kilobyte L1 cache.
- * For production use, the block size should be a user-configurable parameter,
- * with a built-in tool to automatically determine the optimum value. Since the
- * UI for this kind of advanced configuration does not exist yet, and sice the
- * determination of optimum block size is a very slow process, and since I
- * expect most HP-42S users will not be very interested in using a calculator
- * to work with order-100+ matrices, and since even in the optimum case the
- * speed-up is not staggering, I'm putting full implementation of this feature
- * off until some later date.
- */
-static int matrix_mul_rr(vartype_realmatrix *left, vartype_realmatrix *right,
-                         vartype **result) {
-    phloat *cache = NULL;
-    phloat *leftcache, *rightcache;
-
-    phloat *l = left->array->data;
-    phloat *r = right->array->data;
-    phloat *p;
-    int inf;
-    int4 m, n, q;
-    int4 i, j, k;
-
-    q = left->columns;
-    if (q != right->rows)
-        return ERR_DIMENSION_ERROR;
-    m = left->rows;
-    n = right->columns;
-
-    if (contains_strings(left) || contains_strings(right))
-        return ERR_ALPHA_DATA_IS_INVALID;
-
-    *result = new_realmatrix(m, n);
-    if (*result == NULL)
-        return ERR_INSUFFICIENT_MEMORY;
-    p = ((vartype_realmatrix *) *result)->array->data;
-
-    if (BLOCK_SIZE > 0) {
-        int4 cachesize = 2 * BLOCK_SIZE * BLOCK_SIZE;
-        int4 alignment = CACHE_ALIGNMENT;
-        int4 misalgn;
-        if (alignment == 0)
-            alignment = 1;
-        misalgn = alignment % sizeof(phloat);
-        if (misalgn != 0)
-            alignment += sizeof(phloat) - misalgn;
-
-        cache = (phloat *) malloc(cachesize * sizeof(phloat) + alignment);
-        if (cache != NULL) {
-            misalgn = ((unsigned long) cache) % alignment;
-            if (misalgn == 0)
-                leftcache = cache;
-            else
-                leftcache = cache + (alignment - misalgn) / sizeof(phloat);
-            rightcache = leftcache + BLOCK_SIZE * BLOCK_SIZE;
-        }
-    }
-
-    if (cache == NULL) {
-
-        /* Falling back on basic i,j,k algorithm */
-        for (i = 0; i < m; i++)
-            for (j = 0; j < n; j++) {
-                phloat sum = 0;
-                for (k = 0; k < q; k++)
-                    sum += l[i * q + k] * r[k * n + j];
-                if ((inf = p_isinf(sum)) != 0) {
-                    if (core_settings.matrix_outofrange
-                                            && !flags.f.range_error_ignore)
-                        return ERR_OUT_OF_RANGE;
-                    else
-                        sum = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
-                }
-                p[i * n + j] = sum;
-            }
-        return ERR_NONE;
-
-    } else {
-
-        /* Blocked i,j,k algorithm for optimal cache utilization */
-        int4 i, j, k, ii, jj, kk;
-        for (i = 0; i < m; i += BLOCK_SIZE) {
-            int4 iimax = m - i;
-            if (iimax > BLOCK_SIZE)
-                iimax = BLOCK_SIZE;
-            for (j = 0; j < n; j += BLOCK_SIZE) {
-                int4 jjmax = n - j;
-                if (jjmax > BLOCK_SIZE)
-                    jjmax = BLOCK_SIZE;
-                for (k = 0; k < q; k += BLOCK_SIZE) {
-                    int4 kkmax = q - k;
-                    if (kkmax > BLOCK_SIZE)
-                        kkmax = BLOCK_SIZE;
-                    for (ii = 0; ii < iimax; ii++)
-                        for (kk = 0; kk < kkmax; kk++)
-                            leftcache[ii * BLOCK_SIZE + kk]
-                                = l[(ii + i) * q + (kk + k)];
-                    for (kk = 0; kk < kkmax; kk++)
-                        for (jj = 0; jj < jjmax; jj++)
-                            rightcache[kk * BLOCK_SIZE + jj]
-                                = r[(kk + k) * n + (jj + j)];
-                    for (ii = 0; ii < iimax; ii++)
-                        for (jj = 0; jj < jjmax; jj++) {
-                            phloat sum = p[(ii + i) * n + (jj + j)];
-                            for (kk = 0; kk < kkmax; kk++)
-                                sum += leftcache[ii * BLOCK_SIZE + kk]
-                                        * rightcache[kk * BLOCK_SIZE + jj];
-                            if ((inf = p_isinf(sum)) != 0) {
-                                if (core_settings.matrix_outofrange
-                                            && !flags.f.range_error_ignore) {
-                                    free(cache);
-                                    return ERR_OUT_OF_RANGE;
-                                } else
-                                    sum = inf < 0 ? NEG_HUGE_PHLOAT
-                                                  : POS_HUGE_PHLOAT;
-                            }
-                            p[(ii + i) * n + (jj + j)] = sum;
-                        }
-                }
-            }
-        }
-        free(cache);
-        return ERR_NONE;
-
-    }
-}
-#endif
-
 struct mul_rc_data_struct {
     vartype_realmatrix *left;
     vartype_complexmatrix *right;
     vartype *result;
-    int4 i, j, k;
+    phloat *panel;
+    int4 i, j, k, j0, width;
     phloat sum_re, sum_im;
     int (*completion)(int error, vartype *result);
 };
 
-static mul_rc_data_struct *mul_rc_data;
+static CORE_TLS mul_rc_data_struct *mul_rc_data;
 
 static int matrix_mul_rc_worker(bool interrupted);
 
@@ -557,14 +688,30 @@ static int matrix_mul_rc(vartype_realmatrix *left, vartype_complexmatrix *right,
         goto finished;
     }
 
+#ifdef LINALG_THREADS
+    if (linalg_team_size((double) left->rows * right->columns * left->columns) > 1
+            && matrix_mul_team(left->array->data, 1, right->array->data, 2,
+                               left->rows, right->columns, left->columns,
+                               completion))
+        return ERR_INTERRUPTIBLE;
+#endif
+
     dat = (mul_rc_data_struct *) malloc(sizeof(mul_rc_data_struct));
     if (dat == NULL) {
         error = ERR_INSUFFICIENT_MEMORY;
         goto finished;
     }
 
+    dat->panel = mul_panel_alloc(left->columns, right->columns, 2, &dat->width);
+    if (dat->panel == NULL) {
+        free(dat);
+        error = ERR_INSUFFICIENT_MEMORY;
+        goto finished;
+    }
+
     dat->result = new_complexmatrix(left->rows, right->columns);
     if (dat->result == NULL) {
+        free(dat->panel);
         free(dat);
         error = ERR_INSUFFICIENT_MEMORY;
         goto finished;
@@ -575,9 +722,12 @@ static int matrix_mul_rc(vartype_realmatrix *left, vartype_complexmatrix *right,
     dat->i = 0;
     dat->j = 0;
     dat->k = 0;
+    dat->j0 = 0;
     dat->sum_re = 0;
     dat->sum_im = 0;
     dat->completion = completion;
+    mul_panel_fill(dat->panel, right->array->data, left->columns,
+                   right->columns, 2, 0, dat->width);
 
     mul_rc_data = dat;
     mode_interruptible = matrix_mul_rc_worker;
@@ -593,7 +743,7 @@ static int matrix_mul_rc_worker(bool interrupted) {
     int count = 0;
     int inf;
     phloat *l = dat->left->array->data;
-    phloat *r = dat->right->array->data;
+    phloat *c = dat->panel;
     phloat *p = ((vartype_complexmatrix *) dat->result)->array->data;
     int4 i = dat->i;
     int4 j = dat->j;
@@ -601,27 +751,37 @@ static int matrix_mul_rc_worker(bool interrupted) {
     int4 m = dat->left->rows;
     int4 n = dat->right->columns;
     int4 q = dat->left->columns;
+    int4 j0 = dat->j0;
+    int4 j1 = j0 + dat->width < n ? j0 + dat->width : n;
     phloat sum_re = dat->sum_re;
     phloat sum_im = dat->sum_im;
 
     if (interrupted) {
         int err = dat->completion(ERR_INTERRUPTED, NULL);
         free_vartype(dat->result);
+        free(dat->panel);
         free(dat);
         return err;
     }
 
-    while (count++ < 1000) {
-        phloat tmp = l[i * q + k];
-        sum_re += tmp * r[2 * (k * n + j)];
-        sum_im += tmp * r[2 * (k * n + j) + 1];
-        if (++k < q)
-            continue;
+    while (count < 1000) {
+        int4 kn = k + 1000 - count < q ? k + 1000 - count : q;
+        phloat *lrow = l + i * q;
+        phloat *ccol = c + 2 * (j - j0) * q;
+        count += kn - k;
+        for (; k < kn; k++) {
+            phloat tmp = lrow[k];
+            sum_re += tmp * ccol[2 * k];
+            sum_im += tmp * ccol[2 * k + 1];
+        }
+        if (k < q)
+            break;
         k = 0;
         if ((inf = p_isinf(sum_re)) != 0) {
             if (core_settings.matrix_outofrange && !flags.f.range_error_ignore){
                 int err = dat->completion(ERR_OUT_OF_RANGE, NULL);
                 free_vartype(dat->result);
+                free(dat->panel);
                 free(dat);
                 return err;
             } else
@@ -631,6 +791,7 @@ static int matrix_mul_rc_worker(bool interrupted) {
             if (core_settings.matrix_outofrange && !flags.f.range_error_ignore){
                 int err = dat->completion(ERR_OUT_OF_RANGE, NULL);
                 free_vartype(dat->result);
+                free(dat->panel);
                 free(dat);
                 return err;
             } else
@@ -640,13 +801,20 @@ static int matrix_mul_rc_worker(bool interrupted) {
         p[2 * (i * n + j) + 1] = sum_im;
         sum_re = 0;
         sum_im = 0;
-        if (++j < n)
+        if (++j < j1)
             continue;
-        j = 0;
+        j = j0;
         if (++i < m)
             continue;
-        else {
+        i = 0;
+        if (j1 < n) {
+            j = j0 = j1;
+            j1 = j0 + dat->width < n ? j0 + dat->width : n;
+            mul_panel_fill(c, dat->right->array->data, q, n, 2, j0, j1);
+            continue;
+        } else {
             int err = dat->completion(ERR_NONE, dat->result);
+            free(dat->panel);
             free(dat);
             return err;
         }
@@ -655,6 +823,7 @@ static int matrix_mul_rc_worker(bool interrupted) {
     dat->i = i;
     dat->j = j;
     dat->k = k;
+    dat->j0 = j0;
     dat->sum_re = sum_re;
     dat->sum_im = sum_im;
     return ERR_INTERRUPTIBLE;
@@ -664,12 +833,13 @@ struct mul_cr_data_struct {
     vartype_complexmatrix *left;
     vartype_realmatrix *right;
     vartype *result;
-    int4 i, j, k;
+    phloat *panel;
+    int4 i, j, k, j0, width;
     phloat sum_re, sum_im;
     int (*completion)(int error, vartype *result);
 };
 
-static mul_cr_data_struct *mul_cr_data;
+static CORE_TLS mul_cr_data_struct *mul_cr_data;
 
 static int matrix_mul_cr_worker(bool interrupted);
 
@@ -689,14 +859,30 @@ static int matrix_mul_cr(vartype_complexmatrix *left, vartype_realmatrix *right,
         goto finished;
     }
 
+#ifdef LINALG_THREADS
+    if (linalg_team_size((double) left->rows * right->columns * left->columns) > 1
+            && matrix_mul_team(left->array->data, 2, right->array->data, 1,
+                               left->rows, right->columns, left->columns,
+                               completion))
+        return ERR_INTERRUPTIBLE;
+#endif
+
     dat = (mul_cr_data_struct *) malloc(sizeof(mul_cr_data_struct));
     if (dat == NULL) {
         error = ERR_INSUFFICIENT_MEMORY;
         goto finished;
     }
 
+    dat->panel = mul_panel_alloc(left->columns, right->columns, 1, &dat->width);
+    if (dat->panel == NULL) {
+        free(dat);
+        error = ERR_INSUFFICIENT_MEMORY;
+        goto finished;
+    }
+
     dat->result = new_complexmatrix(left->rows, right->columns);
     if (dat->result == NULL) {
+        free(dat->panel);
         free(dat);
         error = ERR_INSUFFICIENT_MEMORY;
         goto finished;
@@ -707,9 +893,12 @@ static int matrix_mul_cr(vartype_complexmatrix *left, vartype_realmatrix *right,
     dat->i = 0;
     dat->j = 0;
     dat->k = 0;
+    dat->j0 = 0;
     dat->sum_re = 0;
     dat->sum_im = 0;
     dat->completion = completion;
+    mul_panel_fill(dat->panel, right->array->data, left->columns,
+                   right->columns, 1, 0, dat->width);
 
     mul_cr_data = dat;
     mode_interruptible = matrix_mul_cr_worker;
@@ -725,7 +914,7 @@ static int matrix_mul_cr_worker(bool interrupted) {
     int count = 0;
     int inf;
     phloat *l = dat->left->array->data;
-    phloat *r = dat->right->array->data;
+    phloat *c = dat->panel;
     phloat *p = ((vartype_complexmatrix *) dat->result)->array->data;
     int4 i = dat->i;
     int4 j = dat->j;
@@ -733,27 +922,37 @@ static int matrix_mul_cr_worker(bool interrupted) {
     int4 m = dat->left->rows;
     int4 n = dat->right->columns;
     int4 q = dat->left->columns;
+    int4 j0 = dat->j0;
+    int4 j1 = j0 + dat->width < n ? j0 + dat->width : n;
     phloat sum_re = dat->sum_re;
     phloat sum_im = dat->sum_im;
 
     if (interrupted) {
         int err = dat->completion(ERR_INTERRUPTED, NULL);
         free_vartype(dat->result);
+        free(dat->panel);
         free(dat);
         return err;
     }
 
-    while (count++ < 1000) {
-        phloat tmp = r[k * n + j];
-        sum_re += tmp * l[2 * (i * q + k)];
-        sum_im += tmp * l[2 * (i * q + k) + 1];
-        if (++k < q)
-            continue;
+    while (count < 1000) {
+        int4 kn = k + 1000 - count < q ? k + 1000 - count : q;
+        phloat *lrow = l + 2 * i * q;
+        phloat *ccol = c + (j - j0) * q;
+        count += kn - k;
+        for (; k < kn; k++) {
+            phloat tmp = ccol[k];
+            sum_re += tmp * lrow[2 * k];
+            sum_im += tmp * lrow[2 * k + 1];
+        }
+        if (k < q)
+            break;
         k = 0;
         if ((inf = p_isinf(sum_re)) != 0) {
             if (core_settings.matrix_outofrange && !flags.f.range_error_ignore){
                 int err = dat->completion(ERR_OUT_OF_RANGE, NULL);
                 free_vartype(dat->result);
+                free(dat->panel);
                 free(dat);
                 return err;
             } else
@@ -763,6 +962,7 @@ static int matrix_mul_cr_worker(bool interrupted) {
             if (core_settings.matrix_outofrange && !flags.f.range_error_ignore){
                 int err = dat->completion(ERR_OUT_OF_RANGE, NULL);
                 free_vartype(dat->result);
+                free(dat->panel);
                 free(dat);
                 return err;
             } else
@@ -772,13 +972,20 @@ static int matrix_mul_cr_worker(bool interrupted) {
         p[2 * (i * n + j) + 1] = sum_im;
         sum_re = 0;
         sum_im = 0;
-        if (++j < n)
+        if (++j < j1)
             continue;
-        j = 0;
+        j = j0;
         if (++i < m)
             continue;
-        else {
+        i = 0;
+        if (j1 < n) {
+            j = j0 = j1;
+            j1 = j0 + dat->width < n ? j0 + dat->width : n;
+            mul_panel_fill(c, dat->right->array->data, q, n, 1, j0, j1);
+            continue;
+        } else {
             int err = dat->completion(ERR_NONE, dat->result);
+            free(dat->panel);
             free(dat);
             return err;
         }
@@ -787,6 +994,7 @@ static int matrix_mul_cr_worker(bool interrupted) {
     dat->i = i;
     dat->j = j;
     dat->k = k;
+    dat->j0 = j0;
     dat->sum_re = sum_re;
     dat->sum_im = sum_im;
     return ERR_INTERRUPTIBLE;
@@ -796,12 +1004,16 @@ struct mul_cc_data_struct {
     vartype_complexmatrix *left;
     vartype_complexmatrix *right;
     vartype *result;
-    int4 i, j, k;
-    phloat sum_re, sum_im;
+    phloat *panel, *row;
+    int4 i, j, k, j0, width;
+    phloat sum_re, sum_im, sum_ss;
+    // With Gauss's trick: whether the right-hand matrix is nearly real, and
+    // whether the current row is as well, so it is done the usual way
+    bool right_real, row_real;
     int (*completion)(int error, vartype *result);
 };
 
-static mul_cc_data_struct *mul_cc_data;
+static CORE_TLS mul_cc_data_struct *mul_cc_data;
 
 static int matrix_mul_cc_worker(bool interrupted);
 
@@ -809,21 +1021,44 @@ static int matrix_mul_cc(vartype_complexmatrix *left, vartype_complexmatrix *rig
                          int (*completion)(int, vartype *)) {
 
     mul_cc_data_struct *dat;
-    int error;
+    int error, size;
 
     if (left->columns != right->rows) {
         error = ERR_DIMENSION_ERROR;
         goto finished;
     }
 
+#ifdef LINALG_THREADS
+    if (linalg_team_size((double) left->rows * right->columns * left->columns) > 1
+            && matrix_mul_team(left->array->data, 2, right->array->data, 2,
+                               left->rows, right->columns, left->columns,
+                               completion))
+        return ERR_INTERRUPTIBLE;
+#endif
+
     dat = (mul_cc_data_struct *) malloc(sizeof(mul_cc_data_struct));
     if (dat == NULL) {
         error = ERR_INSUFFICIENT_MEMORY;
         goto finished;
     }
 
+    size = left->columns >= MUL_GAUSS_MIN ? 3 : 2;
+    dat->panel = mul_panel_alloc(left->columns, right->columns, size,
+                                 &dat->width);
+    dat->row = size == 2 ? NULL
+                : (phloat *) malloc(3 * left->columns * sizeof(phloat));
+    if (dat->panel == NULL || (dat->row == NULL && size == 3)) {
+        free(dat->panel);
+        free(dat->row);
+        free(dat);
+        error = ERR_INSUFFICIENT_MEMORY;
+        goto finished;
+    }
+
     dat->result = new_complexmatrix(left->rows, right->columns);
     if (dat->result == NULL) {
+        free(dat->panel);
+        free(dat->row);
         free(dat);
         error = ERR_INSUFFICIENT_MEMORY;
         goto finished;
@@ -834,9 +1069,18 @@ static int matrix_mul_cc(vartype_complexmatrix *left, vartype_complexmatrix *rig
     dat->i = 0;
     dat->j = 0;
     dat->k = 0;
+    dat->j0 = 0;
     dat->sum_re = 0;
     dat->sum_im = 0;
+    dat->sum_ss = 0;
     dat->completion = completion;
+    mul_panel_fill(dat->panel, right->array->data, left->columns,
+                   right->columns, size, 0, dat->width);
+    dat->right_real = dat->row != NULL
+            && mul_nearly_real(right->array->data, right->rows * right->columns);
+    dat->row_real = dat->row != NULL
+            && mul_row_fill_gauss(dat->row, left->array->data, left->columns, 0)
+            && dat->right_real;
 
     mul_cc_data = dat;
     mode_interruptible = matrix_mul_cc_worker;
@@ -852,7 +1096,9 @@ static int matrix_mul_cc_worker(bool interrupted) {
     int count = 0;
     int inf;
     phloat *l = dat->left->array->data;
-    phloat *r = dat->right->array->data;
+    phloat *c = dat->panel;
+    phloat *g = dat->row;
+    int size = g == NULL ? 2 : 3;
     phloat *p = ((vartype_complexmatrix *) dat->result)->array->data;
     int4 i = dat->i;
     int4 j = dat->j;
@@ -860,30 +1106,69 @@ static int matrix_mul_cc_worker(bool interrupted) {
     int4 m = dat->left->rows;
     int4 n = dat->right->columns;
     int4 q = dat->left->columns;
+    int4 j0 = dat->j0;
+    int4 j1 = j0 + dat->width < n ? j0 + dat->width : n;
     phloat sum_re = dat->sum_re;
     phloat sum_im = dat->sum_im;
+    // With Gauss's trick, sum_re, sum_im, and sum_ss accumulate the products
+    // of the real parts, the imaginary parts, and the sums
+    phloat sum_ss = dat->sum_ss;
+    bool row_real = dat->row_real;
 
     if (interrupted) {
         int err = dat->completion(ERR_INTERRUPTED, NULL);
         free_vartype(dat->result);
+        free(dat->panel);
+        free(g);
         free(dat);
         return err;
     }
 
-    while (count++ < 1000) {
-        phloat l_re = l[2 * (i * q + k)];
-        phloat l_im = l[2 * (i * q + k) + 1];
-        phloat r_re = r[2 * (k * n + j)];
-        phloat r_im = r[2 * (k * n + j) + 1];
-        sum_re += l_re * r_re - l_im * r_im;
-        sum_im += l_im * r_re + l_re * r_im;
-        if (++k < q)
-            continue;
+    while (count < 1000) {
+        int4 kn = k + 1000 - count < q ? k + 1000 - count : q;
+        phloat *lrow = l + 2 * i * q;
+        phloat *ccol = c + size * (j - j0) * q;
+        count += kn - k;
+        if (g == NULL) {
+            for (; k < kn; k++) {
+                phloat l_re = lrow[2 * k];
+                phloat l_im = lrow[2 * k + 1];
+                phloat r_re = ccol[2 * k];
+                phloat r_im = ccol[2 * k + 1];
+                sum_re += l_re * r_re - l_im * r_im;
+                sum_im += l_im * r_re + l_re * r_im;
+            }
+        } else if (row_real) {
+            for (; k < kn; k++) {
+                phloat l_re = g[k];
+                phloat l_im = g[q + k];
+                phloat r_re = ccol[k];
+                phloat r_im = ccol[q + k];
+                sum_re += l_re * r_re - l_im * r_im;
+                sum_im += l_im * r_re + l_re * r_im;
+            }
+        } else {
+            for (; k < kn; k++) {
+                sum_re += g[k] * ccol[k];
+                sum_im += g[q + k] * ccol[q + k];
+                sum_ss += g[2 * q + k] * ccol[2 * q + k];
+            }
+        }
+        if (k < q)
+            break;
         k = 0;
+        if (g != NULL && !row_real) {
+            mul_gauss_finish(sum_re, sum_im, sum_ss, lrow,
+                             dat->right->array->data, q, n, j,
+                             &sum_re, &sum_im);
+            sum_ss = 0;
+        }
         if ((inf = p_isinf(sum_re)) != 0) {
             if (core_settings.matrix_outofrange && !flags.f.range_error_ignore){
                 int err = dat->completion(ERR_OUT_OF_RANGE, NULL);
                 free_vartype(dat->result);
+                free(dat->panel);
+                free(g);
                 free(dat);
                 return err;
             } else
@@ -893,6 +1178,8 @@ static int matrix_mul_cc_worker(bool interrupted) {
             if (core_settings.matrix_outofrange && !flags.f.range_error_ignore){
                 int err = dat->completion(ERR_OUT_OF_RANGE, NULL);
                 free_vartype(dat->result);
+                free(dat->panel);
+                free(g);
                 free(dat);
                 return err;
             } else
@@ -902,13 +1189,26 @@ static int matrix_mul_cc_worker(bool interrupted) {
         p[2 * (i * n + j) + 1] = sum_im;
         sum_re = 0;
         sum_im = 0;
-        if (++j < n)
+        if (++j < j1)
             continue;
-        j = 0;
-        if (++i < m)
+        j = j0;
+        if (++i < m) {
+            if (g != NULL)
+                row_real = mul_row_fill_gauss(g, l, q, i) && dat->right_real;
             continue;
-        else {
+        }
+        i = 0;
+        if (j1 < n) {
+            j = j0 = j1;
+            j1 = j0 + dat->width < n ? j0 + dat->width : n;
+            mul_panel_fill(c, dat->right->array->data, q, n, size, j0, j1);
+            if (g != NULL)
+                row_real = mul_row_fill_gauss(g, l, q, 0) && dat->right_real;
+            continue;
+        } else {
             int err = dat->completion(ERR_NONE, dat->result);
+            free(dat->panel);
+            free(g);
             free(dat);
             return err;
         }
@@ -917,11 +1217,232 @@ static int matrix_mul_cc_worker(bool interrupted) {
     dat->i = i;
     dat->j = j;
     dat->k = k;
+    dat->j0 = j0;
     dat->sum_re = sum_re;
     dat->sum_im = sum_im;
+    dat->sum_ss = sum_ss;
+    dat->row_real = row_real;
     return ERR_INTERRUPTIBLE;
 }
 
+#ifdef LINALG_THREADS
+/* Multiplication of large matrices by a team of threads. The right-hand
+ * matrix is copied into one panel holding all of its columns, and the
+ * threads take rows of the left-hand matrix one at a time, computing each
+ * element of the product the same way the single-threaded workers do.
+ * For Gauss's trick, the panel is split into planes, and each thread has
+ * room for the planes of one row in 'rows'. If the team can't be set up,
+ * matrix_mul_team() returns false, and the single-threaded code is used.
+ */
+struct mul_team_data_struct {
+    const phloat *left;
+    const phloat *r;
+    phloat *right;
+    phloat *rows;
+    phloat *p;
+    vartype *result;
+    int4 m, n, q;
+    int lsize, rsize;
+    bool range_error;
+    bool right_real;
+    std::atomic<int4> next_row;
+    std::atomic<bool> overflow;
+    linalg_team *team;
+    int (*completion)(int error, vartype *result);
+};
+
+static CORE_TLS mul_team_data_struct *mul_team_data;
+
+static int matrix_mul_team_worker(bool interrupted);
+
+static bool mul_team_store(mul_team_data_struct *dat, phloat *dst, phloat x) {
+    int inf;
+    if ((inf = p_isinf(x)) != 0) {
+        if (dat->range_error) {
+            dat->overflow = true;
+            return false;
+        } else
+            x = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
+    }
+    *dst = x;
+    return true;
+}
+
+static bool mul_team_row(mul_team_data_struct *dat, int4 i, phloat *g) {
+    int4 n = dat->n;
+    int4 q = dat->q;
+    const phloat *lrow = dat->left + dat->lsize * i * q;
+    if (dat->lsize == 1 && dat->rsize == 1) {
+        phloat *prow = dat->p + i * n;
+        for (int4 j = 0; j < n; j++) {
+            const phloat *ccol = dat->right + j * q;
+            phloat sum = 0, comp = 0;
+            for (int4 k = 0; k < q; k++)
+                linalg_add_product(&sum, &comp, lrow[k], ccol[k]);
+            if (!mul_team_store(dat, prow + j, linalg_sum(sum, comp)))
+                return false;
+        }
+        return true;
+    }
+    phloat *prow = dat->p + 2 * i * n;
+    if (g != NULL) {
+        bool row_real = mul_row_fill_gauss(g, dat->left, q, i)
+                        && dat->right_real;
+        for (int4 j = 0; j < n; j++) {
+            const phloat *ccol = dat->right + 3 * j * q;
+            phloat sum_re = 0, sum_im = 0;
+            if (row_real) {
+                for (int4 k = 0; k < q; k++) {
+                    phloat l_re = g[k];
+                    phloat l_im = g[q + k];
+                    phloat r_re = ccol[k];
+                    phloat r_im = ccol[q + k];
+                    sum_re += l_re * r_re - l_im * r_im;
+                    sum_im += l_im * r_re + l_re * r_im;
+                }
+            } else {
+                phloat sum_rr = 0, sum_ii = 0, sum_ss = 0;
+                for (int4 k = 0; k < q; k++) {
+                    sum_rr += g[k] * ccol[k];
+                    sum_ii += g[q + k] * ccol[q + k];
+                    sum_ss += g[2 * q + k] * ccol[2 * q + k];
+                }
+                mul_gauss_finish(sum_rr, sum_ii, sum_ss, lrow, dat->r, q, n, j,
+                                 &sum_re, &sum_im);
+            }
+            if (!mul_team_store(dat, prow + 2 * j, sum_re)
+                    || !mul_team_store(dat, prow + 2 * j + 1, sum_im))
+                return false;
+        }
+        return true;
+    }
+    for (int4 j = 0; j < n; j++) {
+        const phloat *ccol = dat->right + dat->rsize * j * q;
+        phloat sum_re = 0, sum_im = 0;
+        if (dat->lsize == 1) {
+            for (int4 k = 0; k < q; k++) {
+                phloat tmp = lrow[k];
+                sum_re += tmp * ccol[2 * k];
+                sum_im += tmp * ccol[2 * k + 1];
+            }
+        } else if (dat->rsize == 1) {
+            for (int4 k = 0; k < q; k++) {
+                phloat tmp = ccol[k];
+                sum_re += tmp * lrow[2 * k];
+                sum_im += tmp * lrow[2 * k + 1];
+            }
+        } else {
+            for (int4 k = 0; k < q; k++) {
+                phloat l_re = lrow[2 * k];
+                phloat l_im = lrow[2 * k + 1];
+                phloat r_re = ccol[2 * k];
+                phloat r_im = ccol[2 * k + 1];
+                sum_re += l_re * r_re - l_im * r_im;
+                sum_im += l_im * r_re + l_re * r_im;
+            }
+        }
+        if (!mul_team_store(dat, prow + 2 * j, sum_re)
+                || !mul_team_store(dat, prow + 2 * j + 1, sum_im))
+            return false;
+    }
+    return true;
+}
+
+static void mul_team_run(linalg_team *team, void *arg, int thread) {
+    mul_team_data_struct *dat = (mul_team_data_struct *) arg;
+    phloat *g = dat->rows == NULL ? NULL : dat->rows + 3 * thread * dat->q;
+    int4 i;
+    while ((i = dat->next_row++) < dat->m)
+        if (linalg_team_cancelled(team) || !mul_team_row(dat, i, g))
+            return;
+}
+
+static bool matrix_mul_team(const phloat *left, int lsize,
+                            const phloat *right, int rsize,
+                            int4 m, int4 n, int4 q,
+                            int (*completion)(int, vartype *)) {
+    mul_team_data_struct *dat = new (std::nothrow) mul_team_data_struct;
+    if (dat == NULL)
+        return false;
+    int threads = linalg_team_size((double) m * n * q);
+    int size = lsize == 2 && rsize == 2 && q >= MUL_GAUSS_MIN ? 3 : rsize;
+    dat->right = (phloat *) malloc(q * n * size * sizeof(phloat));
+    dat->rows = size != 3 ? NULL
+                : (phloat *) malloc(threads * 3 * q * sizeof(phloat));
+    if (dat->right == NULL || (dat->rows == NULL && size == 3)) {
+        free(dat->right);
+        free(dat->rows);
+        delete dat;
+        return false;
+    }
+    if (lsize == 1 && rsize == 1) {
+        dat->result = new_realmatrix(m, n);
+        if (dat->result != NULL)
+            dat->p = ((vartype_realmatrix *) dat->result)->array->data;
+    } else {
+        dat->result = new_complexmatrix(m, n);
+        if (dat->result != NULL)
+            dat->p = ((vartype_complexmatrix *) dat->result)->array->data;
+    }
+    if (dat->result == NULL) {
+        free(dat->right);
+        free(dat->rows);
+        delete dat;
+        return false;
+    }
+    mul_panel_fill(dat->right, right, q, n, size, 0, n);
+    dat->right_real = size == 3 && mul_nearly_real(right, q * n);
+
+    dat->left = left;
+    dat->r = right;
+    dat->m = m;
+    dat->n = n;
+    dat->q = q;
+    dat->lsize = lsize;
+    dat->rsize = rsize;
+    dat->range_error = core_settings.matrix_outofrange
+                            && !flags.f.range_error_ignore;
+    dat->next_row = 0;
+    dat->overflow = false;
+    dat->completion = completion;
+    dat->team = linalg_team_start(&threads, mul_team_run, dat);
+    if (dat->team == NULL) {
+        free_vartype(dat->result);
+        free(dat->right);
+        free(dat->rows);
+        delete dat;
+        return false;
+    }
+
+    mul_team_data = dat;
+    mode_interruptible = matrix_mul_team_worker;
+    mode_stoppable = false;
+    return true;
+}
+
+static int matrix_mul_team_worker(bool interrupted) {
+    mul_team_data_struct *dat = mul_team_data;
+    int err;
+
+    if (interrupted)
+        linalg_team_cancel(dat->team);
+    else if (!linalg_team_wait(dat->team))
+        return ERR_INTERRUPTIBLE;
+    linalg_team_free(dat->team);
+    free(dat->right);
+    free(dat->rows);
+
+    if (interrupted || dat->overflow) {
+        err = dat->completion(interrupted ? ERR_INTERRUPTED : ERR_OUT_OF_RANGE,
+                              NULL);
+        free_vartype(dat->result);
+    } else
+        err = dat->completion(ERR_NONE, dat->result);
+    delete dat;
+    return err;
+}
+#endif
+
 int linalg_mul(const vartype *left, const vartype *right,
                                     int (*completion)(int, vartype *)) {
     if (left->type == TYPE_REALMATRIX) {
@@ -950,8 +1471,8 @@ int linalg_mul(const vartype *left, const vartype *right,
 /***** Matrix inverse *****/
 /**************************/
 
-static void (*linalg_inv_completion)(int error, vartype *det);
-static vartype *linalg_inv_result;
+static CORE_TLS void (*linalg_inv_completion)(int error, vartype *det);
+static CORE_TLS vartype *linalg_inv_result;
 
 static int inv_r_completion1(int error, vartype_realmatrix *a, int4 *perm,
                                 phloat det);
@@ -1079,8 +1600,8 @@ static int inv_c_completion2(int error, vartype_complexmatrix *a, int4 *perm,
 /***** Matrix determinant *****/
 /******************************/
 
-static void (*linalg_det_completion)(int error, vartype *det);
-static bool linalg_det_prev_sm_err;
+static CORE_TLS void (*linalg_det_completion)(int error, vartype *det);
+static CORE_TLS bool linalg_det_prev_sm_err;
 
 static int det_r_completion(int error, vartype_realmatrix *a, int4 *perm,
                                     phloat det);
@@ -1232,3 +1753,202 @@ static int det_c_completion(int error, vartype_complexmatrix *a, int4 *perm,
     linalg_det_completion(error, det_v);
     return error;
 }
+
+
+/**************************************/
+/***** Threads for large matrices *****/
+/**************************************/
+
+#ifdef LINALG_THREADS
+
+#ifdef BCD_MATH
+// At least around 10 milliseconds' worth of work for each thread
+#define LINALG_TEAM_MIN_OPS 20000
+#else
+#define LINALG_TEAM_MIN_OPS 2000000
+#endif
+#define LINALG_TEAM_MAX 64
+
+#ifdef BCD_MATH
+/* The BID library is built with DECIMAL_GLOBAL_EXCEPTION_FLAGS, so every
+ * operation updates _IDEC_glbflags. The core never reads it, but the threads
+ * of a team would still race on it, unless it is thread-local, which it is
+ * where bid_conf.h defines BID_THREAD as something, i.e. everywhere but on
+ * macOS. Where it isn't, the Decimal version doesn't use teams.
+ */
+#define LINALG_STR2(x) #x
+#define LINALG_STR(x) LINALG_STR2(x)
+static const bool bid_flags_thread_local = sizeof(LINALG_STR(BID_THREAD)) > 1;
+#endif
+
+struct linalg_team {
+    void (*run)(linalg_team *, void *, int);
+    void *arg;
+    int threads;
+    core_settings_struct settings;
+    std::mutex mutex;
+    std::condition_variable cond;
+    int running;
+    int waiting;
+    int4 generation;
+    std::atomic<bool> cancelled;
+};
+
+/* The threads that run the teams are started as they are needed, and are
+ * kept for the next team when they're done, rather than starting threads
+ * for each operation. Idle workers are kept in a list, and each one waits
+ * for its 'team' to be set; the list is shared by all the calculators in
+ * the process, in builds with CORE_THREADS.
+ */
+struct linalg_worker {
+    std::condition_variable cond;
+    linalg_team *team;
+    int thread;
+    linalg_worker *next;
+};
+
+static std::mutex linalg_pool_mutex;
+static linalg_worker *linalg_pool_idle = NULL;
+
+int linalg_team_size(double ops) {
+#ifdef BCD_MATH
+    if (!bid_flags_thread_local)
+        return 1;
+#endif
+    int threads = core_settings.matrix_threads;
+    if (threads <= 0)
+        threads = std::thread::hardware_concurrency();
+    if (threads > LINALG_TEAM_MAX)
+        threads = LINALG_TEAM_MAX;
+    if (threads > ops / LINALG_TEAM_MIN_OPS)
+        threads = (int) (ops / LINALG_TEAM_MIN_OPS);
+    return threads < 1 ? 1 : threads;
+}
+
+static void linalg_team_thread(linalg_team *team, int thread) {
+#ifdef CORE_THREADS
+    // The settings are thread-local; use those of the thread that started us
+    core_settings = team->settings;
+#endif
+    team->run(team, team->arg, thread);
+    std::lock_guard<std::mutex> lock(team->mutex);
+    if (--team->running == 0)
+        team->cond.notify_all();
+}
+
+static void linalg_worker_main(linalg_worker *w) {
+    std::unique_lock<std::mutex> lock(linalg_pool_mutex);
+    while (true) {
+        w->cond.wait(lock, [w] { return w->team != NULL; });
+        linalg_team *team = w->team;
+        lock.unlock();
+        // The team may be freed as soon as this returns
+        linalg_team_thread(team, w->thread);
+        lock.lock();
+        w->team = NULL;
+        w->next = linalg_pool_idle;
+        linalg_pool_idle = w;
+    }
+}
+
+static bool linalg_worker_spawn(linalg_worker *w) {
+    w->team = NULL;
+#ifdef __cpp_exceptions
+    try {
+        std::thread(linalg_worker_main, w).detach();
+    } catch (const std::system_error &) {
+        return false;
+    }
+#else
+    // Without exceptions, std::thread terminates the process if it can't
+    // start the thread
+    std::thread(linalg_worker_main, w).detach();
+#endif
+    return true;
+}
+
+linalg_team *linalg_team_start(int *threads,
+                void (*run)(linalg_team *, void *, int), void *arg) {
+    linalg_team *team = new (std::nothrow) linalg_team;
+    if (team == NULL)
+        return NULL;
+    team->run = run;
+    team->arg = arg;
+    team->settings = core_settings;
+    team->waiting = 0;
+    team->generation = 0;
+    team->cancelled = false;
+
+    std::lock_guard<std::mutex> lock(linalg_pool_mutex);
+    linalg_worker *workers[LINALG_TEAM_MAX];
+    int n = 0;
+    while (n < *threads) {
+        linalg_worker *w = linalg_pool_idle;
+        if (w != NULL)
+            linalg_pool_idle = w->next;
+        else {
+            // If we can't have another thread, make do with the ones we've got
+            w = new (std::nothrow) linalg_worker;
+            if (w != NULL && !linalg_worker_spawn(w)) {
+                delete w;
+                w = NULL;
+            }
+            if (w == NULL)
+                break;
+        }
+        workers[n++] = w;
+    }
+    if (n == 0) {
+        delete team;
+        return NULL;
+    }
+    *threads = n;
+    team->threads = n;
+    team->running = n;
+    for (int i = 0; i < n; i++) {
+        workers[i]->team = team;
+        workers[i]->thread = i;
+        workers[i]->cond.notify_one();
+    }
+    return team;
+}
+
+bool linalg_team_wait(linalg_team *team) {
+    std::unique_lock<std::mutex> lock(team->mutex);
+    return team->cond.wait_for(lock,
+            std::chrono::milliseconds(core_settings.poll_latency_ms),
+            [team] { return team->running == 0; });
+}
+
+void linalg_team_cancel(linalg_team *team) {
+    std::lock_guard<std::mutex> lock(team->mutex);
+    team->cancelled = true;
+    team->cond.notify_all();
+}
+
+bool linalg_team_cancelled(linalg_team *team) {
+    return team->cancelled;
+}
+
+bool linalg_team_barrier(linalg_team *team) {
+    std::unique_lock<std::mutex> lock(team->mutex);
+    int4 generation = team->generation;
+    if (++team->waiting == team->threads) {
+        team->waiting = 0;
+        team->generation++;
+        team->cond.notify_all();
+    } else
+        team->cond.wait(lock, [team, generation] {
+            return team->generation != generation || team->cancelled;
+        });
+    return !team->cancelled;
+}
+
+void linalg_team_free(linalg_team *team) {
+    std::unique_lock<std::mutex> lock(team->mutex);
+    team->cond.wait(lock, [team] { return team->running == 0; });
+    lock.unlock();
+    delete team;
+}
+
+#endif
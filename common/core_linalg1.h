@@ -18,6 +18,7 @@
 #ifndef CORE_LINALG1_H
 #define CORE_LINALG1_H 1
 
+#include "core_main.h"
 #include "core_variables.h"
 
 int linalg_div(const vartype *left, const vartype *right,
@@ -27,4 +28,93 @@ int linalg_mul(const vartype *left, const vartype *right,
 int linalg_inv(const vartype *src, void (*completion)(int, vartype *));
 int linalg_det(const vartype *src, void (*completion)(int, vartype *));
 
+/* Sums of products, formed the way core_settings.accumulation says. Start
+ * with *comp at zero, add or subtract the terms one by one, and get the
+ * result from linalg_sum(). In the compensated mode, *comp collects the
+ * rounding errors, which are found exactly using FMA for the products and
+ * Knuth's TwoSum for the additions (the Dot2 algorithm of Ogita, Rump, and
+ * Oishi); in the other modes, it stays zero.
+ * The _mode versions use the given mode instead of the setting, for sums
+ * that need a particular one.
+ */
+inline void linalg_add_product_mode(int mode, phloat *sum, phloat *comp,
+                                    phloat x, phloat y) {
+    switch (mode) {
+        case ACCUMULATE_FMA:
+            *sum = fma(x, y, *sum);
+            break;
+        case ACCUMULATE_COMPENSATED: {
+            phloat p = x * y;
+            phloat pe = fma(x, y, -p);
+            phloat s = *sum + p;
+            phloat z = s - *sum;
+            phloat se = (*sum - (s - z)) + (p - z);
+            *sum = s;
+            *comp += pe + se;
+            break;
+        }
+        default:
+            *sum += x * y;
+            break;
+    }
+}
+
+inline void linalg_sub_product_mode(int mode, phloat *sum, phloat *comp,
+                                    phloat x, phloat y) {
+    if (mode == ACCUMULATE_PLAIN)
+        *sum -= x * y;
+    else
+        linalg_add_product_mode(mode, sum, comp, -x, y);
+}
+
+inline void linalg_add_product(phloat *sum, phloat *comp, phloat x, phloat y) {
+    linalg_add_product_mode(core_settings.accumulation, sum, comp, x, y);
+}
+
+inline void linalg_sub_product(phloat *sum, phloat *comp, phloat x, phloat y) {
+    linalg_sub_product_mode(core_settings.accumulation, sum, comp, x, y);
+}
+
+inline phloat linalg_sum(phloat sum, phloat comp) {
+    // Adding a zero could still change the sign or, in the Decimal version,
+    // the exponent of the sum, so don't
+    if (comp == 0 || p_isinf(sum) || p_isnan(sum))
+        return sum;
+    return sum + comp;
+}
+
+#ifdef LINALG_THREADS
+/* Teams of threads for large matrix operations, in builds with
+ * LINALG_THREADS defined. linalg_team_size() returns the number of threads
+ * to use for an operation that takes about 'ops' multiply-adds; 1 means the
+ * operation is too small to be worth splitting up, or that
+ * core_settings.matrix_threads says not to, or, in the Decimal version,
+ * that the BID library's exception flags aren't thread-local, so the threads
+ * would race on them. linalg_team_start() hands the operation to threads
+ * from a pool that is kept for the life of the process, starting more
+ * threads if needed; each calls run(team, arg, thread) with 'thread' going
+ * from 0 to *threads - 1, and with the same core_settings as the caller. If
+ * not all the threads can be started, the team is made smaller, and *threads
+ * is set to its size before any of them run; if none can, it returns NULL.
+ * The interruptible worker that started the team keeps calling
+ * linalg_team_wait(), which returns true once all threads have returned, and
+ * which waits for that for at most core_settings.poll_latency_ms, so the
+ * shell stays responsive. To interrupt the operation, it calls
+ * linalg_team_cancel(); the threads should check linalg_team_cancelled()
+ * regularly, and return when it is true. linalg_team_barrier() waits until
+ * all threads have called it; it returns false if the team has been
+ * cancelled. linalg_team_free() waits for the threads to return, and frees
+ * the team; the threads go back to the pool.
+ */
+struct linalg_team;
+int linalg_team_size(double ops);
+linalg_team *linalg_team_start(int *threads,
+                void (*run)(linalg_team *, void *, int), void *arg);
+bool linalg_team_wait(linalg_team *team);
+void linalg_team_cancel(linalg_team *team);
+bool linalg_team_cancelled(linalg_team *team);
+bool linalg_team_barrier(linalg_team *team);
+void linalg_team_free(linalg_team *team);
+#endif
+
 #endif
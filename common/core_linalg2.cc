@@ -15,8 +15,11 @@
  * along with this program; if not, see http://www.gnu.org/licenses/.
  *****************************************************************************/
 
+#include <float.h>
+#include <math.h>
 #include <stdlib.h>
 
+#include "core_linalg1.h"
 #include "core_linalg2.h"
 #include "core_globals.h"
 #include "core_main.h"
@@ -30,6 +33,15 @@
         state##s:            \
         ;
 
+/* Like STATE(s), after a step that took 'ops' operations */
+#define STATE_OPS(s, ops)         \
+        if ((count -= (ops)) <= 0) { \
+            dat->state = s;       \
+            goto suspend;         \
+        }                         \
+        state##s:                 \
+        ;
+
 
 /****************************/
 /***** LU decomposition *****/
@@ -39,29 +51,274 @@ struct lu_r_data_struct {
     vartype_realmatrix *a;
     int4 *perm;
     phloat det;
-    int4 i, imax, j, k;
-    phloat max, tmp, sum, *scale;
+    int4 i, j, l, j0, width;
+    phloat *scale, *comp, *orig, *panel;
     int state;
     int (*completion)(int, vartype_realmatrix *, int4 *, phloat);
 };
 
-lu_r_data_struct *lu_r_data;
+CORE_TLS lu_r_data_struct *lu_r_data;
 
 static int lu_decomp_r_worker(bool interrupted);
+#ifdef LINALG_THREADS
+static bool lu_decomp_r_team(vartype_realmatrix *a, int4 *perm,
+                int (*completion)(int, vartype_realmatrix *, int4 *, phloat));
+#endif
+
+#ifdef BCD_MATH
+/* The same algorithm as lu_decomp_r_worker(), on an n x n matrix of doubles,
+ * using 'scale' as scratch space for n doubles. Sets *neg if the rows were
+ * permuted an odd number of times. Returns false if a pivot is no larger,
+ * relative to the largest element of its row, than the rounding errors of
+ * the elimination could make it: n * DBL_EPSILON. Such a matrix is singular,
+ * or too nearly so for doubles to tell, so it is left to the Decimal
+ * decomposition, which substitutes zero pivots the usual way.
+ */
+static bool lu_decomp_doubles(double *a, double *scale, int4 n, int4 *perm,
+                              bool *neg) {
+    int4 i, j, k;
+    *neg = false;
+
+    for (i = 0; i < n; i++) {
+        double max = 0;
+        for (j = 0; j < n; j++) {
+            double tmp = fabs(a[i * n + j]);
+            if (tmp > max)
+                max = tmp;
+        }
+        scale[i] = max;
+    }
+
+    for (j = 0; j < n; j++) {
+        for (i = 0; i < j; i++) {
+            double sum = a[i * n + j];
+            for (k = 0; k < i; k++)
+                sum -= a[i * n + k] * a[k * n + j];
+            a[i * n + j] = sum;
+        }
+
+        double max = 0;
+        int4 imax = j;
+        for (i = j; i < n; i++) {
+            double sum = a[i * n + j];
+            for (k = 0; k < j; k++)
+                sum -= a[i * n + k] * a[k * n + j];
+            a[i * n + j] = sum;
+            if (scale[i] == 0) {
+                imax = i;
+                break;
+            }
+            double tmp = fabs(sum) / scale[i];
+            if (tmp > max) {
+                imax = i;
+                max = tmp;
+            }
+        }
+
+        double pivot_scale = scale[imax];
+        if (j != imax) {
+            for (k = 0; k < n; k++) {
+                double tmp = a[imax * n + k];
+                a[imax * n + k] = a[j * n + k];
+                a[j * n + k] = tmp;
+            }
+            *neg = !*neg;
+            scale[imax] = scale[j];
+        }
+
+        perm[j] = imax;
+        if (fabs(a[j * n + j]) <= n * DBL_EPSILON * pivot_scale)
+            return false;
+        if (j != n - 1) {
+            double tmp = 1 / a[j * n + j];
+            for (i = j + 1; i < n; i++)
+                a[i * n + j] *= tmp;
+        }
+    }
+    return true;
+}
+
+/* Binary engine: lu_decomp_doubles(), in one go. The determinant is
+ * accumulated in Decimal, since it overflows doubles easily. Returns false,
+ * leaving 'a' untouched, if the numbers don't fit in doubles, if the
+ * calculation overflows, if we run out of memory, or if the matrix is
+ * singular or nearly so; the caller then falls back on the Decimal
+ * decomposition.
+ */
+static bool lu_decomp_r_binary(vartype_realmatrix *m, int4 *perm,
+                               phloat *det) {
+    int4 n = m->rows;
+    double *a = (double *) malloc((n * n + n) * sizeof(double));
+    if (a == NULL)
+        return false;
+    bool neg;
+    int4 i, j;
+    if (!to_doubles(m->array->data, a, n * n)
+            || !lu_decomp_doubles(a, a + n * n, n, perm, &neg))
+        goto fail;
+
+    for (i = 0; i < n * n; i++)
+        if (!isfinite(a[i]))
+            goto fail;
+    from_doubles(a, m->array->data, n * n);
+    *det = neg ? -1 : 1;
+    for (j = 0; j < n; j++)
+        *det *= m->array->data[j * n + j];
+    free(a);
+    return true;
+
+    fail:
+    free(a);
+    return false;
+}
+#endif
+
+static void lu_r_free(lu_r_data_struct *dat) {
+    free(dat->scale);
+    free(dat->comp);
+    free(dat->orig);
+    free(dat->panel);
+    free(dat);
+}
+
+/* Step j of the LU decomposition: finish column j, pick the pivot, using
+ * implicit row scaling, swap it into place, and divide the rest of the
+ * column by it. Elements of row j up to column j1 - 1 are finished as well.
+ * 'c', if not NULL, holds the rounding errors of the compensated
+ * accumulation mode, which are added to the elements when they are
+ * finished. Returns false for a singular matrix that should be reported as
+ * an error.
+ * Crout's method, which this is meant to match exactly, stops working on a
+ * column when it reaches a row of zeros, and picks that row as the pivot;
+ * the elements below it are left as they were. To get the same result, we
+ * keep a copy of the original matrix, 'orig', when there are rows of zeros,
+ * and put those elements back.
+ */
+static bool lu_r_pivot(phloat *a, phloat *c, phloat *orig, phloat *scale,
+                       int4 n, int4 j, int4 j1, int4 *perm, phloat *det,
+                       bool singular_error) {
+    int4 i, k, imax;
+    phloat max, tmp;
+
+    if (c != NULL)
+        for (i = j; i < n; i++) {
+            a[i * n + j] = linalg_sum(a[i * n + j], c[i * n + j]);
+            c[i * n + j] = 0;
+        }
+
+    for (imax = j; imax < n; imax++)
+        if (scale[imax] == 0)
+            break;
+    if (imax < n) {
+        for (i = imax + 1; i < n; i++)
+            a[i * n + j] = orig[i * n + j];
+    } else {
+        max = 0;
+        imax = j;
+        for (i = j; i < n; i++) {
+            tmp = a[i * n + j];
+            tmp = (tmp < 0 ? -tmp : tmp) / scale[i];
+            if (tmp > max) {
+                imax = i;
+                max = tmp;
+            }
+        }
+    }
+
+    if (j != imax) {
+        for (k = 0; k < n; k++) {
+            tmp = a[imax * n + k];
+            a[imax * n + k] = a[j * n + k];
+            a[j * n + k] = tmp;
+        }
+        if (c != NULL)
+            for (k = j + 1; k < n; k++) {
+                tmp = c[imax * n + k];
+                c[imax * n + k] = c[j * n + k];
+                c[j * n + k] = tmp;
+            }
+        if (orig != NULL)
+            for (k = j + 1; k < n; k++) {
+                tmp = orig[imax * n + k];
+                orig[imax * n + k] = orig[j * n + k];
+                orig[j * n + k] = tmp;
+            }
+        *det = -*det;
+        scale[imax] = scale[j];
+    }
+
+    perm[j] = imax;
+    if (a[j * n + j] == 0) {
+        if (singular_error)
+            return false;
+        /* For a zero pivot, substitute a small positive number.
+         * I use a number that's about 10^-20 times the size of
+         * the maximum of the original column, with a minimum of
+         * 10^20 / POS_HUGE_PHLOAT.
+         */
+        phloat tiniest = 1e20 / POS_HUGE_PHLOAT;
+        phloat tiny;
+        if (scale[j] == 0)
+            tiny = tiniest;
+        else {
+            tiny = p_pow10(to_int(floor(log10(scale[j]))) - 20);
+            if (tiny < tiniest)
+                tiny = tiniest;
+        }
+        a[j * n + j] = tiny;
+    }
+    *det *= a[j * n + j];
+    if (j != n - 1) {
+        tmp = 1 / a[j * n + j];
+        for (i = j + 1; i < n; i++)
+            a[i * n + j] *= tmp;
+        if (c != NULL)
+            for (k = j + 1; k < j1; k++) {
+                a[j * n + k] = linalg_sum(a[j * n + k], c[j * n + k]);
+                c[j * n + k] = 0;
+            }
+    }
+    return true;
+}
 
 int lu_decomp_r(vartype_realmatrix *a, int4 *perm,
                 int (*completion)(int, vartype_realmatrix *, int4 *, phloat)) {
+#ifdef BCD_MATH
+    phloat det;
+    if (core_settings.binary_engine && lu_decomp_r_binary(a, perm, &det))
+        return completion(ERR_NONE, a, perm, det);
+#endif
+#ifdef LINALG_THREADS
+    if (lu_decomp_r_team(a, perm, completion))
+        return ERR_INTERRUPTIBLE;
+#endif
+
     lu_r_data_struct *dat =
                 (lu_r_data_struct *) malloc(sizeof(lu_r_data_struct));
 
     if (dat == NULL)
         return completion(ERR_INSUFFICIENT_MEMORY, a, perm, 0);
 
-    dat->scale = (phloat *) malloc(a->rows * sizeof(phloat));
-    if (dat->scale == NULL) {
-        free(dat);
+    int4 n = a->rows;
+    int4 width = core_settings.matrix_block_size;
+    if (width <= 0 || width > n)
+        width = n;
+    dat->width = width;
+    dat->scale = (phloat *) malloc(n * sizeof(phloat));
+    dat->panel = width == n ? NULL
+                    : (phloat *) malloc(width * (n - width) * sizeof(phloat));
+    dat->comp = core_settings.accumulation != ACCUMULATE_COMPENSATED ? NULL
+                    : (phloat *) malloc(n * n * sizeof(phloat));
+    dat->orig = NULL;
+    if (dat->scale == NULL || (dat->panel == NULL && width != n)
+            || (dat->comp == NULL
+                && core_settings.accumulation == ACCUMULATE_COMPENSATED)) {
+        lu_r_free(dat);
         return completion(ERR_INSUFFICIENT_MEMORY, a, perm, 0);
     }
+    if (dat->comp != NULL)
+        for (int4 i = 0; i < n * n; i++)
+            dat->comp[i] = 0;
 
     dat->a = a;
     dat->perm = perm;
@@ -75,6 +332,16 @@ int lu_decomp_r(vartype_realmatrix *a, int4 *perm,
     return ERR_INTERRUPTIBLE;
 }
 
+/* The LU decomposition works on panels of core_settings.matrix_block_size
+ * columns: first the panel is decomposed, applying the contributions of its
+ * pivot rows to the rest of the panel right away; then the rows of U to the
+ * right of the panel are finished; and finally, the contributions of all the
+ * panel's pivot rows are subtracted from the rest of the matrix in one pass,
+ * using a copy of those rows of U, arranged by columns, so the inner loop
+ * runs through memory sequentially. Every element gets the same terms
+ * subtracted from it in the same order as in Crout's method, which this
+ * replaces, so the results are the same, too.
+ */
 static int lu_decomp_r_worker(bool interrupted) {
 
     lu_r_data_struct *dat = lu_r_data;
@@ -82,22 +349,24 @@ static int lu_decomp_r_worker(bool interrupted) {
     phloat *a = dat->a->array->data;
     int4 n = dat->a->rows;
     phloat *scale = dat->scale;
+    phloat *c = dat->comp;
+    phloat *u = dat->panel;
     int4 *perm = dat->perm;
     int count = 1000;
     int err;
 
     int4 i = dat->i;
-    int4 imax = dat->imax;
     int4 j = dat->j;
-    int4 k = dat->k;
-    phloat max = dat->max;
-    phloat tmp = dat->tmp;
-    phloat sum = dat->sum;
+    int4 l = dat->l;
+    int4 j0 = dat->j0;
+    int4 j1 = j0 + dat->width < n ? j0 + dat->width : n;
+    int4 k, w;
+    phloat max, tmp, sum, comp, unused;
+    const phloat *li, *ul;
 
     if (interrupted) {
-        free(scale);
         err = dat->completion(ERR_INTERRUPTED, dat->a, perm, 0);
-        free(dat);
+        lu_r_free(dat);
         return err;
     }
 
@@ -108,115 +377,287 @@ static int lu_decomp_r_worker(bool interrupted) {
         case 3: goto state3;
         case 4: goto state4;
         case 5: goto state5;
+        case 6: goto state6;
     }
 
     dat->det = 1;
 
     for (i = 0; i < n; i++) {
         max = 0;
-        for (j = 0; j < n; j++) {
-            tmp = a[i * n + j];
+        for (k = 0; k < n; k++) {
+            tmp = a[i * n + k];
             if (tmp < 0)
                 tmp = -tmp;
             if (tmp > max)
                 max = tmp;
-            STATE(1);
         }
         scale[i] = max;
-    }
-
-    for (j = 0; j < n; j++) {
-        for (i = 0; i < j; i++) {
-            sum = a[i * n + j];
-            for (k = 0; k < i; k++) {
-                sum -= a[i * n + k] * a[k * n + j];
-                STATE(2);
+        if (max == 0 && dat->orig == NULL) {
+            // A row of zeros; see lu_r_pivot()
+            dat->orig = (phloat *) malloc(n * n * sizeof(phloat));
+            if (dat->orig == NULL) {
+                err = dat->completion(ERR_INSUFFICIENT_MEMORY, dat->a, perm, 0);
+                lu_r_free(dat);
+                return err;
             }
-            a[i * n + j] = sum;
+            for (k = 0; k < n * n; k++)
+                dat->orig[k] = a[k];
         }
+        STATE_OPS(1, n);
+    }
 
-        max = 0;
-        imax = j;
-        for (i = j; i < n; i++) {
-            sum = a[i * n + j];
-            for (k = 0; k < j; k++) {
-                sum -= a[i * n + k] * a[k * n + j];
-                STATE(3);
-            }
-            a[i * n  + j] = sum;
-            if (scale[i] == 0) {
-                imax = i;
-                break;
+    for (j0 = 0; j0 < n; j0 = j1) {
+        j1 = j0 + dat->width < n ? j0 + dat->width : n;
+
+        // Decompose the panel
+        for (j = j0; j < j1; j++) {
+            if (!lu_r_pivot(a, c, dat->orig, scale, n, j, j1, perm, &dat->det,
+                            core_settings.matrix_singularmatrix)) {
+                err = dat->completion(ERR_SINGULAR_MATRIX, dat->a, perm, 0);
+                lu_r_free(dat);
+                return err;
             }
-            tmp = (sum < 0 ? -sum : sum) / scale[i];
-            if (tmp > max) {
-                imax = i;
-                max = tmp;
+            STATE_OPS(2, n - j);
+            for (i = j + 1; i < n; i++) {
+                tmp = a[i * n + j];
+                for (k = j + 1; k < j1; k++)
+                    linalg_sub_product(a + i * n + k,
+                                       c == NULL ? &unused : c + i * n + k,
+                                       tmp, a[j * n + k]);
+                STATE_OPS(3, j1 - j);
             }
         }
-
-        if (j != imax) {
-            for (k = 0; k < n; k++) {
-                tmp = a[imax * n + k];
-                a[imax * n + k] = a[j * n + k];
-                a[j * n + k] = tmp;
-                STATE(4);
+        if (j1 == n)
+            break;
+
+        // Finish the rows of U to the right of the panel
+        for (i = j0; i < j1; i++) {
+            for (l = j1; l < n; l++) {
+                sum = a[i * n + l];
+                comp = c == NULL ? 0 : c[i * n + l];
+                for (k = j0; k < i; k++)
+                    linalg_sub_product(&sum, &comp, a[i * n + k], a[k * n + l]);
+                a[i * n + l] = linalg_sum(sum, comp);
+                if (c != NULL)
+                    c[i * n + l] = 0;
+                STATE_OPS(4, i - j0 + 1);
             }
-            dat->det = -dat->det;
-            scale[imax] = scale[j];
         }
 
-        perm[j] = imax;
-        if (a[j * n + j] == 0) {
-            if (core_settings.matrix_singularmatrix) {
-                free(scale);
-                err = dat->completion(ERR_SINGULAR_MATRIX, dat->a, perm, 0);
-                free(dat);
-                return err;
-            } else {
-                /* For a zero pivot, substitute a small positive number.
-                 * I use a number that's about 10^-20 times the size of
-                 * the maximum of the original column, with a minimum of
-                 * 10^20 / POS_HUGE_PHLOAT.
-                 */
-                phloat tiniest = 1e20 / POS_HUGE_PHLOAT;
-                phloat tiny;
-                if (scale[j] == 0)
-                    tiny = tiniest;
-                else {
-                    tiny = pow(10, floor(log10(scale[j])) - 20);
-                    if (tiny < tiniest)
-                        tiny = tiniest;
-                }
-                a[j * n + j] = tiny;
-            }
-        }
-        dat->det *= a[j * n + j];
-        if (j != n - 1) {
-            tmp = 1 / a[j * n + j];
-            for (i = j + 1; i < n; i++) {
-                a[i * n + j] *= tmp;
-                STATE(5);
+        // Update the rest of the matrix
+        w = j1 - j0;
+        for (l = j1; l < n; l++)
+            for (k = j0; k < j1; k++)
+                u[(l - j1) * w + k - j0] = a[k * n + l];
+        STATE_OPS(5, n - j1);
+        for (i = j1; i < n; i++) {
+            for (l = j1; l < n; l++) {
+                w = j1 - j0;
+                li = a + i * n + j0;
+                ul = u + (l - j1) * w;
+                sum = a[i * n + l];
+                comp = c == NULL ? 0 : c[i * n + l];
+                for (k = 0; k < w; k++)
+                    linalg_sub_product(&sum, &comp, li[k], ul[k]);
+                a[i * n + l] = sum;
+                if (c != NULL)
+                    c[i * n + l] = comp;
+                STATE_OPS(6, w);
             }
         }
     }
 
-    free(scale);
     err = dat->completion(ERR_NONE, dat->a, perm, dat->det);
-    free(dat);
+    lu_r_free(dat);
     return err;
 
     suspend:
     dat->i = i;
-    dat->imax = imax;
     dat->j = j;
-    dat->k = k;
-    dat->max = max;
-    dat->tmp = tmp;
-    dat->sum = sum;
+    dat->l = l;
+    dat->j0 = j0;
     return ERR_INTERRUPTIBLE;
 }
 
+#ifdef LINALG_THREADS
+/* LU decomposition of large matrices by a team of threads. Rather than
+ * finishing one column at a time, like the worker above, this subtracts the
+ * contributions of each pivot row from the whole trailing submatrix at once,
+ * with its rows divided among the threads, while thread 0 picks the pivots.
+ * Every element still gets the same terms subtracted from it in the same
+ * order, so the results are identical, except when the matrix has a row of
+ * zeros: the worker above stops working on a column when it finds one, and
+ * we leave those matrices to it. In the compensated accumulation mode, the
+ * rounding errors are kept in a separate matrix until each element is done.
+ */
+struct lu_r_team_struct {
+    vartype_realmatrix *a;
+    int4 *perm;
+    phloat det;
+    phloat *scale, *comp;
+    bool singular_error, singular;
+    int threads;
+    int (*completion)(int, vartype_realmatrix *, int4 *, phloat);
+    linalg_team *team;
+};
+
+static CORE_TLS lu_r_team_struct *lu_r_team_data;
+
+static int lu_decomp_r_team_worker(bool interrupted);
+
+static bool lu_r_zero_row(const phloat *row, int4 n) {
+    for (int4 j = 0; j < n; j++) {
+        phloat tmp = row[j];
+        if (tmp < 0)
+            tmp = -tmp;
+        if (tmp > 0)
+            return false;
+    }
+    return true;
+}
+
+static void lu_r_team_run(linalg_team *team, void *arg, int thread) {
+    lu_r_team_struct *dat = (lu_r_team_struct *) arg;
+    phloat *a = dat->a->array->data;
+    phloat *c = dat->comp;
+    int4 n = dat->a->rows;
+    phloat unused;
+
+    if (thread == 0) {
+        for (int4 i = 0; i < n; i++) {
+            phloat max = 0;
+            for (int4 j = 0; j < n; j++) {
+                phloat tmp = a[i * n + j];
+                if (tmp < 0)
+                    tmp = -tmp;
+                if (tmp > max)
+                    max = tmp;
+            }
+            dat->scale[i] = max;
+        }
+        dat->det = 1;
+    }
+
+    for (int4 j = 0; j < n; j++) {
+        if (thread == 0 && !lu_r_pivot(a, c, NULL, dat->scale, n, j, n,
+                                       dat->perm, &dat->det,
+                                       dat->singular_error))
+            dat->singular = true;
+        if (!linalg_team_barrier(team) || dat->singular)
+            return;
+        const phloat *aj = a + j * n;
+        for (int4 i = j + 1 + thread; i < n; i += dat->threads) {
+            phloat *ai = a + i * n;
+            phloat x = ai[j];
+            if (c == NULL)
+                for (int4 k = j + 1; k < n; k++)
+                    linalg_sub_product(ai + k, &unused, x, aj[k]);
+            else {
+                phloat *ci = c + i * n;
+                for (int4 k = j + 1; k < n; k++)
+                    linalg_sub_product(ai + k, ci + k, x, aj[k]);
+            }
+        }
+        if (!linalg_team_barrier(team))
+            return;
+    }
+}
+
+static bool lu_decomp_r_team(vartype_realmatrix *a, int4 *perm,
+                int (*completion)(int, vartype_realmatrix *, int4 *, phloat)) {
+    int4 n = a->rows;
+    int threads = linalg_team_size((double) n * n * n / 3);
+    if (threads == 1)
+        return false;
+    for (int4 i = 0; i < n; i++)
+        if (lu_r_zero_row(a->array->data + i * n, n))
+            return false;
+
+    lu_r_team_struct *dat = (lu_r_team_struct *) malloc(sizeof(lu_r_team_struct));
+    if (dat == NULL)
+        return false;
+    dat->scale = (phloat *) malloc(n * sizeof(phloat));
+    if (dat->scale == NULL) {
+        free(dat);
+        return false;
+    }
+    if (core_settings.accumulation == ACCUMULATE_COMPENSATED) {
+        dat->comp = (phloat *) malloc(n * n * sizeof(phloat));
+        if (dat->comp == NULL) {
+            free(dat->scale);
+            free(dat);
+            return false;
+        }
+        for (int4 i = 0; i < n * n; i++)
+            dat->comp[i] = 0;
+    } else
+        dat->comp = NULL;
+
+    dat->a = a;
+    dat->perm = perm;
+    dat->singular_error = core_settings.matrix_singularmatrix;
+    dat->singular = false;
+    dat->threads = threads;
+    dat->completion = completion;
+    dat->team = linalg_team_start(&dat->threads, lu_r_team_run, dat);
+    if (dat->team == NULL) {
+        free(dat->comp);
+        free(dat->scale);
+        free(dat);
+        return false;
+    }
+
+    lu_r_team_data = dat;
+    mode_interruptible = lu_decomp_r_team_worker;
+    mode_stoppable = false;
+    return true;
+}
+
+static int lu_decomp_r_team_worker(bool interrupted) {
+    lu_r_team_struct *dat = lu_r_team_data;
+    int err;
+
+    if (interrupted)
+        linalg_team_cancel(dat->team);
+    else if (!linalg_team_wait(dat->team))
+        return ERR_INTERRUPTIBLE;
+    linalg_team_free(dat->team);
+    free(dat->comp);
+    free(dat->scale);
+
+    if (interrupted)
+        err = dat->completion(ERR_INTERRUPTED, dat->a, dat->perm, 0);
+    else if (dat->singular)
+        err = dat->completion(ERR_SINGULAR_MATRIX, dat->a, dat->perm, 0);
+    else
+        err = dat->completion(ERR_NONE, dat->a, dat->perm, dat->det);
+    free(dat);
+    return err;
+}
+#endif
+
+
+/* The complex LU decomposition and back-substitution work on copies of the
+ * matrix with the real and imaginary parts in separate planes, so that the
+ * inner loops run over plain arrays of reals, and on a copy of the column
+ * being worked on, so that they don't stride through the matrix either. The
+ * arithmetic is the same, and so are the results; the matrices themselves
+ * keep their usual layout.
+ */
+static void planes_split(const phloat *a, phloat *re, phloat *im, int4 nn) {
+    for (int4 i = 0; i < nn; i++) {
+        re[i] = a[2 * i];
+        im[i] = a[2 * i + 1];
+    }
+}
+
+static void planes_join(phloat *a, const phloat *re, const phloat *im,
+                        int4 nn) {
+    for (int4 i = 0; i < nn; i++) {
+        a[2 * i] = re[i];
+        a[2 * i + 1] = im[i];
+    }
+}
 
 struct lu_c_data_struct {
     vartype_complexmatrix *a;
@@ -224,17 +665,28 @@ struct lu_c_data_struct {
     phloat det_re, det_im;
     int4 i, imax, j, k;
     phloat max, tmp, tmp_re, tmp_im, sum_re, sum_im, s_re, s_im, *scale;
+    phloat *re, *im, *col_re, *col_im;
     int state;
     int (*completion)(int, vartype_complexmatrix *, int4 *, phloat, phloat);
 };
 
-lu_c_data_struct *lu_c_data;
+CORE_TLS lu_c_data_struct *lu_c_data;
 
 static int lu_decomp_c_worker(bool interrupted);
+#ifdef LINALG_THREADS
+static bool lu_decomp_c_team(vartype_complexmatrix *a, int4 *perm,
+                int (*completion)(int, vartype_complexmatrix *,
+                                          int4 *, phloat, phloat));
+#endif
 
 int lu_decomp_c(vartype_complexmatrix *a, int4 *perm,
                 int (*completion)(int, vartype_complexmatrix *,
                                           int4 *, phloat, phloat)) {
+#ifdef LINALG_THREADS
+    if (lu_decomp_c_team(a, perm, completion))
+        return ERR_INTERRUPTIBLE;
+#endif
+
     lu_c_data_struct *dat =
                 (lu_c_data_struct *) malloc(sizeof(lu_c_data_struct));
 
@@ -247,6 +699,18 @@ int lu_decomp_c(vartype_complexmatrix *a, int4 *perm,
         return completion(ERR_INSUFFICIENT_MEMORY, a, perm, 0, 0);
     }
 
+    int4 n = a->rows;
+    dat->re = (phloat *) malloc(2 * (n * n + n) * sizeof(phloat));
+    if (dat->re == NULL) {
+        free(dat->scale);
+        free(dat);
+        return completion(ERR_INSUFFICIENT_MEMORY, a, perm, 0, 0);
+    }
+    dat->im = dat->re + n * n;
+    dat->col_re = dat->im + n * n;
+    dat->col_im = dat->col_re + n;
+    planes_split(a->array->data, dat->re, dat->im, n * n);
+
     dat->a = a;
     dat->perm = perm;
     dat->completion = completion;
@@ -263,7 +727,10 @@ static int lu_decomp_c_worker(bool interrupted) {
 
     lu_c_data_struct *dat = lu_c_data;
 
-    phloat *a = dat->a->array->data;
+    phloat *re = dat->re;
+    phloat *im = dat->im;
+    phloat *col_re = dat->col_re;
+    phloat *col_im = dat->col_im;
     int4 n = dat->a->rows;
     phloat *scale = dat->scale;
     int4 *perm = dat->perm;
@@ -289,6 +756,7 @@ static int lu_decomp_c_worker(bool interrupted) {
 
     if (interrupted) {
         free(scale);
+        free(re);
         err = dat->completion(ERR_INTERRUPTED, dat->a, perm, 0, 0);
         free(dat);
         return err;
@@ -309,7 +777,7 @@ static int lu_decomp_c_worker(bool interrupted) {
     for (i = 0; i < n; i++) {
         max = 0;
         for (j = 0; j < n; j++) {
-            tmp = hypot(a[2 * (i * n + j)], a[2 * (i * n + j) + 1]);
+            tmp = hypot(re[i * n + j], im[i * n + j]);
             if (tmp > max)
                 max = tmp;
             STATE(1);
@@ -318,38 +786,42 @@ static int lu_decomp_c_worker(bool interrupted) {
     }
 
     for (j = 0; j < n; j++) {
+        for (i = 0; i < n; i++) {
+            col_re[i] = re[i * n + j];
+            col_im[i] = im[i * n + j];
+        }
         for (i = 0; i < j; i++) {
-            sum_re = a[2 * (i * n + j)];
-            sum_im = a[2 * (i * n + j) + 1];
+            sum_re = col_re[i];
+            sum_im = col_im[i];
             for (k = 0; k < i; k++) {
-                xre = a[2 * (i * n + k)];
-                xim = a[2 * (i * n + k) + 1];
-                yre = a[2 * (k * n + j)];
-                yim = a[2 * (k * n + j) + 1];
+                xre = re[i * n + k];
+                xim = im[i * n + k];
+                yre = col_re[k];
+                yim = col_im[k];
                 sum_re -= xre * yre - xim * yim;
                 sum_im -= xim * yre + xre * yim;
                 STATE(2);
             }
-            a[2 * (i * n + j)] = sum_re;
-            a[2 * (i * n + j) + 1] = sum_im;
+            col_re[i] = sum_re;
+            col_im[i] = sum_im;
         }
 
         max = 0;
         imax = j;
         for (i = j; i < n; i++) {
-            sum_re = a[2 * (i * n + j)];
-            sum_im = a[2 * (i * n + j) + 1];
+            sum_re = col_re[i];
+            sum_im = col_im[i];
             for (k = 0; k < j; k++) {
-                xre = a[2 * (i * n + k)];
-                xim = a[2 * (i * n + k) + 1];
-                yre = a[2 * (k * n + j)];
-                yim = a[2 * (k * n + j) + 1];
+                xre = re[i * n + k];
+                xim = im[i * n + k];
+                yre = col_re[k];
+                yim = col_im[k];
                 sum_re -= xre * yre - xim * yim;
                 sum_im -= xim * yre + xre * yim;
                 STATE(3);
             }
-            a[2 * (i * n + j)] = sum_re;
-            a[2 * (i * n + j) + 1] = sum_im;
+            col_re[i] = sum_re;
+            col_im[i] = sum_im;
             if (scale[i] == 0) {
                 imax = i;
                 break;
@@ -361,14 +833,19 @@ static int lu_decomp_c_worker(bool interrupted) {
             }
         }
 
+        for (i = 0; i < n; i++) {
+            re[i * n + j] = col_re[i];
+            im[i * n + j] = col_im[i];
+        }
+
         if (j != imax) {
             for (k = 0; k < n; k++) {
-                tmp = a[2 * (imax * n + k)];
-                a[2 * (imax * n + k)] = a[2 * (j * n + k)];
-                a[2 * (j * n + k)] = tmp;
-                tmp = a[2 * (imax * n + k) + 1];
-                a[2 * (imax * n + k) + 1] = a[2 * (j * n + k) + 1];
-                a[2 * (j * n + k) + 1] = tmp;
+                tmp = re[imax * n + k];
+                re[imax * n + k] = re[j * n + k];
+                re[j * n + k] = tmp;
+                tmp = im[imax * n + k];
+                im[imax * n + k] = im[j * n + k];
+                im[j * n + k] = tmp;
                 STATE(4);
             }
             dat->det_re = -dat->det_re;
@@ -377,11 +854,13 @@ static int lu_decomp_c_worker(bool interrupted) {
         }
 
         perm[j] = imax;
-        tmp_re = a[2 * (j * n + j)];
-        tmp_im = a[2 * (j * n + j) + 1];
+        tmp_re = re[j * n + j];
+        tmp_im = im[j * n + j];
         if (tmp_re == 0 && tmp_im == 0) {
             if (core_settings.matrix_singularmatrix) {
+                planes_join(dat->a->array->data, re, im, n * n);
                 free(scale);
+                free(re);
                 err = dat->completion(ERR_NONE, dat->a, perm, 0, 0);
                 free(dat);
                 return err;
@@ -394,12 +873,12 @@ static int lu_decomp_c_worker(bool interrupted) {
                 if (scale[j] == 0)
                     tiny = tiniest;
                 else {
-                    tiny = pow(10, floor(log10(scale[j])) - 20);
+                    tiny = p_pow10(to_int(floor(log10(scale[j]))) - 20);
                     if (tiny < tiniest)
                         tiny = tiniest;
                 }
-                a[2 * (j * n + j)] = tmp_re = tiny;
-                a[2 * (j * n + j) + 1] = tmp_im = 0;
+                re[j * n + j] = tmp_re = tiny;
+                im[j * n + j] = tmp_im = 0;
             }
         }
         tmp = dat->det_re * tmp_re - dat->det_im * tmp_im;
@@ -410,16 +889,18 @@ static int lu_decomp_c_worker(bool interrupted) {
             s_re = tmp_re / tmp / tmp;
             s_im = -tmp_im / tmp / tmp;
             for (i = j + 1; i < n; i++) {
-                tmp_re = a[2 * (i * n + j)];
-                tmp_im = a[2 * (i * n + j) + 1];
-                a[2 * (i * n + j)] = tmp_re * s_re - tmp_im * s_im;
-                a[2 * (i * n + j) + 1] = tmp_im * s_re + tmp_re * s_im;
+                tmp_re = re[i * n + j];
+                tmp_im = im[i * n + j];
+                re[i * n + j] = tmp_re * s_re - tmp_im * s_im;
+                im[i * n + j] = tmp_im * s_re + tmp_re * s_im;
                 STATE(5);
             }
         }
     }
 
+    planes_join(dat->a->array->data, re, im, n * n);
     free(scale);
+    free(re);
     err = dat->completion(ERR_NONE, dat->a, perm, dat->det_re, dat->det_im);
     free(dat);
     return err;
@@ -440,6 +921,199 @@ static int lu_decomp_c_worker(bool interrupted) {
     return ERR_INTERRUPTIBLE;
 }
 
+#ifdef LINALG_THREADS
+/* The complex version of lu_decomp_r_team() and friends. */
+struct lu_c_team_struct {
+    vartype_complexmatrix *a;
+    int4 *perm;
+    phloat det_re, det_im;
+    phloat *scale;
+    bool singular_error, singular;
+    int threads;
+    int (*completion)(int, vartype_complexmatrix *, int4 *, phloat, phloat);
+    linalg_team *team;
+};
+
+static CORE_TLS lu_c_team_struct *lu_c_team_data;
+
+static int lu_decomp_c_team_worker(bool interrupted);
+
+static bool lu_c_team_pivot(lu_c_team_struct *dat, int4 j) {
+    phloat *a = dat->a->array->data;
+    phloat *scale = dat->scale;
+    int4 n = dat->a->rows;
+    int4 i, k, imax;
+    phloat max, tmp, tmp_re, tmp_im, s_re, s_im;
+
+    max = 0;
+    imax = j;
+    for (i = j; i < n; i++) {
+        tmp = hypot(a[2 * (i * n + j)], a[2 * (i * n + j) + 1]) / scale[i];
+        if (tmp > max) {
+            imax = i;
+            max = tmp;
+        }
+    }
+
+    if (j != imax) {
+        for (k = 0; k < 2 * n; k++) {
+            tmp = a[2 * imax * n + k];
+            a[2 * imax * n + k] = a[2 * j * n + k];
+            a[2 * j * n + k] = tmp;
+        }
+        dat->det_re = -dat->det_re;
+        dat->det_im = -dat->det_im;
+        scale[imax] = scale[j];
+    }
+
+    dat->perm[j] = imax;
+    tmp_re = a[2 * (j * n + j)];
+    tmp_im = a[2 * (j * n + j) + 1];
+    if (tmp_re == 0 && tmp_im == 0) {
+        if (dat->singular_error)
+            return false;
+        // Same substitution as in lu_decomp_c_worker()
+        phloat tiniest = 1e20 / POS_HUGE_PHLOAT;
+        phloat tiny;
+        if (scale[j] == 0)
+            tiny = tiniest;
+        else {
+            tiny = p_pow10(to_int(floor(log10(scale[j]))) - 20);
+            if (tiny < tiniest)
+                tiny = tiniest;
+        }
+        a[2 * (j * n + j)] = tmp_re = tiny;
+        a[2 * (j * n + j) + 1] = tmp_im = 0;
+    }
+    tmp = dat->det_re * tmp_re - dat->det_im * tmp_im;
+    dat->det_im = dat->det_im * tmp_re + dat->det_re * tmp_im;
+    dat->det_re = tmp;
+    if (j != n - 1) {
+        tmp = hypot(tmp_re, tmp_im);
+        s_re = tmp_re / tmp / tmp;
+        s_im = -tmp_im / tmp / tmp;
+        for (i = j + 1; i < n; i++) {
+            tmp_re = a[2 * (i * n + j)];
+            tmp_im = a[2 * (i * n + j) + 1];
+            a[2 * (i * n + j)] = tmp_re * s_re - tmp_im * s_im;
+            a[2 * (i * n + j) + 1] = tmp_im * s_re + tmp_re * s_im;
+        }
+    }
+    return true;
+}
+
+static void lu_c_team_run(linalg_team *team, void *arg, int thread) {
+    lu_c_team_struct *dat = (lu_c_team_struct *) arg;
+    phloat *a = dat->a->array->data;
+    int4 n = dat->a->rows;
+
+    if (thread == 0) {
+        for (int4 i = 0; i < n; i++) {
+            phloat max = 0;
+            for (int4 j = 0; j < n; j++) {
+                phloat tmp = hypot(a[2 * (i * n + j)], a[2 * (i * n + j) + 1]);
+                if (tmp > max)
+                    max = tmp;
+            }
+            dat->scale[i] = max;
+        }
+        dat->det_re = 1;
+        dat->det_im = 0;
+    }
+
+    for (int4 j = 0; j < n; j++) {
+        if (thread == 0 && !lu_c_team_pivot(dat, j))
+            dat->singular = true;
+        if (!linalg_team_barrier(team) || dat->singular)
+            return;
+        const phloat *aj = a + 2 * j * n;
+        for (int4 i = j + 1 + thread; i < n; i += dat->threads) {
+            phloat *ai = a + 2 * i * n;
+            phloat xre = ai[2 * j];
+            phloat xim = ai[2 * j + 1];
+            for (int4 k = j + 1; k < n; k++) {
+                phloat yre = aj[2 * k];
+                phloat yim = aj[2 * k + 1];
+                ai[2 * k] -= xre * yre - xim * yim;
+                ai[2 * k + 1] -= xim * yre + xre * yim;
+            }
+        }
+        if (!linalg_team_barrier(team))
+            return;
+    }
+}
+
+static bool lu_decomp_c_team(vartype_complexmatrix *a, int4 *perm,
+                int (*completion)(int, vartype_complexmatrix *,
+                                          int4 *, phloat, phloat)) {
+    int4 n = a->rows;
+    // A complex multiply-add is four real ones
+    int threads = linalg_team_size((double) n * n * n * 4 / 3);
+    if (threads == 1)
+        return false;
+    phloat *data = a->array->data;
+    for (int4 i = 0; i < n; i++) {
+        int4 j;
+        for (j = 0; j < n; j++)
+            if (hypot(data[2 * (i * n + j)], data[2 * (i * n + j) + 1]) > 0)
+                break;
+        if (j == n)
+            return false;
+    }
+
+    lu_c_team_struct *dat = (lu_c_team_struct *) malloc(sizeof(lu_c_team_struct));
+    if (dat == NULL)
+        return false;
+    dat->scale = (phloat *) malloc(n * sizeof(phloat));
+    if (dat->scale == NULL) {
+        free(dat);
+        return false;
+    }
+
+    dat->a = a;
+    dat->perm = perm;
+    dat->singular_error = core_settings.matrix_singularmatrix;
+    dat->singular = false;
+    dat->threads = threads;
+    dat->completion = completion;
+    dat->team = linalg_team_start(&dat->threads, lu_c_team_run, dat);
+    if (dat->team == NULL) {
+        free(dat->scale);
+        free(dat);
+        return false;
+    }
+
+    lu_c_team_data = dat;
+    mode_interruptible = lu_decomp_c_team_worker;
+    mode_stoppable = false;
+    return true;
+}
+
+static int lu_decomp_c_team_worker(bool interrupted) {
+    lu_c_team_struct *dat = lu_c_team_data;
+    int err;
+
+    if (interrupted)
+        linalg_team_cancel(dat->team);
+    else if (!linalg_team_wait(dat->team))
+        return ERR_INTERRUPTIBLE;
+    linalg_team_free(dat->team);
+    free(dat->scale);
+
+    if (interrupted)
+        err = dat->completion(ERR_INTERRUPTED, dat->a, dat->perm, 0, 0);
+    else if (dat->singular)
+        // Like lu_decomp_c_worker(), which reports this case as a zero
+        // determinant
+        err = dat->completion(ERR_NONE, dat->a, dat->perm, 0, 0);
+    else
+        err = dat->completion(ERR_NONE, dat->a, dat->perm,
+                              dat->det_re, dat->det_im);
+    free(dat);
+    return err;
+}
+#endif
+
 
 /*****************************/
 /***** Back-substitution *****/
@@ -450,18 +1124,85 @@ struct backsub_rr_data_struct {
     int4 *perm;
     vartype_realmatrix *b;
     int4 i, ii, j, ll, k;
-    phloat sum;
+    phloat sum, comp;
     int state;
     int (*completion)(int, vartype_realmatrix *, int4 *, vartype_realmatrix *);
 };
 
-static backsub_rr_data_struct *backsub_rr_data;
+static CORE_TLS backsub_rr_data_struct *backsub_rr_data;
 
 static int lu_backsubst_rr_worker(bool interrupted);
 
+#ifdef BCD_MATH
+/* The same algorithm as lu_backsubst_rr_worker(), on doubles: solves for the
+ * q columns of the n x q matrix 'b', in place, using the decomposition made
+ * by lu_decomp_doubles().
+ */
+static void lu_backsubst_doubles(const double *a, const int4 *perm,
+                                 double *b, int4 n, int4 q) {
+    int4 i, j, k;
+    for (k = 0; k < q; k++) {
+        int4 ii = -1;
+        for (i = 0; i < n; i++) {
+            int4 ll = perm[i];
+            double sum = b[ll * q + k];
+            b[ll * q + k] = b[i * q + k];
+            if (ii != -1) {
+                for (j = ii; j < i; j++)
+                    sum -= a[i * n + j] * b[j * q + k];
+            } else if (sum != 0)
+                ii = i;
+            b[i * q + k] = sum;
+        }
+        for (i = n - 1; i >= 0; i--) {
+            double sum = b[i * q + k];
+            for (j = i + 1; j < n; j++)
+                sum -= a[i * n + j] * b[j * q + k];
+            b[i * q + k] = sum / a[i * n + i];
+        }
+    }
+}
+
+/* Binary engine: lu_backsubst_doubles(), in one go. Returns false, leaving
+ * 'b' untouched, if the numbers don't fit in doubles, if the calculation
+ * overflows, or if we run out of memory; the caller then falls back on the
+ * Decimal back-substitution.
+ */
+static bool lu_backsubst_rr_binary(vartype_realmatrix *am, int4 *perm,
+                                   vartype_realmatrix *bm) {
+    int4 n = am->rows;
+    int4 q = bm->columns;
+    double *a = (double *) malloc((n * n + n * q) * sizeof(double));
+    if (a == NULL)
+        return false;
+    double *b = a + n * n;
+    int4 i;
+    if (!to_doubles(am->array->data, a, n * n)
+            || !to_doubles(bm->array->data, b, n * q))
+        goto fail;
+    lu_backsubst_doubles(a, perm, b, n, q);
+
+    for (i = 0; i < n * q; i++)
+        if (!isfinite(b[i]))
+            goto fail;
+    from_doubles(b, bm->array->data, n * q);
+    free(a);
+    return true;
+
+    fail:
+    free(a);
+    return false;
+}
+#endif
+
 int lu_backsubst_rr(vartype_realmatrix *a, int4 *perm, vartype_realmatrix *b,
                     int (*completion)(int, vartype_realmatrix *,
                                     int4 *, vartype_realmatrix *)) {
+#ifdef BCD_MATH
+    if (core_settings.binary_engine && lu_backsubst_rr_binary(a, perm, b))
+        return completion(ERR_NONE, a, perm, b);
+#endif
+
     backsub_rr_data_struct *dat =
             (backsub_rr_data_struct *) malloc(sizeof(backsub_rr_data_struct));
 
@@ -496,6 +1237,7 @@ static int lu_backsubst_rr_worker(bool interrupted) {
     int4 ll = dat->ll;
     int4 k = dat->k;
     phloat sum = dat->sum;
+    phloat comp = dat->comp;
 
     phloat t;
 
@@ -516,23 +1258,25 @@ static int lu_backsubst_rr_worker(bool interrupted) {
         for (i = 0; i < n; i++) {
             ll = perm[i];
             sum = b[ll * q + k];
+            comp = 0;
             b[ll * q + k] = b[i * q + k];
             if (ii != -1) {
                 for (j = ii; j < i; j++) {
-                    sum -= a[i * n + j] * b[j * q + k];
+                    linalg_sub_product(&sum, &comp, a[i * n + j], b[j * q + k]);
                     STATE(1);
                 }
             } else if (sum != 0)
                 ii = i;
-            b[i * q + k] = sum;
+            b[i * q + k] = linalg_sum(sum, comp);
         }
         for (i = n - 1; i >= 0; i--) {
             sum = b[i * q + k];
+            comp = 0;
             for (j = i + 1; j < n; j++) {
-                sum -= a[i * n + j] * b[j * q + k];
+                linalg_sub_product(&sum, &comp, a[i * n + j], b[j * q + k]);
                 STATE(2);
             }
-            t = sum / a[i * n + i];
+            t = linalg_sum(sum, comp) / a[i * n + i];
             if (p_isinf(t) || p_isnan(t)) {
                 if (core_settings.matrix_outofrange
                                         && !flags.f.range_error_ignore)
@@ -556,9 +1300,208 @@ static int lu_backsubst_rr_worker(bool interrupted) {
     dat->ll = ll;
     dat->k = k;
     dat->sum = sum;
+    dat->comp = comp;
+    return ERR_INTERRUPTIBLE;
+}
+
+#ifdef BCD_MATH
+// Give up when the solution hasn't converged after this many rounds
+#define REFINE_MAX_ROUNDS 10
+
+struct refine_rr_data_struct {
+    const vartype_realmatrix *a;
+    const vartype_realmatrix *b;
+    vartype_realmatrix *x;
+    double *lu;
+    int4 *perm;
+    phloat *xr;
+    int4 i, j, k;
+    int step;
+    double prev;
+    phloat sum, comp;
+    int state;
+    int (*completion)(int, const vartype_realmatrix *, vartype_realmatrix *,
+                      bool);
+};
+
+static CORE_TLS refine_rr_data_struct *refine_rr_data;
+
+static int lu_solve_rr_refined_worker(bool interrupted);
+
+static void refine_rr_free(refine_rr_data_struct *dat) {
+    free(dat->lu);
+    free(dat->perm);
+    free(dat->xr);
+    free(dat);
+}
+
+int lu_solve_rr_refined(const vartype_realmatrix *a,
+                        const vartype_realmatrix *b,
+                        vartype_realmatrix *x,
+                        int (*completion)(int, const vartype_realmatrix *,
+                                          vartype_realmatrix *, bool)) {
+    int4 n = a->rows;
+    int4 q = b->columns;
+    refine_rr_data_struct *dat;
+    double *d;
+    bool neg;
+    int4 i;
+
+    // Each round of refinement costs about 8 n^2 q Decimal operations, and
+    // it usually takes three rounds; the Decimal decomposition costs about
+    // 2/3 n^3.
+    if (q * 64 >= n)
+        return completion(ERR_NONE, a, x, false);
+
+    dat = (refine_rr_data_struct *) malloc(sizeof(refine_rr_data_struct));
+    if (dat == NULL)
+        return completion(ERR_NONE, a, x, false);
+    dat->lu = (double *) malloc((n * n + n + n * q) * sizeof(double));
+    dat->perm = (int4 *) malloc(n * sizeof(int4));
+    dat->xr = (phloat *) malloc(n * q * sizeof(phloat));
+    if (dat->lu == NULL || dat->perm == NULL || dat->xr == NULL)
+        goto fail;
+
+    // The decomposition is followed by its scale factors, and then by the
+    // corrections, which start out as the solution itself
+    d = dat->lu + n * n + n;
+    if (!to_doubles(a->array->data, dat->lu, n * n)
+            || !to_doubles(b->array->data, d, n * q))
+        goto fail;
+    if (!lu_decomp_doubles(dat->lu, dat->lu + n * n, n, dat->perm, &neg))
+        goto fail;
+    lu_backsubst_doubles(dat->lu, dat->perm, d, n, q);
+    for (i = 0; i < n * q; i++)
+        if (!isfinite(d[i]))
+            goto fail;
+    from_doubles(d, dat->xr, n * q);
+
+    dat->a = a;
+    dat->b = b;
+    dat->x = x;
+    dat->completion = completion;
+
+    dat->step = 0;
+    dat->prev = 0;
+    dat->state = 0;
+
+    refine_rr_data = dat;
+    mode_interruptible = lu_solve_rr_refined_worker;
+    mode_stoppable = false;
     return ERR_INTERRUPTIBLE;
+
+    fail:
+    refine_rr_free(dat);
+    return completion(ERR_NONE, a, x, false);
 }
 
+static int lu_solve_rr_refined_worker(bool interrupted) {
+    refine_rr_data_struct *dat = refine_rr_data;
+    const phloat *a = dat->a->array->data;
+    const phloat *b = dat->b->array->data;
+    int4 n = dat->a->rows;
+    int4 q = dat->b->columns;
+    phloat *x = dat->xr;
+    double *d = dat->lu + n * n + n;
+    int count = 1000;
+
+    int4 i = dat->i;
+    int4 j = dat->j;
+    int4 k = dat->k;
+    int step = dat->step;
+    phloat sum = dat->sum;
+    phloat comp = dat->comp;
+
+    double r, dmax;
+    bool success = false;
+    int err;
+
+    if (interrupted) {
+        err = dat->completion(ERR_INTERRUPTED, dat->a, dat->x, false);
+        refine_rr_free(dat);
+        return err;
+    }
+
+    switch (dat->state) {
+        case 0: break;
+        case 1: goto state1;
+    }
+
+    for (step = 0; step < REFINE_MAX_ROUNDS; step++) {
+        /* The residuals are differences of nearly equal numbers, so they
+         * are computed with compensated accumulation whatever the setting;
+         * that way, the refinement gets X right even where the condition
+         * of A would make rounding errors in the residuals show up in it.
+         */
+        for (i = 0; i < n; i++)
+            for (k = 0; k < q; k++) {
+                sum = b[i * q + k];
+                comp = 0;
+                for (j = 0; j < n; j++) {
+                    linalg_sub_product_mode(ACCUMULATE_COMPENSATED, &sum, &comp,
+                                            a[i * n + j], x[j * q + k]);
+                    STATE(1);
+                }
+                r = to_double(linalg_sum(sum, comp));
+                if (!isfinite(r))
+                    goto done;
+                d[i * q + k] = r;
+            }
+        lu_backsubst_doubles(dat->lu, dat->perm, d, n, q);
+
+        // The largest correction, relative to the element it corrects
+        dmax = 0;
+        for (i = 0; i < n * q; i++) {
+            if (!isfinite(d[i]))
+                goto done;
+            if (d[i] == 0)
+                continue;
+            r = fabs(to_double(x[i]));
+            r = r == 0 ? HUGE_VAL : fabs(d[i]) / r;
+            if (r > dmax)
+                dmax = r;
+            x[i] += phloat(d[i]);
+        }
+        // Done when every correction is at most 1e-34 times the element it
+        // corrects, i.e. less than a unit in its last digit, or at most
+        // 1e-33 times while still shrinking a thousandfold per round, which
+        // leaves what's after it far below the last digit. Otherwise, keep
+        // going while the corrections keep shrinking; once they don't,
+        // they're down to the rounding errors of the Decimal arithmetic, and
+        // that's good enough if none is more than 1e-33 times its element.
+        // If they stop shrinking while they're still larger than that, A is
+        // too badly conditioned for the decomposition in doubles to be of
+        // use.
+        if (dmax <= 1e-34 || (dmax <= 1e-33 && dmax <= dat->prev / 1000)) {
+            success = true;
+            break;
+        }
+        if (step > 0 && dmax > dat->prev / 2) {
+            success = dmax <= 1e-33;
+            break;
+        }
+        dat->prev = dmax;
+    }
+    if (success)
+        for (i = 0; i < n * q; i++)
+            dat->x->array->data[i] = x[i];
+
+    done:
+    err = dat->completion(ERR_NONE, dat->a, dat->x, success);
+    refine_rr_free(dat);
+    return err;
+
+    suspend:
+    dat->i = i;
+    dat->j = j;
+    dat->k = k;
+    dat->step = step;
+    dat->sum = sum;
+    dat->comp = comp;
+    return ERR_INTERRUPTIBLE;
+}
+#endif
+
 struct backsub_rc_data_struct {
     vartype_realmatrix *a;
     int4 *perm;
@@ -570,7 +1513,7 @@ struct backsub_rc_data_struct {
                                             vartype_complexmatrix *);
 };
 
-static backsub_rc_data_struct *backsub_rc_data;
+static CORE_TLS backsub_rc_data_struct *backsub_rc_data;
 
 static int lu_backsubst_rc_worker(bool interrupted);
 
@@ -701,12 +1644,14 @@ struct backsub_cc_data_struct {
     vartype_complexmatrix *b;
     int4 i, ii, j, ll, k;
     phloat sum_re, sum_im;
+    // Planes of 'a' and of the current column of 'b', as in lu_decomp_c()
+    phloat *re, *im, *col_re, *col_im;
     int state;
     int (*completion)(int, vartype_complexmatrix *, int4 *,
                                             vartype_complexmatrix *);
 };
 
-static backsub_cc_data_struct *backsub_cc_data;
+static CORE_TLS backsub_cc_data_struct *backsub_cc_data;
 
 static int lu_backsubst_cc_worker(bool interrupted);
 
@@ -719,6 +1664,17 @@ int lu_backsubst_cc(vartype_complexmatrix *a, int4 *perm, vartype_complexmatrix
     if (dat == NULL)
         return completion(ERR_INSUFFICIENT_MEMORY, a, perm, b);
 
+    int4 n = a->rows;
+    dat->re = (phloat *) malloc(2 * (n * n + n) * sizeof(phloat));
+    if (dat->re == NULL) {
+        free(dat);
+        return completion(ERR_INSUFFICIENT_MEMORY, a, perm, b);
+    }
+    dat->im = dat->re + n * n;
+    dat->col_re = dat->im + n * n;
+    dat->col_im = dat->col_re + n;
+    planes_split(a->array->data, dat->re, dat->im, n * n);
+
     dat->a = a;
     dat->perm = perm;
     dat->b = b;
@@ -734,7 +1690,10 @@ int lu_backsubst_cc(vartype_complexmatrix *a, int4 *perm, vartype_complexmatrix
 
 static int lu_backsubst_cc_worker(bool interrupted) {
     backsub_cc_data_struct *dat = backsub_cc_data;
-    phloat *a = dat->a->array->data;
+    phloat *re = dat->re;
+    phloat *im = dat->im;
+    phloat *col_re = dat->col_re;
+    phloat *col_im = dat->col_im;
     int4 n = dat->a->rows;
     phloat *b = dat->b->array->data;
     int4 q = dat->b->columns;
@@ -755,6 +1714,7 @@ static int lu_backsubst_cc_worker(bool interrupted) {
 
     if (interrupted) {
         int err = dat->completion(ERR_INTERRUPTED, dat->a, perm, dat->b);
+        free(re);
         free(dat);
         return err;
     }
@@ -766,42 +1726,46 @@ static int lu_backsubst_cc_worker(bool interrupted) {
     }
 
     for (k = 0; k < q; k++) {
+        for (i = 0; i < n; i++) {
+            col_re[i] = b[2 * (i * q + k)];
+            col_im[i] = b[2 * (i * q + k) + 1];
+        }
         ii = -1;
         for (i = 0; i < n; i++) {
             ll = perm[i];
-            sum_re = b[2 * (ll * q + k)];
-            sum_im = b[2 * (ll * q + k) + 1];
-            b[2 * (ll * q + k)] = b[2 * (i * q + k)];
-            b[2 * (ll * q + k) + 1] = b[2 * (i * q + k) + 1];
+            sum_re = col_re[ll];
+            sum_im = col_im[ll];
+            col_re[ll] = col_re[i];
+            col_im[ll] = col_im[i];
             if (ii != -1) {
                 for (j = ii; j < i; j++) {
-                    bre = b[2 * (j * q + k)];
-                    bim = b[2 * (j * q + k) + 1];
-                    tmp_re = a[2 * (i * n + j)];
-                    tmp_im = a[2 * (i * n + j) + 1];
+                    bre = col_re[j];
+                    bim = col_im[j];
+                    tmp_re = re[i * n + j];
+                    tmp_im = im[i * n + j];
                     sum_re -= bre * tmp_re - bim * tmp_im;
                     sum_im -= bim * tmp_re + bre * tmp_im;
                     STATE(1);
                 }
             } else if (sum_re != 0 || sum_im != 0)
                 ii = i;
-            b[2 * (i * q + k)] = sum_re;
-            b[2 * (i * q + k) + 1] = sum_im;
+            col_re[i] = sum_re;
+            col_im[i] = sum_im;
         }
         for (i = n - 1; i >= 0; i--) {
-            sum_re = b[2 * (i * q + k)];
-            sum_im = b[2 * (i * q + k) + 1];
+            sum_re = col_re[i];
+            sum_im = col_im[i];
             for (j = i + 1; j < n; j++) {
-                bre = b[2 * (j * q + k)];
-                bim = b[2 * (j * q + k) + 1];
-                tmp_re = a[2 * (i * n + j)];
-                tmp_im = a[2 * (i * n + j) + 1];
+                bre = col_re[j];
+                bim = col_im[j];
+                tmp_re = re[i * n + j];
+                tmp_im = im[i * n + j];
                 sum_re -= bre * tmp_re - bim * tmp_im;
                 sum_im -= bim * tmp_re + bre * tmp_im;
                 STATE(2);
             }
-            tmp_re = a[2 * (i * n + i)];
-            tmp_im = a[2 * (i * n + i) + 1];
+            tmp_re = re[i * n + i];
+            tmp_im = im[i * n + i];
             tmp = hypot(tmp_re, tmp_im);
             tmp_re = tmp_re / tmp / tmp;
             tmp_im = -tmp_im / tmp / tmp;
@@ -809,25 +1773,34 @@ static int lu_backsubst_cc_worker(bool interrupted) {
             t_im = sum_im * tmp_re + sum_re * tmp_im;
             if (p_isinf(t_re) || p_isnan(t_re)) {
                 if (core_settings.matrix_outofrange
-                                        && !flags.f.range_error_ignore)
+                                        && !flags.f.range_error_ignore) {
+                    free(re);
                     return ERR_OUT_OF_RANGE;
+                }
                 else
                     t_re = p_isinf(t_re) < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
             }
             if (p_isinf(t_im) || p_isnan(t_im)) {
                 if (core_settings.matrix_outofrange
-                                        && !flags.f.range_error_ignore)
+                                        && !flags.f.range_error_ignore) {
+                    free(re);
                     return ERR_OUT_OF_RANGE;
+                }
                 else
                     t_im = p_isinf(t_im) < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
             }
-            b[2 * (i * q + k)] = t_re;
-            b[2 * (i * q + k) + 1] = t_im;
+            col_re[i] = t_re;
+            col_im[i] = t_im;
+        }
+        for (i = 0; i < n; i++) {
+            b[2 * (i * q + k)] = col_re[i];
+            b[2 * (i * q + k) + 1] = col_im[i];
         }
     }
 
     int err;
     err = dat->completion(ERR_NONE, dat->a, perm, dat->b);
+    free(re);
     free(dat);
     return err;
 
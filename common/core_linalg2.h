@@ -34,6 +34,35 @@ int lu_backsubst_rr(vartype_realmatrix *a,
                             int (*completion)(int, vartype_realmatrix *,
                                     int4 *, vartype_realmatrix *));
 
+#ifdef BCD_MATH
+/* Mixed-precision solution of A X = B, for core_settings.mixed_precision.
+ * A is decomposed in double precision, which is much faster than doing it in
+ * Decimal, and the solution is then refined: the residual B - A X is
+ * computed in Decimal, with compensated accumulation whatever
+ * core_settings.accumulation says, the decomposition in doubles solves for
+ * the correction, and that is added to X. This stops when every element of
+ * the correction is at most 1e-34 times the element of X it corrects, or at
+ * most 1e-33 times while the corrections still shrink a thousandfold per
+ * round, or, when the corrections stop shrinking, if none is more than
+ * 1e-33 times its element; each element of X is then within about one unit
+ * in its last digit of the solution the Decimal residual implies. Each round gains the
+ * digits that A's condition number leaves in double precision, so a few
+ * rounds are usually enough. The refinement is an interruptible operation.
+ * The completion gets 'solved' false, with 'x' untouched, if the numbers
+ * don't fit in doubles, if A is singular or too badly conditioned for the
+ * refinement to converge, if an element of X that should be zero keeps
+ * getting corrections as large as itself, if we run out of memory, or if
+ * B has so many columns that the residuals would cost more than the
+ * Decimal decomposition; it should then use lu_decomp_r() and
+ * lu_backsubst_rr().
+ */
+int lu_solve_rr_refined(const vartype_realmatrix *a,
+                        const vartype_realmatrix *b,
+                        vartype_realmatrix *x,
+                        int (*completion)(int, const vartype_realmatrix *,
+                                          vartype_realmatrix *, bool));
+#endif
+
 int lu_backsubst_rc(vartype_realmatrix *a,
                             int4 *perm,
                             vartype_complexmatrix *b,
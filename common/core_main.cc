@@ -20,6 +20,12 @@
 #include <string.h>
 #include <stdarg.h>
 #include <errno.h>
+#ifndef ARM
+#include <chrono>
+#endif
+#ifdef CORE_THREADS
+#include <mutex>
+#endif
 
 #include "core_main.h"
 #include "core_commands2.h"
@@ -29,6 +35,7 @@
 #include "core_display.h"
 #include "core_helpers.h"
 #include "core_keydown.h"
+#include "core_linalg1.h"
 #include "core_math1.h"
 #include "core_sto_rcl.h"
 #include "core_tables.h"
@@ -64,13 +71,29 @@ static void continue_running();
 static void stop_interruptible();
 static int handle_error(int error);
 
-int repeating = 0;
-int repeating_shift;
-int repeating_key;
-
-static int4 oldpc;
+CORE_TLS int repeating = 0;
+CORE_TLS int repeating_shift;
+CORE_TLS int repeating_key;
+
+static CORE_TLS int4 oldpc;
+
+CORE_TLS core_settings_struct core_settings = {
+    false, // matrix_singularmatrix
+    false, // matrix_outofrange
+    true,  // auto_repeat
+    false, // allow_big_stack
+    true,  // localized_copy_paste
+    true,  // decode_cache
+    false, // binary_engine
+    10,    // poll_latency_ms
+    ACCUMULATE_PLAIN, // accumulation
+    false, // mixed_precision
+    32,    // matrix_block_size
+    0,     // matrix_threads
+    true   // transcendental_cache
+};
 
-core_settings_struct core_settings;
+CORE_TLS core_stats_struct core_stats = { 0, 0, 0 };
 
 void core_init(int read_saved_state, int4 version, const char *state_file_name, int offset) {
 
@@ -80,7 +103,13 @@ void core_init(int read_saved_state, int4 version, const char *state_file_name,
      * 2: state file present but not OK (State File Corrupt)
      */
 
+#ifdef CORE_THREADS
+    // The phloat constants are shared by all threads
+    static std::once_flag phloat_init_done;
+    std::call_once(phloat_init_done, phloat_init);
+#else
     phloat_init();
+#endif
 
 #ifndef ARM
     char *state_file_name_crash = NULL;
@@ -4934,11 +4963,376 @@ void do_interactive(int command) {
     }
 }
 
+/* Returns a timestamp in nanoseconds */
+static inline uint8 clock_ns() {
+#ifdef ARM
+    // No high-resolution clock here; make do with the shell's timer
+    return (uint8) shell_milliseconds() * 1000000;
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/* Instruction budget
+ *
+ * Rather than calling shell_wants_cpu() after every instruction, which can
+ * cost a system call or two per instruction in some shells, we execute
+ * batches of run_budget instructions between calls. The batch size is tuned
+ * on the fly so that a batch takes between a quarter and all of
+ * core_settings.poll_latency_ms, so the shell still gets control back often
+ * enough to stay responsive.
+ */
+
+#define MAX_RUN_BUDGET 1048576
+
+static CORE_TLS int4 run_budget = 1;
+static CORE_TLS int4 run_count;
+static CORE_TLS uint8 run_batch_start;
+
+static void start_run_batch() {
+    run_count = 0;
+    if (core_settings.poll_latency_ms > 0)
+        run_batch_start = clock_ns();
+}
+
+static bool batch_wants_cpu() {
+    if (++run_count < run_budget)
+        return false;
+    if (core_settings.poll_latency_ms > 0) {
+        uint8 now = clock_ns();
+        uint8 elapsed = now - run_batch_start;
+        uint8 target = (uint8) core_settings.poll_latency_ms * 1000000;
+        if (elapsed > target) {
+            run_budget /= 2;
+            if (run_budget < 1)
+                run_budget = 1;
+        } else if (elapsed < target / 4 && run_budget < MAX_RUN_BUDGET)
+            run_budget *= 2;
+        run_batch_start = now;
+    } else
+        run_budget = 1;
+    run_count = 0;
+    return shell_wants_cpu();
+}
+
+/* Execution profiler
+ *
+ * When enabled, continue_running() times and counts every program line it
+ * executes, and doesn't use compiled programs, which run many lines per
+ * call. The per-line data is kept in an open-addressing hash table keyed by
+ * (prgm, pc), which is discarded whenever programs are edited, deleted, or
+ * renumbered, so the keys always point at the lines they were made for; the
+ * per-command data in an array indexed by command id.
+ */
+
+struct profile_line {
+    int prgm; // -1 means unused slot
+    int4 pc;
+    uint4 hits;
+    uint8 time;
+};
+
+struct profile_cmd {
+    uint4 hits;
+    uint8 time;
+};
+
+static CORE_TLS bool profiling = false;
+static CORE_TLS profile_line *profile_lines = NULL;
+static CORE_TLS int profile_lines_size = 0;
+static CORE_TLS int profile_lines_count = 0;
+static CORE_TLS profile_cmd *profile_cmds = NULL;
+
+static inline int profile_hash(int prgm, int4 pc) {
+    uint4 h = (uint4) prgm * 0x9e3779b1U ^ (uint4) pc * 0x85ebca77U;
+    h ^= h >> 15;
+    return (int) (h & (profile_lines_size - 1));
+}
+
+static profile_line *profile_find_line(int prgm, int4 pc) {
+    if (profile_lines_count * 2 >= profile_lines_size) {
+        int newsize = profile_lines_size == 0 ? 256 : profile_lines_size * 2;
+        profile_line *newlines = (profile_line *) malloc(newsize * sizeof(profile_line));
+        if (newlines == NULL)
+            return NULL;
+        for (int i = 0; i < newsize; i++)
+            newlines[i].prgm = -1;
+        profile_line *oldlines = profile_lines;
+        int oldsize = profile_lines_size;
+        profile_lines = newlines;
+        profile_lines_size = newsize;
+        for (int i = 0; i < oldsize; i++) {
+            if (oldlines[i].prgm == -1)
+                continue;
+            int h = profile_hash(oldlines[i].prgm, oldlines[i].pc);
+            while (newlines[h].prgm != -1)
+                h = (h + 1) & (newsize - 1);
+            newlines[h] = oldlines[i];
+        }
+        free(oldlines);
+    }
+    int h = profile_hash(prgm, pc);
+    while (true) {
+        profile_line *pl = profile_lines + h;
+        if (pl->prgm == -1) {
+            pl->prgm = prgm;
+            pl->pc = pc;
+            pl->hits = 0;
+            pl->time = 0;
+            profile_lines_count++;
+            return pl;
+        }
+        if (pl->prgm == prgm && pl->pc == pc)
+            return pl;
+        h = (h + 1) & (profile_lines_size - 1);
+    }
+}
+
+void core_profiler_enable(bool enable) {
+    if (enable && profile_cmds == NULL) {
+        profile_cmds = (profile_cmd *) calloc(CMD_SENTINEL, sizeof(profile_cmd));
+        if (profile_cmds == NULL)
+            return;
+    }
+    profiling = enable;
+}
+
+bool core_profiler_enabled() {
+    return profiling;
+}
+
+void profiler_discard_lines() {
+    free(profile_lines);
+    profile_lines = NULL;
+    profile_lines_size = 0;
+    profile_lines_count = 0;
+}
+
+void core_profiler_reset() {
+    profiler_discard_lines();
+    if (profile_cmds != NULL)
+        memset(profile_cmds, 0, CMD_SENTINEL * sizeof(profile_cmd));
+    phloat_memo_reset_stats();
+}
+
+static int profile_line_compare(const void *a, const void *b) {
+    uint8 ta = (*(const profile_line **) a)->time;
+    uint8 tb = (*(const profile_line **) b)->time;
+    return ta < tb ? 1 : ta > tb ? -1 : 0;
+}
+
+static int profile_cmd_compare(const void *a, const void *b) {
+    uint8 ta = profile_cmds[*(const int *) a].time;
+    uint8 tb = profile_cmds[*(const int *) b].time;
+    return ta < tb ? 1 : ta > tb ? -1 : 0;
+}
+
+static void tb_print_profile_stats(textbuf *tb, uint4 hits, uint8 time, uint8 total) {
+    char buf[50];
+    snprintf(buf, 50, "%10u %12.3f %5.1f%%  ", hits, time / 1e6,
+             total == 0 ? 0.0 : time * 100.0 / total);
+    tb_write(tb, buf, strlen(buf));
+}
+
+char *core_profiler_report() {
+    textbuf tb;
+    tb.buf = NULL;
+    tb.size = 0;
+    tb.capacity = 0;
+    tb.fail = false;
+
+    profile_line **lines = (profile_line **) malloc((profile_lines_count + 1) * sizeof(profile_line *));
+    if (lines == NULL)
+        return NULL;
+    int n = 0;
+    uint8 total = 0;
+    for (int i = 0; i < profile_lines_size; i++) {
+        profile_line *pl = profile_lines + i;
+        if (pl->prgm == -1)
+            continue;
+        lines[n++] = pl;
+        total += pl->time;
+    }
+    qsort(lines, n, sizeof(profile_line *), profile_line_compare);
+
+    const char *header = "      Hits     Time (ms)      %  Line\n";
+    tb_write(&tb, "Program lines\n", 14);
+    tb_write(&tb, header, strlen(header));
+    char buf[50];
+    for (int i = 0; i < n; i++) {
+        profile_line *pl = lines[i];
+        tb_print_profile_stats(&tb, pl->hits, pl->time, total);
+        int lbl = -1;
+        for (int j = 0; j < labels_count; j++)
+            if (labels[j].prgm == pl->prgm && labels[j].length > 0) {
+                lbl = j;
+                break;
+            }
+        if (lbl == -1) {
+            snprintf(buf, 50, "PRGM %d", pl->prgm + 1);
+            tb_write(&tb, buf, strlen(buf));
+        } else {
+            char utf8buf[50];
+            tb_write(&tb, "\"", 1);
+            int len = hp2ascii(utf8buf, labels[lbl].name, labels[lbl].length);
+            tb_write(&tb, utf8buf, len);
+            tb_write(&tb, "\"", 1);
+        }
+        tb_write(&tb, ": ", 2);
+        tb_print_program_line(&tb, pl->prgm, pl->pc);
+        tb_write(&tb, "\n", 1);
+    }
+    free(lines);
+
+    if (profile_cmds != NULL) {
+        int cmds[CMD_SENTINEL];
+        n = 0;
+        total = 0;
+        for (int i = 0; i < CMD_SENTINEL; i++)
+            if (profile_cmds[i].hits != 0) {
+                cmds[n++] = i;
+                total += profile_cmds[i].time;
+            }
+        qsort(cmds, n, sizeof(int), profile_cmd_compare);
+        tb_write(&tb, "\nCommands\n", 10);
+        header = "     Calls     Time (ms)      %  Command\n";
+        tb_write(&tb, header, strlen(header));
+        for (int i = 0; i < n; i++) {
+            const command_spec *cs = cmd_array + cmds[i];
+            tb_print_profile_stats(&tb, profile_cmds[cmds[i]].hits, profile_cmds[cmds[i]].time, total);
+            if (cmds[i] == CMD_NUMBER)
+                tb_write(&tb, "(number)", 8);
+            else if (cmds[i] == CMD_STRING)
+                tb_write(&tb, "(string)", 8);
+            else {
+                char namebuf[20];
+                for (int j = 0; j < cs->name_length; j++) {
+                    unsigned char c = cs->name[j];
+                    if (undefined_char(c))
+                        c &= 127;
+                    namebuf[j] = c;
+                }
+                char utf8buf[100];
+                int len = hp2ascii(utf8buf, namebuf, cs->name_length);
+                tb_write(&tb, utf8buf, len);
+            }
+            tb_write(&tb, "\n", 1);
+        }
+    }
+
+    uint8 memo_hits, memo_misses;
+    phloat_memo_stats(&memo_hits, &memo_misses);
+    if (memo_hits + memo_misses != 0) {
+        tb_write(&tb, "\nTranscendental cache (SOLVE and INTEG)\n", 40);
+        snprintf(buf, 50, "%10llu hits %10llu misses %5.1f%%\n", memo_hits, memo_misses,
+                 memo_hits * 100.0 / (memo_hits + memo_misses));
+        tb_write(&tb, buf, strlen(buf));
+    }
+
+    tb_write_null(&tb);
+    if (tb.fail) {
+        free(tb.buf);
+        return NULL;
+    }
+    return tb.buf;
+}
+
+static int calibrate_completion(int error, vartype *res) {
+    free_vartype(res);
+    return error;
+}
+
+int core_calibrate_matrix_block_size() {
+    // The multiplications would clobber the state of an interruptible
+    // operation that's in progress, like a matrix operation of the user's
+    if (mode_interruptible != NULL)
+        return core_settings.matrix_block_size;
+
+    // Large enough for the right-hand matrix not to fit in the L1 cache,
+    // small enough to take no more than a fraction of a second per candidate
+#ifdef BCD_MATH
+    const int4 n = 32;
+#else
+    const int4 n = 192;
+#endif
+    vartype *a = new_realmatrix(n, n);
+    vartype *b = new_realmatrix(n, n);
+    if (a == NULL || b == NULL) {
+        free_vartype(a);
+        free_vartype(b);
+        return -1;
+    }
+    phloat *ad = ((vartype_realmatrix *) a)->array->data;
+    phloat *bd = ((vartype_realmatrix *) b)->array->data;
+    for (int4 i = 0; i < n * n; i++) {
+        ad[i] = phloat(i % 7 + 1) / 8;
+        bd[i] = phloat(i % 11 + 1) / 16;
+    }
+
+    // The binary engine and the matrix threads don't use the block size, so
+    // time the single-threaded Decimal code even if they're on
+    bool saved_binary_engine = core_settings.binary_engine;
+    core_settings.binary_engine = false;
+    int saved_threads = core_settings.matrix_threads;
+    core_settings.matrix_threads = 1;
+    int saved_size = core_settings.matrix_block_size;
+    int best_size = -1;
+    uint8 best_time = 0;
+    for (int size = 4; size <= n; size *= 2) {
+        core_settings.matrix_block_size = size;
+        uint8 time = 0;
+        for (int rep = 0; rep < 2; rep++) {
+            uint8 t0 = clock_ns();
+            int err = linalg_mul(a, b, calibrate_completion);
+            while (err == ERR_INTERRUPTIBLE)
+                err = mode_interruptible(false);
+            uint8 t = clock_ns() - t0;
+            if (err != ERR_NONE)
+                goto done;
+            if (rep == 0 || t < time)
+                time = t;
+        }
+        if (best_size == -1 || time < best_time) {
+            best_size = size;
+            best_time = time;
+        }
+    }
+
+    done:
+    mode_interruptible = NULL;
+    mode_stoppable = false;
+    core_settings.binary_engine = saved_binary_engine;
+    core_settings.matrix_threads = saved_threads;
+    free_vartype(a);
+    free_vartype(b);
+    core_settings.matrix_block_size = best_size == -1 ? saved_size : best_size;
+    return best_size;
+}
+
+static void profile_line_done(int prgm, int4 pc, int cmd,
+                              uint8 t0, uint8 t1) {
+    uint8 t2 = clock_ns();
+    profile_cmds[cmd].hits++;
+    profile_cmds[cmd].time += t2 - t1;
+    profile_line *pl = profile_find_line(prgm, pc);
+    if (pl != NULL) {
+        pl->hits++;
+        pl->time += t2 - t0;
+    }
+}
+
 static void continue_running() {
     int error;
+    start_run_batch();
     do {
         int cmd;
         arg_struct arg;
+        int prgm = 0;
+        int4 linepc = 0;
+        uint8 t0 = 0, t1 = 0;
+        if (profiling)
+            t0 = clock_ns();
         oldpc = pc;
         if (pc == -1)
             pc = 0;
@@ -4947,14 +5341,32 @@ static void continue_running() {
             set_running(false);
             return;
         }
-        get_next_command(&pc, &cmd, &arg, 1, NULL);
+        if (prgms[current_prgm].compiled != -1 && !profiling
+                && !(flags.f.trace_print && flags.f.printer_exists)) {
+            int4 start = pc, last;
+            error = run_compiled_prgm(&last);
+            if (last != start)
+                oldpc = last;
+            if (error != COMPILED_INTERPRET)
+                goto handled;
+        }
+        prgm = current_prgm;
+        linepc = pc;
+        get_next_command_cached(&pc, &cmd, &arg);
         if (flags.f.trace_print && flags.f.printer_exists) {
             if (cmd == CMD_LBL)
                 print_text(NULL, 0, true);
             print_program_line(current_prgm, oldpc);
         }
         mode_disable_stack_lift = false;
-        error = handle(cmd, &arg);
+        core_stats.instructions++;
+        if (profiling) {
+            t1 = clock_ns();
+            error = handle(cmd, &arg);
+            profile_line_done(prgm, linepc, cmd, t0, t1);
+        } else
+            error = handle(cmd, &arg);
+        handled:
         if (mode_pause) {
             shell_request_timeout3(1000);
             return;
@@ -4965,7 +5377,7 @@ static void continue_running() {
             return;
         if (mode_getkey)
             return;
-    } while (!shell_wants_cpu());
+    } while (!batch_wants_cpu());
 }
 
 struct synonym_spec {
@@ -5031,7 +5443,102 @@ static synonym_spec hp41_synonyms[] =
     { "",       true,  0, CMD_NONE    }
 };
 
+/* Name index for find_builtin()
+ *
+ * Two open-addressing hash tables, built on first use: one for the synonyms,
+ * keyed by their exact names, and one for cmd_array, keyed by name with
+ * undefined characters masked to 7 bits, the same way the lookup used to
+ * compare them. Where several commands have the same name, the table holds
+ * the one with the lowest index, which is the one the old linear search
+ * found first. Synonyms take precedence over commands, as before.
+ */
+
+#define BUILTIN_HASH_SIZE 1024
+#define SYNONYM_HASH_SIZE 128
+
+static CORE_TLS short builtin_hash[BUILTIN_HASH_SIZE];
+static CORE_TLS signed char synonym_hash[SYNONYM_HASH_SIZE];
+static CORE_TLS bool builtin_hash_initialized = false;
+
+static inline unsigned char builtin_char(unsigned char c) {
+    return undefined_char(c) ? c & 127 : c;
+}
+
+static uint4 builtin_name_hash(const char *name, int namelen, bool mask) {
+    uint4 h = 2166136261U;
+    for (int i = 0; i < namelen; i++) {
+        unsigned char c = name[i];
+        if (mask)
+            c = builtin_char(c);
+        h = (h ^ c) * 16777619U;
+    }
+    return h;
+}
+
+static bool builtin_name_equals(const command_spec *cs, const char *name, int namelen) {
+    if (cs->name_length != namelen)
+        return false;
+    for (int i = 0; i < namelen; i++)
+        if (builtin_char(name[i]) != builtin_char(cs->name[i]))
+            return false;
+    return true;
+}
+
+static void init_builtin_hash() {
+    for (int i = 0; i < SYNONYM_HASH_SIZE; i++)
+        synonym_hash[i] = -1;
+    for (int i = 0; hp41_synonyms[i].cmd_id != CMD_NONE; i++) {
+        synonym_spec *ss = hp41_synonyms + i;
+        int h = builtin_name_hash(ss->name, ss->namelen, false) & (SYNONYM_HASH_SIZE - 1);
+        while (synonym_hash[h] != -1) {
+            synonym_spec *ss2 = hp41_synonyms + synonym_hash[h];
+            if (ss2->namelen == ss->namelen && memcmp(ss2->name, ss->name, ss->namelen) == 0)
+                goto next_synonym;
+            h = (h + 1) & (SYNONYM_HASH_SIZE - 1);
+        }
+        synonym_hash[h] = i;
+        next_synonym:;
+    }
+    for (int i = 0; i < BUILTIN_HASH_SIZE; i++)
+        builtin_hash[i] = -1;
+    for (int i = 0; i < CMD_SENTINEL; i++) {
+        const command_spec *cs = cmd_array + i;
+        if ((cs->flags & FLAG_HIDDEN) != 0)
+            continue;
+        int h = builtin_name_hash(cs->name, cs->name_length, true) & (BUILTIN_HASH_SIZE - 1);
+        while (builtin_hash[h] != -1) {
+            if (builtin_name_equals(cmd_array + builtin_hash[h], cs->name, cs->name_length))
+                goto next_builtin;
+            h = (h + 1) & (BUILTIN_HASH_SIZE - 1);
+        }
+        builtin_hash[h] = i;
+        next_builtin:;
+    }
+    builtin_hash_initialized = true;
+}
+
 int find_builtin(const char *name, int namelen) {
+    if (!builtin_hash_initialized)
+        init_builtin_hash();
+
+    int h = builtin_name_hash(name, namelen, false) & (SYNONYM_HASH_SIZE - 1);
+    while (synonym_hash[h] != -1) {
+        synonym_spec *ss = hp41_synonyms + synonym_hash[h];
+        if (ss->namelen == namelen && memcmp(ss->name, name, namelen) == 0)
+            return ss->cmd_id;
+        h = (h + 1) & (SYNONYM_HASH_SIZE - 1);
+    }
+
+    h = builtin_name_hash(name, namelen, true) & (BUILTIN_HASH_SIZE - 1);
+    while (builtin_hash[h] != -1) {
+        if (builtin_name_equals(cmd_array + builtin_hash[h], name, namelen))
+            return builtin_hash[h];
+        h = (h + 1) & (BUILTIN_HASH_SIZE - 1);
+    }
+    return CMD_NONE;
+}
+
+int find_builtin_linear(const char *name, int namelen) {
     int i, j;
 
     for (i = 0; hp41_synonyms[i].cmd_id != CMD_NONE; i++) {
@@ -5464,6 +5971,7 @@ static int handle_error(int error) {
             pc = oldpc;
             display_error(error);
             set_running(false);
+            core_stats.errors++;
             return 0;
         }
         return 1;
@@ -5528,7 +6036,7 @@ static int handle_error(int error) {
 
 const char *number_format() {
     const char *uf = shell_number_format();
-    static char df[9];
+    static CORE_TLS char df[9];
     df[0] = 0;
     int len = ascii2hp(df, 4, uf);
     if (len >= 4)
@@ -325,6 +325,77 @@ void core_get_char_pixels(const char *ch, char *pixels);
 
 #endif
 
+/* core_profiler_enable()
+ *
+ * Turns the execution profiler on or off. While it is on, every program line
+ * that is executed is counted and timed, per program and pc, and the time
+ * spent in each command's handler is accumulated per command. Turning the
+ * profiler off does not discard the data collected so far; use
+ * core_profiler_reset() for that. While the profiler is on, programs that
+ * have been compiled with raw2cc are interpreted, so their lines can be
+ * timed; when it is off, all it costs is a flag test per program line.
+ */
+void core_profiler_enable(bool enable);
+bool core_profiler_enabled();
+
+/* core_profiler_reset()
+ *
+ * Discards all data collected by the profiler, including the transcendental
+ * cache statistics.
+ */
+void core_profiler_reset();
+
+/* core_profiler_report()
+ *
+ * Returns a text report of the data collected by the profiler: the program
+ * lines, sorted by total time spent, followed by the commands, also sorted by
+ * total time. Program lines are listed the way they are in program mode.
+ * The per-line data is discarded whenever programs are edited, deleted, or
+ * renumbered; the per-command data is kept. In the Decimal version, the report ends with the hit rate of the
+ * cache that the transcendental functions use while SOLVE or INTEG is
+ * running, if it has been used since the last reset; the cache works whether
+ * the profiler is on or not.
+ * The caller should free the returned text using free(3). Returns NULL if
+ * there isn't enough memory to generate the report.
+ */
+char *core_profiler_report();
+
+/* core_calibrate_matrix_block_size()
+ *
+ * Times the multiplication of two square real matrices with a range of
+ * block sizes, stores the fastest one in core_settings.matrix_block_size,
+ * and returns it. This takes a fraction of a second; shells can call it once
+ * at startup, or when the user asks for it, and save the result with their
+ * other preferences. If there isn't enough memory, the setting is left
+ * unchanged and -1 is returned. While an interruptible operation is in
+ * progress, nothing is timed, and the current setting is returned. The
+ * timing is done on one thread, whatever core_settings.matrix_threads says,
+ * and in the Decimal version, with the binary engine off, whatever
+ * core_settings.binary_engine says.
+ */
+int core_calibrate_matrix_block_size();
+
+/* core_register_compiled_programs()
+ *
+ * Registers programs that have been translated to C++ by raw2cc. When a
+ * program is run whose text is identical to that of a registered program, the
+ * compiled code runs instead of the interpreter, except while trace printing
+ * or the profiler is active. The code generated by raw2cc calls this function
+ * from a static initializer, so shells don't need to call it themselves.
+ * For each program, 'text' and 'size' are the program's text, 'lines' is the
+ * number of lines, and 'run' executes the program, starting at pc, using the
+ * arguments of its instructions, which the core decodes into 'args'. See
+ * run_compiled_prgm() for the details.
+ */
+struct arg_struct;
+struct core_compiled_program {
+    const unsigned char *text;
+    int4 size;
+    int4 lines;
+    int (*run)(arg_struct *args, int4 *instr_pc);
+};
+void core_register_compiled_programs(const core_compiled_program *progs, int count);
+
 /* core_update_allow_big_stack()
  *
  * Updates the big stack state and the UI to reflect a change in the
@@ -337,6 +408,64 @@ void core_update_allow_big_stack();
  * This is a struct that stores user-configurable core settings. The shell
  * should provide the appropriate controls in a "Preferences" dialog box to
  * allow the user to view and change these settings.
+ * The decode_cache setting controls whether running programs are executed
+ * from a cache of pre-decoded instructions, rather than decoding each line
+ * from the program text every time it is executed. It is on by default;
+ * turning it off is only useful for troubleshooting and benchmarking.
+ * The poll_latency_ms setting is the longest time, in milliseconds, that a
+ * running program should go without giving the shell a chance to handle
+ * events through shell_wants_cpu(). The core adjusts the number of
+ * instructions it executes between calls accordingly. Zero means call
+ * shell_wants_cpu() after every instruction.
+ * The binary_engine setting makes the Decimal version perform real matrix
+ * multiplication, and the LU decompositions and back-substitutions behind
+ * matrix division, INVRT, and DET, in IEEE double precision. This is much
+ * faster, but the results are only accurate to about 16 digits. When a
+ * matrix has elements outside the range of doubles, or when a calculation
+ * overflows, the Decimal arithmetic is used anyway. The setting is stored in
+ * the state file; it has no effect in the Binary version.
+ * The accumulation setting selects how the sums of products in matrix
+ * multiplication, the real LU decomposition and back-substitution, DOT, and
+ * FNRM are formed: ACCUMULATE_PLAIN rounds each product and each addition;
+ * ACCUMULATE_FMA adds each product to the running sum with a fused
+ * multiply-add, rounding once per term; ACCUMULATE_COMPENSATED also keeps
+ * track of the rounding errors of the products and of the additions, and
+ * adds them to the sum at the end, which makes each sum about as accurate as
+ * if it had been computed with twice the precision. The latter two are
+ * slower; the setting is stored in the state file.
+ * The mixed_precision setting makes the Decimal version solve real linear
+ * systems (matrix division and SIMQ) with a decomposition in IEEE double
+ * precision, followed by iterative refinement of the solution using
+ * residuals computed in Decimal, which gives full Decimal accuracy. When the
+ * matrix is too badly conditioned for that to converge, or when it is so
+ * small, or the right-hand side has so many columns, that the refinement
+ * wouldn't save time (one column per 64 rows or more), the Decimal
+ * decomposition is used instead. The setting is stored in the state file;
+ * it has no effect in the Binary version.
+ * The matrix_block_size setting is the number of columns of the right-hand
+ * matrix that matrix multiplication works on at a time, so that they stay in
+ * the cache while they are multiplied by every row of the left-hand matrix;
+ * it is also the number of columns the LU decomposition of real matrices
+ * (used by SIMQ, INVRT, DET, and matrix division) finishes before updating
+ * the rest of the matrix. Zero means all columns at once. The best value depends on the host's
+ * cache, so it is not stored in the state file;
+ * core_calibrate_matrix_block_size() finds it by timing a few candidates.
+ * The matrix_threads setting is the number of threads that multiply large
+ * matrices and compute their LU decompositions, in builds with
+ * LINALG_THREADS defined. Zero means one per processor, and one means do all
+ * the work on the calling thread. Smaller matrices always use one thread,
+ * and the results are the same regardless of the number of threads. This
+ * setting is not stored in the state file either.
+ * The transcendental_cache setting makes the Decimal version keep the
+ * results of the transcendental functions (SIN, LN, E^X, Y^X, and so on) in
+ * a 256-entry cache while SOLVE or INTEG is running, and reuse them when a
+ * function is called with the same arguments again, as happens a lot in
+ * the functions being solved or integrated. The cached results are
+ * the same as recomputed ones, bit for bit. It is on by default, and takes
+ * effect the next time SOLVE or INTEG calls its function. The setting is
+ * stored in the state file; it has no effect in the Binary version.
+ * In builds with CORE_THREADS defined, each thread has its own copy of these
+ * settings, like it has its own copy of the rest of the core's state.
  */
 struct core_settings_struct
 {
@@ -345,17 +474,50 @@ struct core_settings_struct
     bool auto_repeat;
     bool allow_big_stack;
     bool localized_copy_paste;
+    bool decode_cache;
+    bool binary_engine;
+    int poll_latency_ms;
+    int accumulation;
+    bool mixed_precision;
+    int matrix_block_size;
+    int matrix_threads;
+    bool transcendental_cache;
+};
+
+#define ACCUMULATE_PLAIN 0
+#define ACCUMULATE_FMA 1
+#define ACCUMULATE_COMPENSATED 2
+
+extern CORE_TLS core_settings_struct core_settings;
+
+/* core_stats
+ *
+ * Counters that the core maintains for benchmarking and batch runs. The
+ * shell may reset them at any time by setting them to zero.
+ * The instructions counter is the number of program lines executed by running
+ * programs, whether interpreted or compiled by raw2cc; commands executed from
+ * the keyboard are not counted. The allocations counter is the number of
+ * variables (reals, complex numbers, strings, matrices, and lists) that have
+ * been created, including ones taken from the core's pools of recycled
+ * objects. The errors counter is the number of times a running program was
+ * stopped by an error.
+ */
+struct core_stats_struct
+{
+    uint8 instructions;
+    uint8 allocations;
+    uint8 errors;
 };
 
-extern core_settings_struct core_settings;
+extern CORE_TLS core_stats_struct core_stats;
 
 /*******************/
 /* Keyboard repeat */
 /*******************/
 
-extern int repeating;
-extern int repeating_shift;
-extern int repeating_key;
+extern CORE_TLS int repeating;
+extern CORE_TLS int repeating_shift;
+extern CORE_TLS int repeating_key;
 
 /*******************/
 /* Other functions */
@@ -369,6 +531,10 @@ int dequeue_key();
 
 void do_interactive(int command);
 int find_builtin(const char *name, int namelen);
+/* The linear search that find_builtin() did before it had an index; kept
+ * as the reference that coretest checks find_builtin() against.
+ */
+int find_builtin_linear(const char *name, int namelen);
 
 void sst();
 void bst();
@@ -383,5 +549,9 @@ void finish_alpha_prgm_line();
 int shiftcharacter(char c);
 void set_old_pc(int4 pc);
 const char *number_format();
+/* Discards the profiler's per-line data; called whenever programs are
+ * edited, deleted, or renumbered, since that data is keyed by (prgm, pc).
+ */
+void profiler_discard_lines();
 
 #endif
@@ -62,7 +62,7 @@ struct solve_state {
     int f_gap_worsening_counter;
 };
 
-static solve_state solve;
+static CORE_TLS solve_state solve;
 
 #define ROMB_K 5
 // 1/2 million evals max!
@@ -95,7 +95,7 @@ struct integ_state {
     int prev_sp;
 };
 
-static integ_state integ;
+static CORE_TLS integ_state integ;
 
 
 static void reset_solve();
@@ -18,7 +18,7 @@
 #include "core_globals.h"
 #include "core_math2.h"
 
-phloat math_random() {
+static void random_seed_default() {
     if (random_number_low == 0 && random_number_high == 0) {
         random_number_high = 0;
         random_number_low = 2787;
@@ -27,45 +27,68 @@ phloat math_random() {
         // random_number_high = 9995003;
         // random_number_low = 33083533;
     }
+}
+
+static inline phloat random_next() {
     int8 temp = random_number_low * 30928467;
     random_number_high = (random_number_low * 28511 + random_number_high * 30928467 + temp / 100000000) % 10000000;
     random_number_low = temp % 100000000;
-    if (random_number_high >= 1000000) {
-        temp = random_number_low / 1000;
-        #ifdef BCD_MATH
-            const Phloat n1(1000000000000LL);
-            const Phloat n2(10000000);
-            return Phloat(temp) / n1 + Phloat(random_number_high) / n2;
-        #else
+    #ifdef BCD_MATH
+        // The result is random_number_high / 10^7 + random_number_low / 10^15,
+        // cut to 12 significant digits, which is exact in decimal. Build it
+        // from its integer coefficient directly, with the trailing zeros
+        // removed; that is the same number, in the same representation, that
+        // dividing and adding the two parts, as the Binary version does,
+        // would produce, but without the divisions.
+        int8 c;
+        int e;
+        if (random_number_high >= 1000000) {
+            c = random_number_high * 100000 + random_number_low / 1000;
+            e = -12;
+        } else if (random_number_high >= 100000) {
+            c = random_number_high * 1000000 + random_number_low / 100;
+            e = -13;
+        } else if (random_number_high >= 10000) {
+            c = random_number_high * 10000000 + random_number_low / 10;
+            e = -14;
+        } else {
+            c = random_number_high * 100000000 + random_number_low;
+            e = -15;
+        }
+        if (c == 0)
+            return 0;
+        while (c % 10 == 0) {
+            c /= 10;
+            e++;
+        }
+        return scalbn(Phloat(c), e);
+    #else
+        if (random_number_high >= 1000000) {
+            temp = random_number_low / 1000;
             return temp / 1000000000000.0 + random_number_high / 10000000.0;
-        #endif
-    } else if (random_number_high >= 100000) {
-        temp = random_number_low / 100;
-        #ifdef BCD_MATH
-            const Phloat n1(10000000000000LL);
-            const Phloat n2(10000000);
-            return Phloat(temp) / n1 + Phloat(random_number_high) / n2;
-        #else
+        } else if (random_number_high >= 100000) {
+            temp = random_number_low / 100;
             return temp / 10000000000000.0 + random_number_high / 10000000.0;
-        #endif
-    } else if (random_number_high >= 10000) {
-        temp = random_number_low / 10;
-        #ifdef BCD_MATH
-            const Phloat n1(100000000000000LL);
-            const Phloat n2(10000000);
-            return Phloat(temp) / n1 + Phloat(random_number_high) / n2;
-        #else
+        } else if (random_number_high >= 10000) {
+            temp = random_number_low / 10;
             return temp / 100000000000000.0 + random_number_high / 10000000.0;
-        #endif
-    } else {
-        #ifdef BCD_MATH
-            const Phloat n1(1000000000000000LL);
-            const Phloat n2(10000000);
-            return Phloat(random_number_low) / n1 + Phloat(random_number_high) / n2;
-        #else
+        } else {
             return random_number_low / 1000000000000000.0 + random_number_high / 10000000.0;
-        #endif
-    }
+        }
+    #endif
+}
+
+phloat math_random() {
+    random_seed_default();
+    return random_next();
+}
+
+void math_random_fill(phloat *data, int4 n) {
+    // The generator never returns to the all-zero state, so the default
+    // seed only needs to be checked once
+    random_seed_default();
+    for (int4 i = 0; i < n; i++)
+        data[i] = random_next();
 }
 
 int math_tan(phloat x, phloat *y, bool rad) {
@@ -88,9 +111,9 @@ int math_tan(phloat x, phloat *y, bool rad) {
         }
         // to improve accuracy for x close to 100gon
         if (x > 89)
-            *y = 1 / tan((100 - x) / (200 / PI));
+            *y = 1 / tan((100 - x) / GRAD_PER_RAD_PHLOAT);
         else
-            *y = tan(x / (200 / PI));
+            *y = tan(x / GRAD_PER_RAD_PHLOAT);
         if (neg)
             *y = -(*y);
     } else {
@@ -110,9 +133,9 @@ int math_tan(phloat x, phloat *y, bool rad) {
         }
         // to improve accuracy for x close to 90°
         if (x > 80)
-            *y = 1 / tan((90 - x) / (180 / PI));
+            *y = 1 / tan((90 - x) / DEG_PER_RAD_PHLOAT);
         else
-            *y = tan(x / (180 / PI));
+            *y = tan(x / DEG_PER_RAD_PHLOAT);
         if (neg)
             *y = -(*y);
     }
@@ -21,6 +21,8 @@
 #include "core_phloat.h"
 
 phloat math_random();
+// Stores the next n values that math_random() would return in data[]
+void math_random_fill(phloat *data, int4 n);
 int math_tan(phloat x, phloat *y, bool rad);
 int math_asinh(phloat xre, phloat xim, phloat *yre, phloat *yim);
 int math_acosh(phloat xre, phloat xim, phloat *yre, phloat *yim);
@@ -39,6 +39,14 @@ phloat NEG_TINY_PHLOAT;
 phloat NAN_PHLOAT;
 phloat NAN_1_PHLOAT;
 phloat NAN_2_PHLOAT;
+phloat DEG_PER_RAD_PHLOAT;
+phloat GRAD_PER_RAD_PHLOAT;
+
+static CORE_TLS bool direct_conversions = true;
+
+void phloat_direct_conversions(bool enable) {
+    direct_conversions = enable;
+}
 
 
 #ifdef BCD_MATH
@@ -62,6 +70,150 @@ void phloat_init() {
     NAN_PHLOAT = nan;
     bid128_nan(&NAN_1_PHLOAT.val, "1");
     bid128_nan(&NAN_2_PHLOAT.val, "2");
+    DEG_PER_RAD_PHLOAT = 180 / PI;
+    GRAD_PER_RAD_PHLOAT = 200 / PI;
+}
+
+/* Decimal conversions
+ *
+ * Plain numbers -- an optional minus sign, at most MAX_MANT_DIGITS digits
+ * with an optional decimal point, and an optional exponent -- are converted
+ * directly to and from the BID128 coefficient and exponent, instead of going
+ * through bid128_from_string() and bid128_to_string(). Such a coefficient is
+ * always exact, so the result is encoded exactly the way the BID library
+ * would encode it, trailing zeroes and all. Anything else, including numbers
+ * whose exponents would have to be clamped, is left to the library.
+ */
+
+#define BID_EXP_BIAS 6176
+#define BID_EXP_MAX 6111
+#define BID_COEFF_HIGH_MASK 0x0001ffffffffffffULL
+// 10^34, the smallest non-canonical coefficient
+#define BID_COEFF_LIMIT_HIGH 0x0001ed09bead87c0ULL
+#define BID_COEFF_LIMIT_LOW 0x378d8e6400000000ULL
+
+static const uint8 pow10_int[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+    10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+    100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+    100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+    100000000000000000ULL
+};
+
+// hi:lo = a * b + c
+static void mul_add(uint8 a, uint8 b, uint8 c, uint8 *hi, uint8 *lo) {
+    uint8 a0 = a & 0xffffffff, a1 = a >> 32;
+    uint8 b0 = b & 0xffffffff, b1 = b >> 32;
+    uint8 p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+    uint8 mid = (p00 >> 32) + (p01 & 0xffffffff) + (p10 & 0xffffffff);
+    uint8 l = (mid << 32) | (p00 & 0xffffffff);
+    uint8 h = p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+    *lo = l + c;
+    *hi = h + (*lo < l);
+}
+
+static bool string2bid(const char *buf, int buflen, BID_UINT128 *b) {
+    char dot = flags.f.decimal_point ? '.' : ',';
+    char sep = flags.f.decimal_point ? ',' : '.';
+    int i = 0;
+    bool neg = buflen > 0 && buf[0] == '-';
+    if (neg)
+        i++;
+    // The first 17 digits go in c1, the rest in c2
+    uint8 c1 = 0, c2 = 0;
+    int digits = 0, frac_digits = 0;
+    bool seen_dot = false;
+    for (; i < buflen; i++) {
+        char c = buf[i];
+        if (c >= '0' && c <= '9') {
+            if (++digits > MAX_MANT_DIGITS)
+                return false;
+            if (digits <= 17)
+                c1 = c1 * 10 + (c - '0');
+            else
+                c2 = c2 * 10 + (c - '0');
+            if (seen_dot)
+                frac_digits++;
+        } else if (c == dot) {
+            if (seen_dot)
+                return false;
+            seen_dot = true;
+        } else if (c == 24)
+            break;
+        else if (c != sep)
+            return false;
+    }
+    if (digits == 0)
+        return false;
+    int exp = 0;
+    if (i < buflen) {
+        bool exp_neg = ++i < buflen && buf[i] == '-';
+        if (exp_neg)
+            i++;
+        int exp_digits = 0;
+        for (; i < buflen; i++) {
+            char c = buf[i];
+            if (c < '0' || c > '9' || ++exp_digits > 5)
+                return false;
+            exp = exp * 10 + (c - '0');
+        }
+        if (exp_neg)
+            exp = -exp;
+    }
+    exp -= frac_digits;
+    if (exp < -BID_EXP_BIAS || exp > BID_EXP_MAX)
+        return false;
+    uint8 hi, lo;
+    if (digits <= 17) {
+        hi = 0;
+        lo = c1;
+    } else
+        mul_add(c1, pow10_int[digits - 17], c2, &hi, &lo);
+    b->w[BID_HIGH_128W] = hi | (uint8) (exp + BID_EXP_BIAS) << 49
+                             | (neg ? 0x8000000000000000ULL : 0);
+    b->w[BID_LOW_128W] = lo;
+    return true;
+}
+
+/* Returns the significant digits of v in 'mantissa', and the exponent of the
+ * first one in 'exponent'; zero gets no digits, and exponent 0.
+ */
+static bool phloat2digits(const phloat &v, char *mantissa, int *exponent, int *sign) {
+    uint8 hi = v.val.w[BID_HIGH_128W];
+    uint8 lo = v.val.w[BID_LOW_128W];
+    // Infinities, NaNs, and non-canonical encodings
+    if ((hi & 0x6000000000000000ULL) == 0x6000000000000000ULL)
+        return false;
+    int exp = (int) ((hi >> 49) & 0x3fff) - BID_EXP_BIAS;
+    *sign = (int) (hi >> 63);
+    hi &= BID_COEFF_HIGH_MASK;
+    if (hi > BID_COEFF_LIMIT_HIGH || hi == BID_COEFF_LIMIT_HIGH && lo >= BID_COEFF_LIMIT_LOW)
+        return false;
+    // Divide the coefficient by 10^9 repeatedly, in 32-bit limbs
+    uint4 limb[4] = { (uint4) (hi >> 32), (uint4) hi, (uint4) (lo >> 32), (uint4) lo };
+    char digits[36];
+    int n = 36;
+    while (limb[0] != 0 || limb[1] != 0 || limb[2] != 0 || limb[3] != 0) {
+        uint8 r = 0;
+        for (int i = 0; i < 4; i++) {
+            uint8 cur = r << 32 | limb[i];
+            limb[i] = (uint4) (cur / 1000000000);
+            r = cur % 1000000000;
+        }
+        for (int i = 0; i < 9; i++) {
+            digits[--n] = (char) (r % 10);
+            r /= 10;
+        }
+    }
+    while (n < 36 && digits[n] == 0)
+        n++;
+    if (n == 36) {
+        *exponent = 0;
+        return true;
+    }
+    memcpy(mantissa, digits + n, 36 - n);
+    *exponent = exp + 35 - n;
+    return true;
 }
 
 int string2phloat(const char *buf, int buflen, phloat *d) {
@@ -82,6 +234,12 @@ int string2phloat(const char *buf, int buflen, phloat *d) {
         return 0;
     }
 
+    BID_UINT128 b;
+    if (direct_conversions && string2bid(buf, buflen, &b)) {
+        *d = b;
+        return 0;
+    }
+
     // Strip thousands separators, convert comma to dot if
     // appropriate, and convert char(24) to 'E'.
     // Also, reject numbers with more than MAX_MANT_DIGITS digits in the mantissa.
@@ -130,7 +288,6 @@ int string2phloat(const char *buf, int buflen, phloat *d) {
         buf2[buflen2++] = '0';
 
     buf2[buflen2] = 0;
-    BID_UINT128 b;
     bid128_from_string(&b, buf2);
     int r;
     if (bid128_isInf(&r, &b), r)
@@ -141,6 +298,49 @@ int string2phloat(const char *buf, int buflen, phloat *d) {
     return 0;
 }
 
+/* Small integers
+ *
+ * Integers with an exponent of zero and a coefficient below 2^31, which is
+ * what bid128_from_int32() produces, and what the arithmetic operators keep
+ * producing as long as the results are exact integers, are handled with
+ * plain integer arithmetic. The results are encoded exactly the way the
+ * BID library would encode them, including the signs of zeros, assuming
+ * round-to-nearest, which is the only rounding mode Free42 uses.
+ */
+
+#define SMALL_INT_HIGH (6176ULL << 49) // Biased exponent 0, coefficient < 2^49
+#define SMALL_INT_MAX 0x7fffffffULL
+
+static inline bool small_int(const BID_UINT128 &v, int8 *n, bool *neg) {
+    BID_UINT64 hi = v.w[BID_HIGH_128W];
+    BID_UINT64 lo = v.w[BID_LOW_128W];
+    if ((hi & 0x7fffffffffffffffULL) != SMALL_INT_HIGH || lo > SMALL_INT_MAX)
+        return false;
+    *neg = (hi >> 63) != 0;
+    *n = *neg ? -(int8) lo : (int8) lo;
+    return true;
+}
+
+static inline void make_int(BID_UINT128 *r, int8 n, bool neg) {
+    if (n < 0) {
+        neg = true;
+        n = -n;
+    } else if (n > 0)
+        neg = false;
+    r->w[BID_HIGH_128W] = SMALL_INT_HIGH | (neg ? 0x8000000000000000ULL : 0);
+    r->w[BID_LOW_128W] = (BID_UINT64) n;
+}
+
+/* public */
+bool Phloat::is_small_int(int4 *i) const {
+    int8 n;
+    bool neg;
+    if (!small_int(val, &n, &neg))
+        return false;
+    *i = (int4) n;
+    return true;
+}
+
 /* public */
 Phloat::Phloat(const char *str) {
     bid128_from_string(&val, (char *) str);
@@ -164,7 +364,7 @@ Phloat::Phloat(int8 numer, int8 denom) {
 
 /* public */
 Phloat::Phloat(int i) {
-    bid128_from_int32(&val, &i);
+    make_int(&val, i, false);
 }
 
 /* public */
@@ -185,42 +385,31 @@ Phloat::Phloat(double d) {
 }
 
 /* public */
-Phloat::Phloat(const Phloat &p) {
-    val = p.val;
-}
-
-/* public */
-Phloat Phloat::operator=(int i) {
-    bid128_from_int32(&val, &i);
+Phloat &Phloat::operator=(int i) {
+    make_int(&val, i, false);
     return *this;
 }
 
 /* public */
-Phloat Phloat::operator=(int8 i) {
+Phloat &Phloat::operator=(int8 i) {
     bid128_from_int64(&val, &i);
     return *this;
 }
 
 /* public */
-Phloat Phloat::operator=(uint8 i) {
+Phloat &Phloat::operator=(uint8 i) {
     bid128_from_uint64(&val, &i);
     return *this;
 }
 
 /* public */
-Phloat Phloat::operator=(double d) {
+Phloat &Phloat::operator=(double d) {
     BID_UINT64 tmp;
     binary64_to_bid64(&tmp, &d);
     bid64_to_bid128(&val, &tmp);
     return *this;
 }
 
-/* public */
-Phloat Phloat::operator=(Phloat p) {
-    val = p.val;
-    return *this;
-}
-
 /* public */
 void Phloat::assign17digits(double d) {
     if (isinf(d) || isnan(d)) {
@@ -236,44 +425,68 @@ void Phloat::assign17digits(double d) {
 }
 
 /* public */
-bool Phloat::operator==(Phloat p) const {
+bool Phloat::operator==(const Phloat &p) const {
+    int8 a, b;
+    bool an, bn;
+    if (small_int(val, &a, &an) && small_int(p.val, &b, &bn))
+        return a == b;
     int r;
-    bid128_quiet_equal(&r, (BID_UINT128 *) &val, &p.val);
+    bid128_quiet_equal(&r, (BID_UINT128 *) &val, (BID_UINT128 *) &p.val);
     return r != 0;
 }
 
 /* public */
-bool Phloat::operator!=(Phloat p) const {
+bool Phloat::operator!=(const Phloat &p) const {
+    int8 a, b;
+    bool an, bn;
+    if (small_int(val, &a, &an) && small_int(p.val, &b, &bn))
+        return a != b;
     int r;
-    bid128_quiet_not_equal(&r, (BID_UINT128 *) &val, &p.val);
+    bid128_quiet_not_equal(&r, (BID_UINT128 *) &val, (BID_UINT128 *) &p.val);
     return r != 0;
 }
 
 /* public */
-bool Phloat::operator<(Phloat p) const {
+bool Phloat::operator<(const Phloat &p) const {
+    int8 a, b;
+    bool an, bn;
+    if (small_int(val, &a, &an) && small_int(p.val, &b, &bn))
+        return a < b;
     int r;
-    bid128_quiet_less(&r, (BID_UINT128 *) &val, &p.val);
+    bid128_quiet_less(&r, (BID_UINT128 *) &val, (BID_UINT128 *) &p.val);
     return r != 0;
 }
 
 /* public */
-bool Phloat::operator<=(Phloat p) const {
+bool Phloat::operator<=(const Phloat &p) const {
+    int8 a, b;
+    bool an, bn;
+    if (small_int(val, &a, &an) && small_int(p.val, &b, &bn))
+        return a <= b;
     int r;
-    bid128_quiet_less_equal(&r, (BID_UINT128 *) &val, &p.val);
+    bid128_quiet_less_equal(&r, (BID_UINT128 *) &val, (BID_UINT128 *) &p.val);
     return r != 0;
 }
 
 /* public */
-bool Phloat::operator>(Phloat p) const {
+bool Phloat::operator>(const Phloat &p) const {
+    int8 a, b;
+    bool an, bn;
+    if (small_int(val, &a, &an) && small_int(p.val, &b, &bn))
+        return a > b;
     int r;
-    bid128_quiet_greater(&r, (BID_UINT128 *) &val, &p.val);
+    bid128_quiet_greater(&r, (BID_UINT128 *) &val, (BID_UINT128 *) &p.val);
     return r != 0;
 }
 
 /* public */
-bool Phloat::operator>=(Phloat p) const {
+bool Phloat::operator>=(const Phloat &p) const {
+    int8 a, b;
+    bool an, bn;
+    if (small_int(val, &a, &an) && small_int(p.val, &b, &bn))
+        return a >= b;
     int r;
-    bid128_quiet_greater_equal(&r, (BID_UINT128 *) &val, &p.val);
+    bid128_quiet_greater_equal(&r, (BID_UINT128 *) &val, (BID_UINT128 *) &p.val);
     return r != 0;
 }
 
@@ -285,74 +498,85 @@ Phloat Phloat::operator-() const {
 }
 
 /* public */
-Phloat Phloat::operator*(Phloat p) const {
+Phloat Phloat::operator*(const Phloat &p) const {
     BID_UINT128 res;
-    bid128_mul(&res, (BID_UINT128 *) &val, &p.val);
+    int8 a, b;
+    bool an, bn;
+    if (small_int(val, &a, &an) && small_int(p.val, &b, &bn)) {
+        make_int(&res, a * b, an != bn);
+        return Phloat(res);
+    }
+    bid128_mul(&res, (BID_UINT128 *) &val, (BID_UINT128 *) &p.val);
     return Phloat(res);
 }
 
 /* public */
-Phloat Phloat::operator/(Phloat p) const {
+Phloat Phloat::operator/(const Phloat &p) const {
     BID_UINT128 res;
-    bid128_div(&res, (BID_UINT128 *) &val, &p.val);
+    int8 a, b;
+    bool an, bn;
+    if (small_int(val, &a, &an) && small_int(p.val, &b, &bn) && b != 0 && a % b == 0) {
+        make_int(&res, a / b, an != bn);
+        return Phloat(res);
+    }
+    bid128_div(&res, (BID_UINT128 *) &val, (BID_UINT128 *) &p.val);
     return Phloat(res);
 }
 
 /* public */
-Phloat Phloat::operator+(Phloat p) const {
+Phloat Phloat::operator+(const Phloat &p) const {
     BID_UINT128 res;
-    bid128_add(&res, (BID_UINT128 *) &val, &p.val);
+    int8 a, b;
+    bool an, bn;
+    if (small_int(val, &a, &an) && small_int(p.val, &b, &bn)) {
+        make_int(&res, a + b, an && bn);
+        return Phloat(res);
+    }
+    bid128_add(&res, (BID_UINT128 *) &val, (BID_UINT128 *) &p.val);
     return Phloat(res);
 }
 
 /* public */
-Phloat Phloat::operator-(Phloat p) const {
+Phloat Phloat::operator-(const Phloat &p) const {
     BID_UINT128 res;
-    bid128_sub(&res, (BID_UINT128 *) &val, &p.val);
+    int8 a, b;
+    bool an, bn;
+    if (small_int(val, &a, &an) && small_int(p.val, &b, &bn)) {
+        make_int(&res, a - b, an && !bn);
+        return Phloat(res);
+    }
+    bid128_sub(&res, (BID_UINT128 *) &val, (BID_UINT128 *) &p.val);
     return Phloat(res);
 }
 
 /* public */
-Phloat Phloat::operator*=(Phloat p) {
-    BID_UINT128 res;
-    bid128_mul(&res, &val, &p.val);
-    val = res;
+Phloat &Phloat::operator*=(const Phloat &p) {
+    *this = *this * p;
     return *this;
 }
 
 /* public */
-Phloat Phloat::operator/=(Phloat p) {
-    BID_UINT128 res;
-    bid128_div(&res, &val, &p.val);
-    val = res;
+Phloat &Phloat::operator/=(const Phloat &p) {
+    *this = *this / p;
     return *this;
 }
 
 /* public */
-Phloat Phloat::operator+=(Phloat p) {
-    BID_UINT128 res;
-    bid128_add(&res, &val, &p.val);
-    val = res;
+Phloat &Phloat::operator+=(const Phloat &p) {
+    *this = *this + p;
     return *this;
 }
 
 /* public */
-Phloat Phloat::operator-=(Phloat p) {
-    BID_UINT128 res;
-    bid128_sub(&res, &val, &p.val);
-    val = res;
+Phloat &Phloat::operator-=(const Phloat &p) {
+    *this = *this - p;
     return *this;
 }
 
 /* public */
-Phloat Phloat::operator++() {
+Phloat &Phloat::operator++() {
     // prefix
-    BID_UINT128 one;
-    int d1 = 1;
-    bid128_from_int32(&one, &d1);
-    BID_UINT128 temp;
-    bid128_add(&temp, &val, &one);
-    val = temp;
+    *this = *this + 1;
     return *this;
 }
 
@@ -360,22 +584,14 @@ Phloat Phloat::operator++() {
 Phloat Phloat::operator++(int) {
     // postfix
     Phloat old = *this;
-    BID_UINT128 one;
-    int d1 = 1;
-    bid128_from_int32(&one, &d1);
-    bid128_add(&val, &old.val, &one);
+    *this = old + 1;
     return old;
 }
 
 /* public */
-Phloat Phloat::operator--() {
+Phloat &Phloat::operator--() {
     // prefix
-    BID_UINT128 one;
-    int d1 = 1;
-    bid128_from_int32(&one, &d1);
-    BID_UINT128 temp;
-    bid128_sub(&temp, &val, &one);
-    val = temp;
+    *this = *this - 1;
     return *this;
 }
 
@@ -383,41 +599,41 @@ Phloat Phloat::operator--() {
 Phloat Phloat::operator--(int) {
     // postfix
     Phloat old = *this;
-    BID_UINT128 one;
-    int d1 = 1;
-    bid128_from_int32(&one, &d1);
-    bid128_sub(&val, &old.val, &one);
+    *this = old - 1;
     return old;
 }
 
-int p_isinf(Phloat p) {
+int p_isinf(const Phloat &p) {
     int r;
-    if (bid128_isInf(&r, &p.val), r)
-        return (bid128_isSigned(&r, &p.val), r) ? -1 : 1;
+    if (bid128_isInf(&r, (BID_UINT128 *) &p.val), r)
+        return (bid128_isSigned(&r, (BID_UINT128 *) &p.val), r) ? -1 : 1;
     else
         return 0;
 }
 
-int p_isnan(Phloat p) {
+int p_isnan(const Phloat &p) {
     int r;
-    bid128_isNaN(&r, &p.val);
+    bid128_isNaN(&r, (BID_UINT128 *) &p.val);
     return r;
 }
 
-int p_isnormal(Phloat p) {
+int p_isnormal(const Phloat &p) {
     int r;
-    bid128_isNormal(&r, &p.val);
+    bid128_isNormal(&r, (BID_UINT128 *) &p.val);
     return r;
 }
 
-int to_digit(Phloat p) {
+int to_digit(const Phloat &p) {
+    int8 n;
+    bool neg;
+    if (small_int(p.val, &n, &neg))
+        return (int) (n % 10);
     BID_UINT128 ten, res;
-    int d10 = 10;
     int ires;
-    bid128_from_int32(&ten, &d10);
-    bid128_rem(&res, &p.val, &ten);
+    make_int(&ten, 10, false);
+    bid128_rem(&res, (BID_UINT128 *) &p.val, &ten);
     int numer_sign, res_sign;
-    bid128_isSigned(&numer_sign, &p.val);
+    bid128_isSigned(&numer_sign, (BID_UINT128 *) &p.val);
     bid128_isSigned(&res_sign, &res);
     if (numer_sign ^ res_sign) {
         BID_UINT128 r2;
@@ -431,205 +647,489 @@ int to_digit(Phloat p) {
     return ires;
 }
 
-char to_char(Phloat p) {
+char to_char(const Phloat &p) {
+    int8 n;
+    bool neg;
+    if (small_int(p.val, &n, &neg))
+        return (char) n;
     int4 res;
-    bid128_to_int32_xint(&res, &p.val);
+    bid128_to_int32_xint(&res, (BID_UINT128 *) &p.val);
     return (char) res;
 }
 
-int to_int(Phloat p) {
+int to_int(const Phloat &p) {
+    int8 n;
+    bool neg;
+    if (small_int(p.val, &n, &neg))
+        return (int) n;
     int4 res;
-    bid128_to_int32_xint(&res, &p.val);
+    bid128_to_int32_xint(&res, (BID_UINT128 *) &p.val);
     return (int) res;
 }
 
-int4 to_int4(Phloat p) {
+int4 to_int4(const Phloat &p) {
+    int8 n;
+    bool neg;
+    if (small_int(p.val, &n, &neg))
+        return (int4) n;
     int4 res;
-    bid128_to_int32_xint(&res, &p.val);
+    bid128_to_int32_xint(&res, (BID_UINT128 *) &p.val);
     return res;
 }
 
-int8 to_int8(Phloat p) {
+int8 to_int8(const Phloat &p) {
+    int8 n;
+    bool neg;
+    if (small_int(p.val, &n, &neg))
+        return (int8) n;
     int8 res;
-    bid128_to_int64_xint(&res, &p.val);
+    bid128_to_int64_xint(&res, (BID_UINT128 *) &p.val);
     return res;
 }
 
-uint8 to_uint8(Phloat p) {
+uint8 to_uint8(const Phloat &p) {
     uint8 res;
-    bid128_to_uint64_xint(&res, &p.val);
+    bid128_to_uint64_xint(&res, (BID_UINT128 *) &p.val);
     return res;
 }
 
-double to_double(Phloat p) {
+double to_double(const Phloat &p) {
     double res;
-    bid128_to_binary64(&res, &p.val);
+    bid128_to_binary64(&res, (BID_UINT128 *) &p.val);
     return res;
 }
 
-Phloat sin(Phloat p) {
+bool to_doubles(const Phloat *src, double *dst, int4 n) {
+    for (int4 i = 0; i < n; i++) {
+        double d;
+        bid128_to_binary64(&d, (BID_UINT128 *) &src[i].val);
+        if (d == 0) {
+            int r;
+            bid128_isZero(&r, (BID_UINT128 *) &src[i].val);
+            if (r == 0)
+                return false;
+        } else if (!(fabs(d) >= 1e-154 && fabs(d) <= 1e154))
+            return false;
+        dst[i] = d;
+    }
+    return true;
+}
+
+void from_doubles(const double *src, Phloat *dst, int4 n) {
+    for (int4 i = 0; i < n; i++)
+        dst[i] = Phloat(src[i]);
+}
+
+/* Transcendental function cache
+ *
+ * While SOLVE or INTEG is running, the results of the transcendental
+ * functions are remembered in a small direct-mapped cache, keyed by the
+ * function and the exact bits of its arguments, because the functions they
+ * call tend to evaluate the same arguments over and over: the solver retries
+ * points, the integrator's sample points are symmetric, and many functions
+ * have subexpressions that don't depend on the variable being solved or
+ * integrated. The BID library always rounds the same way, so a cached
+ * result is identical to a recomputed one.
+ */
+
+enum {
+    MEMO_NONE, MEMO_SIN, MEMO_COS, MEMO_TAN, MEMO_ASIN, MEMO_ACOS, MEMO_ATAN,
+    MEMO_SINH, MEMO_COSH, MEMO_TANH, MEMO_ASINH, MEMO_ACOSH, MEMO_ATANH,
+    MEMO_LOG, MEMO_LOG1P, MEMO_LOG10, MEMO_EXP, MEMO_EXPM1, MEMO_TGAMMA,
+    MEMO_POW
+};
+
+#define MEMO_SIZE 256
+
+struct memo_entry {
+    BID_UINT128 x, y, res;
+    int func;
+};
+
+static CORE_TLS memo_entry memo[MEMO_SIZE];
+static CORE_TLS bool memo_enabled = false;
+static CORE_TLS uint8 memo_hits = 0;
+static CORE_TLS uint8 memo_misses = 0;
+
+static inline memo_entry *memo_slot(int func, const BID_UINT128 &x, const BID_UINT128 &y) {
+    uint8 h = (x.w[0] ^ x.w[1] * 0x9e3779b97f4a7c15ULL) + (y.w[0] ^ y.w[1]) * 31 + func;
+    h ^= h >> 31;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 29;
+    return memo + (h & (MEMO_SIZE - 1));
+}
+
+static inline bool memo_get(int func, const BID_UINT128 &x, const BID_UINT128 &y, BID_UINT128 *res) {
+    if (!memo_enabled)
+        return false;
+    memo_entry *m = memo_slot(func, x, y);
+    if (m->func != func || m->x.w[0] != x.w[0] || m->x.w[1] != x.w[1]
+            || m->y.w[0] != y.w[0] || m->y.w[1] != y.w[1]) {
+        memo_misses++;
+        return false;
+    }
+    memo_hits++;
+    *res = m->res;
+    return true;
+}
+
+static inline void memo_put(int func, const BID_UINT128 &x, const BID_UINT128 &y, const BID_UINT128 &res) {
+    if (!memo_enabled)
+        return;
+    memo_entry *m = memo_slot(func, x, y);
+    m->func = func;
+    m->x = x;
+    m->y = y;
+    m->res = res;
+}
+
+void phloat_memo_enable(bool enable) {
+    memo_enabled = enable;
+}
+
+void phloat_memo_stats(uint8 *hits, uint8 *misses) {
+    *hits = memo_hits;
+    *misses = memo_misses;
+}
+
+void phloat_memo_reset_stats() {
+    memo_hits = 0;
+    memo_misses = 0;
+}
+
+Phloat sin(const Phloat &p) {
     BID_UINT128 res;
-    bid128_sin(&res, &p.val);
+    if (memo_get(MEMO_SIN, p.val, p.val, &res))
+        return res;
+    bid128_sin(&res, (BID_UINT128 *) &p.val);
+    memo_put(MEMO_SIN, p.val, p.val, res);
     return Phloat(res);
 }
 
-Phloat cos(Phloat p) {
+Phloat cos(const Phloat &p) {
     BID_UINT128 res;
-    bid128_cos(&res, &p.val);
+    if (memo_get(MEMO_COS, p.val, p.val, &res))
+        return res;
+    bid128_cos(&res, (BID_UINT128 *) &p.val);
+    memo_put(MEMO_COS, p.val, p.val, res);
     return Phloat(res);
 }
 
-Phloat tan(Phloat p) {
+Phloat tan(const Phloat &p) {
     BID_UINT128 res;
-    bid128_tan(&res, &p.val);
+    if (memo_get(MEMO_TAN, p.val, p.val, &res))
+        return res;
+    bid128_tan(&res, (BID_UINT128 *) &p.val);
+    memo_put(MEMO_TAN, p.val, p.val, res);
     return Phloat(res);
 }
 
-Phloat asin(Phloat p) {
+Phloat asin(const Phloat &p) {
     BID_UINT128 res;
-    bid128_asin(&res, &p.val);
+    if (memo_get(MEMO_ASIN, p.val, p.val, &res))
+        return res;
+    bid128_asin(&res, (BID_UINT128 *) &p.val);
+    memo_put(MEMO_ASIN, p.val, p.val, res);
     return Phloat(res);
 }
 
-Phloat acos(Phloat p) {
+Phloat acos(const Phloat &p) {
     if (p == -1)
         // Intel library bug work-around
         return PI;
     BID_UINT128 res;
-    bid128_acos(&res, &p.val);
+    if (memo_get(MEMO_ACOS, p.val, p.val, &res))
+        return res;
+    bid128_acos(&res, (BID_UINT128 *) &p.val);
+    memo_put(MEMO_ACOS, p.val, p.val, res);
     return Phloat(res);
 }
 
-Phloat atan(Phloat p) {
+Phloat atan(const Phloat &p) {
     BID_UINT128 res;
-    bid128_atan(&res, &p.val);
+    if (memo_get(MEMO_ATAN, p.val, p.val, &res))
+        return res;
+    bid128_atan(&res, (BID_UINT128 *) &p.val);
+    memo_put(MEMO_ATAN, p.val, p.val, res);
     return Phloat(res);
 }
 
-void p_sincos(Phloat phi, Phloat *s, Phloat *c) {
-    bid128_sin(&s->val, &phi.val);
-    bid128_cos(&c->val, &phi.val);
+void p_sincos(const Phloat &phi, Phloat *s, Phloat *c) {
+    // phi may be *s or *c, so don't store anything until we're done with it
+    BID_UINT128 sres, cres;
+    if (!memo_get(MEMO_SIN, phi.val, phi.val, &sres)) {
+        bid128_sin(&sres, (BID_UINT128 *) &phi.val);
+        memo_put(MEMO_SIN, phi.val, phi.val, sres);
+    }
+    if (!memo_get(MEMO_COS, phi.val, phi.val, &cres)) {
+        bid128_cos(&cres, (BID_UINT128 *) &phi.val);
+        memo_put(MEMO_COS, phi.val, phi.val, cres);
+    }
+    s->val = sres;
+    c->val = cres;
 }
 
-Phloat hypot(Phloat x, Phloat y) {
+Phloat hypot(const Phloat &x, const Phloat &y) {
     BID_UINT128 res;
-    bid128_hypot(&res, &x.val, &y.val);
+    bid128_hypot(&res, (BID_UINT128 *) &x.val, (BID_UINT128 *) &y.val);
     return Phloat(res);
 }
 
-Phloat atan2(Phloat x, Phloat y) {
+Phloat atan2(const Phloat &x, const Phloat &y) {
     BID_UINT128 res;
-    bid128_atan2(&res, &x.val, &y.val);
+    bid128_atan2(&res, (BID_UINT128 *) &x.val, (BID_UINT128 *) &y.val);
     return Phloat(res);
 }
 
-Phloat sinh(Phloat p) {
+Phloat sinh(const Phloat &p) {
     BID_UINT128 res;
-    bid128_sinh(&res, &p.val);
+    if (memo_get(MEMO_SINH, p.val, p.val, &res))
+        return res;
+    bid128_sinh(&res, (BID_UINT128 *) &p.val);
+    memo_put(MEMO_SINH, p.val, p.val, res);
     return Phloat(res);
 }
 
-Phloat cosh(Phloat p) {
+Phloat cosh(const Phloat &p) {
     BID_UINT128 res;
-    bid128_cosh(&res, &p.val);
+    if (memo_get(MEMO_COSH, p.val, p.val, &res))
+        return res;
+    bid128_cosh(&res, (BID_UINT128 *) &p.val);
+    memo_put(MEMO_COSH, p.val, p.val, res);
     return Phloat(res);
 }
 
-Phloat tanh(Phloat p) {
+Phloat tanh(const Phloat &p) {
     BID_UINT128 res;
-    bid128_tanh(&res, &p.val);
+    if (memo_get(MEMO_TANH, p.val, p.val, &res))
+        return res;
+    bid128_tanh(&res, (BID_UINT128 *) &p.val);
+    memo_put(MEMO_TANH, p.val, p.val, res);
     return Phloat(res);
 }
 
-Phloat asinh(Phloat p) {
+Phloat asinh(const Phloat &p) {
     BID_UINT128 res;
-    bid128_asinh(&res, &p.val);
+    if (memo_get(MEMO_ASINH, p.val, p.val, &res))
+        return res;
+    bid128_asinh(&res, (BID_UINT128 *) &p.val);
+    memo_put(MEMO_ASINH, p.val, p.val, res);
     return Phloat(res);
 }
 
-Phloat acosh(Phloat p) {
+Phloat acosh(const Phloat &p) {
     BID_UINT128 res;
-    bid128_acosh(&res, &p.val);
+    if (memo_get(MEMO_ACOSH, p.val, p.val, &res))
+        return res;
+    bid128_acosh(&res, (BID_UINT128 *) &p.val);
+    memo_put(MEMO_ACOSH, p.val, p.val, res);
     return Phloat(res);
 }
 
-Phloat atanh(Phloat p) {
+Phloat atanh(const Phloat &p) {
     BID_UINT128 res;
-    bid128_atanh(&res, &p.val);
+    if (memo_get(MEMO_ATANH, p.val, p.val, &res))
+        return res;
+    bid128_atanh(&res, (BID_UINT128 *) &p.val);
+    memo_put(MEMO_ATANH, p.val, p.val, res);
     return Phloat(res);
 }
 
-Phloat log(Phloat p) {
+Phloat log(const Phloat &p) {
     BID_UINT128 res;
-    bid128_log(&res, &p.val);
+    if (memo_get(MEMO_LOG, p.val, p.val, &res))
+        return res;
+    bid128_log(&res, (BID_UINT128 *) &p.val);
+    memo_put(MEMO_LOG, p.val, p.val, res);
     return Phloat(res);
 }
 
-Phloat log1p(Phloat p) {
+Phloat log1p(const Phloat &p) {
     BID_UINT128 res;
-    bid128_log1p(&res, &p.val);
+    if (memo_get(MEMO_LOG1P, p.val, p.val, &res))
+        return res;
+    bid128_log1p(&res, (BID_UINT128 *) &p.val);
+    memo_put(MEMO_LOG1P, p.val, p.val, res);
     return Phloat(res);
 }
 
-Phloat log10(Phloat p) {
+Phloat log10(const Phloat &p) {
     BID_UINT128 res;
-    bid128_log10(&res, &p.val);
+    if (memo_get(MEMO_LOG10, p.val, p.val, &res))
+        return res;
+    bid128_log10(&res, (BID_UINT128 *) &p.val);
+    memo_put(MEMO_LOG10, p.val, p.val, res);
     return Phloat(res);
 }
 
-Phloat exp(Phloat p) {
+Phloat exp(const Phloat &p) {
     BID_UINT128 res;
-    bid128_exp(&res, &p.val);
+    if (memo_get(MEMO_EXP, p.val, p.val, &res))
+        return res;
+    bid128_exp(&res, (BID_UINT128 *) &p.val);
+    memo_put(MEMO_EXP, p.val, p.val, res);
     return Phloat(res);
 }
 
-Phloat expm1(Phloat p) {
+Phloat expm1(const Phloat &p) {
     BID_UINT128 res;
-    bid128_expm1(&res, &p.val);
+    if (memo_get(MEMO_EXPM1, p.val, p.val, &res))
+        return res;
+    bid128_expm1(&res, (BID_UINT128 *) &p.val);
+    memo_put(MEMO_EXPM1, p.val, p.val, res);
     return Phloat(res);
 }
 
-Phloat tgamma(Phloat p) {
+Phloat tgamma(const Phloat &p) {
     BID_UINT128 res;
-    bid128_tgamma(&res, &p.val);
+    if (memo_get(MEMO_TGAMMA, p.val, p.val, &res))
+        return res;
+    bid128_tgamma(&res, (BID_UINT128 *) &p.val);
+    memo_put(MEMO_TGAMMA, p.val, p.val, res);
     return Phloat(res);
 }
 
-Phloat sqrt(Phloat p) {
+Phloat sqrt(const Phloat &p) {
     BID_UINT128 res;
-    bid128_sqrt(&res, &p.val);
+    bid128_sqrt(&res, (BID_UINT128 *) &p.val);
     return Phloat(res);
 }
 
-Phloat fmod(Phloat x, Phloat y) {
+Phloat fmod(const Phloat &x, const Phloat &y) {
     BID_UINT128 res;
-    bid128_rem(&res, &x.val, &y.val);
+    bid128_rem(&res, (BID_UINT128 *) &x.val, (BID_UINT128 *) &y.val);
     int numer_sign, denom_sign, res_sign;
-    bid128_isSigned(&numer_sign, &x.val);
-    bid128_isSigned(&denom_sign, &y.val);
+    bid128_isSigned(&numer_sign, (BID_UINT128 *) &x.val);
+    bid128_isSigned(&denom_sign, (BID_UINT128 *) &y.val);
     bid128_isSigned(&res_sign, &res);
     if (numer_sign ^ res_sign) {
         BID_UINT128 r2;
         if (denom_sign ^ res_sign)
-            bid128_add(&r2, &res, &y.val);
+            bid128_add(&r2, &res, (BID_UINT128 *) &y.val);
         else
-            bid128_sub(&r2, &res, &y.val);
+            bid128_sub(&r2, &res, (BID_UINT128 *) &y.val);
         return Phloat(r2);
     } else
         return Phloat(res);
 }
 
-Phloat fabs(Phloat p) {
+Phloat fabs(const Phloat &p) {
     BID_UINT128 res;
-    bid128_abs(&res, &p.val);
+    bid128_abs(&res, (BID_UINT128 *) &p.val);
     return Phloat(res);
 }
 
-Phloat pow(Phloat y, Phloat x) {
+// a = a * b, as long as the result stays below 10^34
+static bool mul_coeff(uint8 *ahi, uint8 *alo, uint8 bhi, uint8 blo) {
+    if (*ahi != 0 && bhi != 0)
+        return false;
+    uint8 hi = *ahi, lo = *alo;
+    if (bhi != 0) {
+        hi = bhi;
+        lo = blo;
+        blo = *alo;
+    }
+    uint8 phi, plo, hi2;
+    mul_add(lo, blo, 0, &phi, &plo);
+    mul_add(hi, blo, phi, &hi2, &phi);
+    if (hi2 != 0 || phi > BID_COEFF_LIMIT_HIGH
+            || phi == BID_COEFF_LIMIT_HIGH && plo >= BID_COEFF_LIMIT_LOW)
+        return false;
+    *ahi = phi;
+    *alo = plo;
+    return true;
+}
+
+/* Nonnegative integer powers of numbers with coefficients below 2^64, using
+ * integer arithmetic, for when the result is exact. The results are encoded
+ * the same way the repeated squaring in pow() encodes them: powers of ten
+ * become 1E(n*e), and anything else gets coefficient c^n and exponent n*e,
+ * just as if y had been multiplied by itself n times. When the coefficient
+ * would not fit, or the exponent is out of range, this returns false, and
+ * pow() takes over.
+ */
+static bool int_pow(const BID_UINT128 &y, int4 n, BID_UINT128 *r) {
+    uint8 hi = y.w[BID_HIGH_128W];
+    uint8 c = y.w[BID_LOW_128W];
+    if ((hi & 0x6000000000000000ULL) == 0x6000000000000000ULL
+            || (hi & BID_COEFF_HIGH_MASK) != 0)
+        return false;
+    if (c == 0) {
+        // Same as pow(): 0^0 = 1, 0^n = 0
+        make_int(r, n == 0 ? 1 : 0, false);
+        return true;
+    }
+    int8 e = (int8) ((hi >> 49) & 0x3fff) - BID_EXP_BIAS;
+    bool neg = (hi >> 63) != 0 && (n & 1) != 0;
+    int tz = 0;
+    uint8 m = c;
+    while (m % 10 == 0) {
+        m /= 10;
+        tz++;
+    }
+    // Same range check as in pow()
+    int8 scale = (e + tz) * n;
+    if (scale > 6144 || scale < -6209)
+        return false;
+    uint8 rhi = 0, rlo = 1;
+    if (m == 1)
+        e = scale;
+    else {
+        e *= n;
+        uint8 bhi = 0, blo = c;
+        while (true) {
+            if ((n & 1) != 0 && !mul_coeff(&rhi, &rlo, bhi, blo))
+                return false;
+            n >>= 1;
+            if (n == 0)
+                break;
+            if (!mul_coeff(&bhi, &blo, bhi, blo))
+                return false;
+        }
+    }
+    if (e < -BID_EXP_BIAS || e > BID_EXP_MAX)
+        return false;
+    r->w[BID_HIGH_128W] = rhi | (uint8) (e + BID_EXP_BIAS) << 49
+                              | (neg ? 0x8000000000000000ULL : 0);
+    r->w[BID_LOW_128W] = rlo;
+    return true;
+}
+
+/* Powers of ten and two, encoded the way pow() would return them: 10^n as
+ * coefficient 1 and exponent n, and 2^n as coefficient 2^n and exponent 0.
+ */
+Phloat p_pow10(int n) {
+    if (n < -BID_EXP_BIAS || n > BID_EXP_MAX)
+        return pow(Phloat(10), Phloat(n));
+    BID_UINT128 res;
+    res.w[BID_HIGH_128W] = (uint8) (n + BID_EXP_BIAS) << 49;
+    res.w[BID_LOW_128W] = 1;
+    return res;
+}
+
+Phloat p_pow2(int n) {
+    BID_UINT128 res;
+    res.w[BID_HIGH_128W] = (uint8) BID_EXP_BIAS << 49 | (n == 64 ? 1 : 0);
+    res.w[BID_LOW_128W] = n == 64 ? 0 : 1ULL << n;
+    return res;
+}
+
+static Phloat pow_uncached(const Phloat &y, const Phloat &x) {
     BID_UINT128 tmp, res;
-    bid128_round_integral_negative(&tmp, &x.val);
+    int4 n;
+    if (x.is_small_int(&n) && n >= 0) {
+        if (int_pow(y.val, n, &res))
+            return res;
+        if (n == 2 && !p_isinf(y) && !p_isnan(y)) {
+            // Inexact square: one correctly rounded multiplication, which
+            // is at least as accurate as bid128_pow(), and matches X^2
+            bid128_mul(&res, (BID_UINT128 *) &y.val, (BID_UINT128 *) &y.val);
+            return res;
+        }
+    }
+    bid128_round_integral_negative(&tmp, (BID_UINT128 *) &x.val);
     int r;
-    bid128_quiet_equal(&r, &tmp, &x.val);
+    bid128_quiet_equal(&r, &tmp, (BID_UINT128 *) &x.val);
     if (r != 0) {
         // Integral power. Use repeated squaring for these, at
         // least as long as the calculations are exact. We make sure
@@ -640,7 +1140,7 @@ Phloat pow(Phloat y, Phloat x) {
             goto inexact;
         int4 ex = to_int4(x);
         // Handle base of zero
-        bid128_isZero(&r, &y.val);
+        bid128_isZero(&r, (BID_UINT128 *) &y.val);
         if (r != 0) {
             if (ex < 0) {
                 BID_UINT128 zero;
@@ -656,10 +1156,10 @@ Phloat pow(Phloat y, Phloat x) {
         // Handle negative base
         bool result_negative;
         BID_UINT128 yy;
-        bid128_isSigned(&r, &y.val);
+        bid128_isSigned(&r, (BID_UINT128 *) &y.val);
         if (r != 0) {
             result_negative = (ex & 1) != 0;
-            bid128_negate(&yy, &y.val);
+            bid128_negate(&yy, (BID_UINT128 *) &y.val);
         } else {
             result_negative = false;
             yy = y.val;
@@ -729,84 +1229,81 @@ Phloat pow(Phloat y, Phloat x) {
         return Phloat(res);
     } else {
         inexact:
-        bid128_pow(&res, &y.val, &x.val);
+        bid128_pow(&res, (BID_UINT128 *) &y.val, (BID_UINT128 *) &x.val);
         return Phloat(res);
     }
 }
 
-Phloat floor(Phloat p) {
+Phloat pow(const Phloat &y, const Phloat &x) {
     BID_UINT128 res;
-    bid128_round_integral_negative(&res, &p.val);
+    if (memo_get(MEMO_POW, y.val, x.val, &res))
+        return res;
+    res = pow_uncached(y, x).val;
+    memo_put(MEMO_POW, y.val, x.val, res);
+    return res;
+}
+
+Phloat floor(const Phloat &p) {
+    int8 n;
+    bool neg;
+    if (small_int(p.val, &n, &neg))
+        return p;
+    BID_UINT128 res;
+    bid128_round_integral_negative(&res, (BID_UINT128 *) &p.val);
     return Phloat(res);
 }
 
-Phloat fma(Phloat x, Phloat y, Phloat z) {
+Phloat fma(const Phloat &x, const Phloat &y, const Phloat &z) {
     BID_UINT128 res;
-    bid128_fma(&res, &x.val, &y.val, &z.val);
+    bid128_fma(&res, (BID_UINT128 *) &x.val, (BID_UINT128 *) &y.val, (BID_UINT128 *) &z.val);
     return Phloat(res);
 }
 
-int ilogb(Phloat x) {
+int ilogb(const Phloat &x) {
     int res;
-    bid128_ilogb(&res, &x.val);
+    bid128_ilogb(&res, (BID_UINT128 *) &x.val);
     return res;
 }
 
-Phloat scalbn(Phloat x, int y) {
+Phloat scalbn(const Phloat &x, int y) {
     BID_UINT128 res;
-    bid128_scalbn(&res, &x.val, &y);
+    bid128_scalbn(&res, (BID_UINT128 *) &x.val, &y);
     return Phloat(res);
 }
 
-Phloat copysign(Phloat x, Phloat y) {
+Phloat copysign(const Phloat &x, const Phloat &y) {
     BID_UINT128 res;
-    bid128_copySign(&res, &x.val, &y.val);
+    bid128_copySign(&res, (BID_UINT128 *) &x.val, (BID_UINT128 *) &y.val);
     return Phloat(res);
 }
 
-Phloat operator*(int x, Phloat y) {
-    BID_UINT128 xx, res;
-    bid128_from_int32(&xx, &x);
-    bid128_mul(&res, &xx, &y.val);
-    return Phloat(res);
+Phloat operator*(int x, const Phloat &y) {
+    return Phloat(x) * y;
 }
 
-Phloat operator/(int x, Phloat y) {
-    BID_UINT128 xx, res;
-    bid128_from_int32(&xx, &x);
-    bid128_div(&res, &xx, &y.val);
-    return Phloat(res);
+Phloat operator/(int x, const Phloat &y) {
+    return Phloat(x) / y;
 }
 
-Phloat operator/(double x, Phloat y) {
+Phloat operator/(double x, const Phloat &y) {
     BID_UINT128 xx, res;
     BID_UINT64 tmp;
     binary64_to_bid64(&tmp, &x);
     bid64_to_bid128(&xx, &tmp);
-    bid128_div(&res, &xx, &y.val);
+    bid128_div(&res, &xx, (BID_UINT128 *) &y.val);
     return Phloat(res);
 }
 
-Phloat operator+(int x, Phloat y) {
-    BID_UINT128 xx, res;
-    bid128_from_int32(&xx, &x);
-    bid128_add(&res, &xx, &y.val);
-    return Phloat(res);
+Phloat operator+(int x, const Phloat &y) {
+    return Phloat(x) + y;
 }
 
-Phloat operator-(int x, Phloat y) {
-    BID_UINT128 xx, res;
-    bid128_from_int32(&xx, &x);
-    bid128_sub(&res, &xx, &y.val);
-    return Phloat(res);
+Phloat operator-(int x, const Phloat &y) {
+    return Phloat(x) - y;
 }
 
-bool operator==(int4 x, Phloat y) {
-    BID_UINT128 xx;
-    bid128_from_int32(&xx, &x);
-    int r;
-    bid128_quiet_equal(&r, &xx, &y.val);
-    return r != 0;
+bool operator==(int4 x, const Phloat &y) {
+    return Phloat(x) == y;
 }
 
 Phloat PI("3.141592653589793238462643383279503");
@@ -815,6 +1312,19 @@ Phloat PI("3.141592653589793238462643383279503");
 #else // BCD_MATH
 
 
+void phloat_memo_enable(bool enable) {
+    // Not used in the Binary build
+}
+
+void phloat_memo_stats(uint8 *hits, uint8 *misses) {
+    *hits = 0;
+    *misses = 0;
+}
+
+void phloat_memo_reset_stats() {
+    // Not used in the Binary build
+}
+
 void phloat_init() {
     POS_HUGE_PHLOAT = DBL_MAX;
     NEG_HUGE_PHLOAT = -POS_HUGE_PHLOAT;
@@ -836,6 +1346,58 @@ void phloat_init() {
 #endif
     NEG_TINY_PHLOAT = -POS_TINY_PHLOAT;
     NAN_PHLOAT = nan("");
+    DEG_PER_RAD_PHLOAT = 180 / PI;
+    GRAD_PER_RAD_PHLOAT = 200 / PI;
+}
+
+// All exactly representable as doubles
+static const double pow10_exact[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// For |n| <= 22, these are the same as what pow() returns
+phloat p_pow10(int n) {
+    if (n >= 0 && n <= 22)
+        return pow10_exact[n];
+    else if (n < 0 && n >= -22)
+        return 1 / pow10_exact[-n];
+    else
+        return pow(10.0, n);
+}
+
+phloat p_pow2(int n) {
+    return ldexp(1.0, n);
+}
+
+/* Returns the significant digits of v in 'mantissa', and the exponent of the
+ * first one in 'exponent'. Only handles integers below 10^16, which are exact
+ * in 16 digits, so they come out the same as they would from snprintf().
+ */
+static bool phloat2digits(const phloat &v, char *mantissa, int *exponent, int *sign) {
+    double d = v;
+    if (!(d > -1e16 && d < 1e16))
+        return false;
+    int8 n = (int8) d;
+    if (n != d)
+        return false;
+    *sign = d < 0;
+    if (n < 0)
+        n = -n;
+    if (n == 0) {
+        *exponent = 0;
+        return true;
+    }
+    char digits[16];
+    int nd = 0;
+    while (n != 0) {
+        digits[nd++] = (char) (n % 10);
+        n /= 10;
+    }
+    for (int i = 0; i < nd; i++)
+        mantissa[i] = digits[nd - 1 - i];
+    *exponent = nd - 1;
+    return true;
 }
 
 int string2phloat(const char *buf, int buflen, phloat *d) {
@@ -939,6 +1501,24 @@ int string2phloat(const char *buf, int buflen, phloat *d) {
      * 'exp' contains the normalized signed exponent,
      * and 'mant_sign' contains the mantissa's sign.
      */
+
+    /* With at most 15 significant digits, and a power of ten that is exact,
+     * a single multiplication or division gives the correctly rounded
+     * result, so there's no need to go through sscanf().
+     */
+    int sig_digits = mant_pos;
+    while (sig_digits > 0 && mantissa[sig_digits - 1] == 0)
+        sig_digits--;
+    int scale = exp - sig_digits + 1;
+    if (direct_conversions && sig_digits <= 15 && scale >= -22 && scale <= 22) {
+        int8 m = 0;
+        for (i = 0; i < sig_digits; i++)
+            m = m * 10 + mantissa[i];
+        res = scale >= 0 ? m * pow10_exact[scale] : m / pow10_exact[-scale];
+        *d = mant_sign ? -res : res;
+        return 0;
+    }
+
     char decstr[35];
     int pos = 0;
     if (mant_sign)
@@ -1032,11 +1612,11 @@ int phloat2string(phloat pd, char *buf, int buflen, int base_mode, int digits,
 
         phloat high, low;
         if (flags.f.base_signed) {
-            high = pow(phloat(2), wsize - 1);
+            high = p_pow2(wsize - 1);
             low = -high;
             high--;
         } else {
-            high = pow(phloat(2), wsize) - 1;
+            high = p_pow2(wsize) - 1;
             low = 0;
         }
         if (pd > high || pd < low) {
@@ -1044,7 +1624,7 @@ int phloat2string(phloat pd, char *buf, int buflen, int base_mode, int digits,
                 too_big = true;
                 phloat ipd = pd < 0 ? -floor(-pd) : floor(pd);
                 inexact = base_mode == 1 && pd != ipd;
-                phloat d = pow(phloat(2), wsize);
+                phloat d = p_pow2(wsize);
                 phloat r = fmod(ipd, d);
                 if (r < 0)
                     r += d;
@@ -1120,54 +1700,57 @@ int phloat2string(phloat pd, char *buf, int buflen, int base_mode, int digits,
     int bcd_exponent = 0;
     int bcd_mantissa_sign = 0;
 
-    char decstr[50];
+    if (!direct_conversions
+            || !phloat2digits(pd, bcd_mantissa, &bcd_exponent, &bcd_mantissa_sign)) {
+        char decstr[50];
 
 #ifndef BCD_MATH
-    double d = to_double(pd);
-    snprintf(decstr, 50, "%.*e", MAX_MANT_DIGITS - 2, d);
-    double d2;
-    if (sscanf(decstr, "%le", &d2) != 1 || d != d2)
-        snprintf(decstr, 50, "%.*e", MAX_MANT_DIGITS - 1, d);
+        double d = to_double(pd);
+        snprintf(decstr, 50, "%.*e", MAX_MANT_DIGITS - 2, d);
+        double d2;
+        if (sscanf(decstr, "%le", &d2) != 1 || d != d2)
+            snprintf(decstr, 50, "%.*e", MAX_MANT_DIGITS - 1, d);
 #else
-    bid128_to_string(decstr, &pd.val);
+        bid128_to_string(decstr, &pd.val);
 #endif
 
-    char *p = decstr;
-    int mant_index = 0;
-    bcd_mantissa_sign = 0;
-    bool seen_dot = false;
-    bool in_leading_zeroes = true;
-    int exp_offset = -1;
+        char *p = decstr;
+        int mant_index = 0;
+        bcd_mantissa_sign = 0;
+        bool seen_dot = false;
+        bool in_leading_zeroes = true;
+        int exp_offset = -1;
 
-    while (*p != 0) {
-        char c = *p++;
-        if (c == '-') {
-            bcd_mantissa_sign = 1;
-            continue;
-        }
-        if (c == '+')
-            continue;
-        if (c == '.') {
-            seen_dot = true;
-            continue;
-        }
-        if (c == 'e' || c == 'E') {
-            if (!in_leading_zeroes) {
-                sscanf(p, "%d", &bcd_exponent);
-                bcd_exponent += exp_offset;
+        while (*p != 0) {
+            char c = *p++;
+            if (c == '-') {
+                bcd_mantissa_sign = 1;
+                continue;
             }
-            break;
-        }
-        // Can only be decimal digit at this point
-        if (c == '0') {
-            if (in_leading_zeroes)
+            if (c == '+')
                 continue;
-        } else
-            in_leading_zeroes = false;
-        if (!seen_dot)
-            exp_offset++;
-        if (mant_index < MAX_MANT_DIGITS)
-            bcd_mantissa[mant_index++] = c - '0';
+            if (c == '.') {
+                seen_dot = true;
+                continue;
+            }
+            if (c == 'e' || c == 'E') {
+                if (!in_leading_zeroes) {
+                    sscanf(p, "%d", &bcd_exponent);
+                    bcd_exponent += exp_offset;
+                }
+                break;
+            }
+            // Can only be decimal digit at this point
+            if (c == '0') {
+                if (in_leading_zeroes)
+                    continue;
+            } else
+                in_leading_zeroes = false;
+            if (!seen_dot)
+                exp_offset++;
+            if (mant_index < MAX_MANT_DIGITS)
+                bcd_mantissa[mant_index++] = c - '0';
+        }
     }
 
     int max_int_digits = max_mant_digits;
@@ -30,7 +30,7 @@
 
 #ifdef BCD_MATH
 #define MAX_MANT_DIGITS 34
-#define ALWAYS_INT_FROM (pow(10, MAX_MANT_DIGITS))
+#define ALWAYS_INT_FROM (p_pow10(MAX_MANT_DIGITS))
 #else
 #define MAX_MANT_DIGITS 17
 #define ALWAYS_INT_FROM ((double) (1LL << 53))
@@ -54,6 +54,13 @@
 #define to_uint8(x) ((uint8) (x))
 #define to_double(x) ((double) (x))
 
+static inline bool is_small_int(double x, int4 *i) {
+    if (!(x >= -2147483647.0 && x <= 2147483647.0) || x != (int4) x)
+        return false;
+    *i = (int4) x;
+    return true;
+}
+
 #define PI 3.1415926535897932384626433
 #define P 7
 
@@ -69,6 +76,8 @@ class Phloat {
     public:
         BID_UINT128 val;
 
+        // Phloat is trivially copyable, so copies are plain 16-byte moves,
+        // and arrays of them can be moved with memcpy() and realloc().
         Phloat() {}
         Phloat(const BID_UINT128 &b) : val(b) {}
         Phloat(const char *str);
@@ -78,40 +87,47 @@ class Phloat {
         Phloat(int8 i);
         Phloat(uint8 i);
         Phloat(double d);
-        Phloat(const Phloat &p);
-        Phloat operator=(const BID_UINT128 &b) { val = b; return *this; }
-        Phloat operator=(int i);
-        Phloat operator=(int8 i);
-        Phloat operator=(uint8 i);
-        Phloat operator=(double d);
-        Phloat operator=(Phloat p);
+        Phloat(const Phloat &p) = default;
+        Phloat &operator=(const BID_UINT128 &b) { val = b; return *this; }
+        Phloat &operator=(int i);
+        Phloat &operator=(int8 i);
+        Phloat &operator=(uint8 i);
+        Phloat &operator=(double d);
+        Phloat &operator=(const Phloat &p) = default;
         void assign17digits(double d);
-        bool operator==(Phloat p) const;
-        bool operator!=(Phloat p) const;
-        bool operator<(Phloat p) const;
-        bool operator<=(Phloat p) const;
-        bool operator>(Phloat p) const;
-        bool operator>=(Phloat p) const;
+        bool is_small_int(int4 *i) const;
+        bool operator==(const Phloat &p) const;
+        bool operator!=(const Phloat &p) const;
+        bool operator<(const Phloat &p) const;
+        bool operator<=(const Phloat &p) const;
+        bool operator>(const Phloat &p) const;
+        bool operator>=(const Phloat &p) const;
         Phloat operator-() const;
-        Phloat operator*(Phloat p) const;
-        Phloat operator/(Phloat p) const;
-        Phloat operator+(Phloat p) const;
-        Phloat operator-(Phloat p) const;
-        Phloat operator*=(Phloat p);
-        Phloat operator/=(Phloat p);
-        Phloat operator+=(Phloat p);
-        Phloat operator-=(Phloat p);
-        Phloat operator++(); // prefix
+        Phloat operator*(const Phloat &p) const;
+        Phloat operator/(const Phloat &p) const;
+        Phloat operator+(const Phloat &p) const;
+        Phloat operator-(const Phloat &p) const;
+        Phloat &operator*=(const Phloat &p);
+        Phloat &operator/=(const Phloat &p);
+        Phloat &operator+=(const Phloat &p);
+        Phloat &operator-=(const Phloat &p);
+        Phloat &operator++(); // prefix
         Phloat operator++(int); // postfix
-        Phloat operator--(); // prefix
+        Phloat &operator--(); // prefix
         Phloat operator--(int); // postfix
 };
 
 // I can't simply overload isinf() and isnan(), because the Linux math.h
 // defines them as macros.
-int p_isinf(Phloat p);
-int p_isnan(Phloat p);
-int p_isnormal(Phloat p);
+int p_isinf(const Phloat &p);
+int p_isnan(const Phloat &p);
+int p_isnormal(const Phloat &p);
+
+// Quick check for integers in the int4 range, which get special treatment
+// by the arithmetic operators. This may return false for some integers that
+// aren't stored in their simplest form, like 1E3, so callers must be able to
+// handle those the slow way.
+inline bool is_small_int(const Phloat &p, int4 *i) { return p.is_small_int(i); }
 
 // We don't define type cast operators, because they just lead
 // to tons of ambiguities. Defining explicit conversions instead.
@@ -119,51 +135,57 @@ int p_isnormal(Phloat p);
 // converted actually fits in the returned type; if not, the result
 // is undefined, except for to_char(), which will handle the range
 // -128..255 correctly.
-int to_digit(Phloat p); // Returns digit in units position
-char to_char(Phloat p);
-int to_int(Phloat p);
-int4 to_int4(Phloat p);
-int8 to_int8(Phloat p);
-uint8 to_uint8(Phloat p);
-double to_double(Phloat p);
-
-Phloat sin(Phloat p);
-Phloat cos(Phloat p);
-Phloat tan(Phloat p);
-Phloat asin(Phloat p);
-Phloat acos(Phloat p);
-Phloat atan(Phloat p);
-void p_sincos(Phloat phi, Phloat *s, Phloat *c);
-Phloat hypot(Phloat x, Phloat y);
-Phloat atan2(Phloat x, Phloat y);
-Phloat sinh(Phloat p);
-Phloat cosh(Phloat p);
-Phloat tanh(Phloat p);
-Phloat asinh(Phloat p);
-Phloat acosh(Phloat p);
-Phloat atanh(Phloat p);
-Phloat log(Phloat p);
-Phloat log1p(Phloat p);
-Phloat log10(Phloat p);
-Phloat exp(Phloat p);
-Phloat expm1(Phloat p);
-Phloat tgamma(Phloat p);
-Phloat sqrt(Phloat p);
-Phloat fmod(Phloat x, Phloat y);
-Phloat fabs(Phloat p);
-Phloat pow(Phloat x, Phloat y);
-Phloat floor(Phloat x);
-Phloat fma(Phloat x, Phloat y, Phloat z);
-int ilogb(Phloat x);
-Phloat scalbn(Phloat x, int y);
-Phloat copysign(Phloat x, Phloat y);
-
-Phloat operator*(int x, Phloat y);
-Phloat operator/(int x, Phloat y);
-Phloat operator/(double x, Phloat y);
-Phloat operator+(int x, Phloat y);
-Phloat operator-(int x, Phloat y);
-bool operator==(int4 x, Phloat y);
+int to_digit(const Phloat &p); // Returns digit in units position
+char to_char(const Phloat &p);
+int to_int(const Phloat &p);
+int4 to_int4(const Phloat &p);
+int8 to_int8(const Phloat &p);
+uint8 to_uint8(const Phloat &p);
+double to_double(const Phloat &p);
+// Array conversions for the binary engine; see core_settings in core_main.h.
+// to_doubles() returns false if any of the numbers is nonzero and outside
+// 1e-154..1e154, the range where products of two doubles can't overflow or
+// underflow.
+bool to_doubles(const Phloat *src, double *dst, int4 n);
+void from_doubles(const double *src, Phloat *dst, int4 n);
+
+Phloat sin(const Phloat &p);
+Phloat cos(const Phloat &p);
+Phloat tan(const Phloat &p);
+Phloat asin(const Phloat &p);
+Phloat acos(const Phloat &p);
+Phloat atan(const Phloat &p);
+void p_sincos(const Phloat &phi, Phloat *s, Phloat *c);
+Phloat hypot(const Phloat &x, const Phloat &y);
+Phloat atan2(const Phloat &x, const Phloat &y);
+Phloat sinh(const Phloat &p);
+Phloat cosh(const Phloat &p);
+Phloat tanh(const Phloat &p);
+Phloat asinh(const Phloat &p);
+Phloat acosh(const Phloat &p);
+Phloat atanh(const Phloat &p);
+Phloat log(const Phloat &p);
+Phloat log1p(const Phloat &p);
+Phloat log10(const Phloat &p);
+Phloat exp(const Phloat &p);
+Phloat expm1(const Phloat &p);
+Phloat tgamma(const Phloat &p);
+Phloat sqrt(const Phloat &p);
+Phloat fmod(const Phloat &x, const Phloat &y);
+Phloat fabs(const Phloat &p);
+Phloat pow(const Phloat &x, const Phloat &y);
+Phloat floor(const Phloat &x);
+Phloat fma(const Phloat &x, const Phloat &y, const Phloat &z);
+int ilogb(const Phloat &x);
+Phloat scalbn(const Phloat &x, int y);
+Phloat copysign(const Phloat &x, const Phloat &y);
+
+Phloat operator*(int x, const Phloat &y);
+Phloat operator/(int x, const Phloat &y);
+Phloat operator/(double x, const Phloat &y);
+Phloat operator+(int x, const Phloat &y);
+Phloat operator-(int x, const Phloat &y);
+bool operator==(int4 x, const Phloat &y);
 
 extern Phloat PI;
 
@@ -178,6 +200,20 @@ extern phloat NEG_TINY_PHLOAT;
 extern phloat NAN_PHLOAT;
 extern phloat NAN_1_PHLOAT;
 extern phloat NAN_2_PHLOAT;
+extern phloat DEG_PER_RAD_PHLOAT; // 180 / PI
+extern phloat GRAD_PER_RAD_PHLOAT; // 200 / PI
+
+// 10^n and 2^n, without going through pow(), but returning the same results.
+// p_pow2() only handles 0 <= n <= 64, the range of BASE word sizes.
+phloat p_pow10(int n);
+phloat p_pow2(int n);
+
+// Cache for the transcendental functions, used while SOLVE or INTEG is
+// running; see core_profiler_report(). Decimal only; no-ops in the Binary
+// build, where the functions are too cheap for a cache to pay off.
+void phloat_memo_enable(bool enable);
+void phloat_memo_stats(uint8 *hits, uint8 *misses);
+void phloat_memo_reset_stats();
 
 void phloat_init();
 int phloat2string(phloat d, char *buf, int buflen,
@@ -185,6 +221,10 @@ int phloat2string(phloat d, char *buf, int buflen,
                   int thousandssep, int max_mant_digits = 12,
                   const char *format = NULL);
 int string2phloat(const char *buf, int buflen, phloat *d);
+// Turning these off makes phloat2string() and string2phloat() leave all
+// numbers to the library conversions, instead of converting plain ones
+// directly; coretest uses this to check the one against the other.
+void phloat_direct_conversions(bool enable);
 
 
 #endif
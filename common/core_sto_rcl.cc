@@ -27,9 +27,13 @@
 
 static int apply_sto_operation(char operation, vartype *oldval, bool trace_stk);
 static int generic_sto_completion(int error, vartype *res);
+static int div_rr(phloat x, phloat y, phloat *z);
+static int mul_rr(phloat x, phloat y, phloat *z);
+static int sub_rr(phloat x, phloat y, phloat *z);
+static int add_rr(phloat x, phloat y, phloat *z);
 
-static bool preserve_ij;
-static bool trace_stack;
+static CORE_TLS bool preserve_ij;
+static CORE_TLS bool trace_stack;
 
 
 static int apply_sto_operation(char operation, vartype *oldval, bool trace_stk) {
@@ -153,7 +157,7 @@ int generic_rcl(arg_struct *arg, vartype **dst) {
     }
 }
 
-static arg_struct temp_arg;
+static CORE_TLS arg_struct temp_arg;
 
 static int generic_sto_completion(int error, vartype *res) {
     if (error != ERR_NONE)
@@ -464,6 +468,145 @@ int generic_sto(arg_struct *arg, char operation) {
     }
 }
 
+#ifndef BCD_MATH
+
+/* Element-wise kernels for real matrices
+ *
+ * In the binary version, the most common element-wise operations on real
+ * matrices are done by these kernels, instead of by calling the mappable
+ * function for each element. The loops are unrolled by four, with no calls
+ * in them, so the compiler can turn them into SIMD instructions.
+ * A kernel returns false if any of its results is not finite (r * 0 is zero
+ * for finite r, and NaN otherwise), and then the mapper does the whole matrix
+ * over again using the mappable function, so division by zero, out of range
+ * errors, and clamping with range_error_ignore are handled exactly as before.
+ */
+
+typedef bool (*kernel_r)(const phloat *x, phloat *z, int4 n);
+typedef bool (*kernel_rr)(const phloat *x, const phloat *y, phloat *z, int4 n);
+
+#define KERNEL_BODY(OP, X, Y)              \
+    phloat c0 = 0, c1 = 0, c2 = 0, c3 = 0; \
+    int4 i;                                \
+    for (i = 0; i + 4 <= n; i += 4) {      \
+        phloat r0 = OP(X(0), Y(0));        \
+        phloat r1 = OP(X(1), Y(1));        \
+        phloat r2 = OP(X(2), Y(2));        \
+        phloat r3 = OP(X(3), Y(3));        \
+        z[i] = r0;                         \
+        z[i + 1] = r1;                     \
+        z[i + 2] = r2;                     \
+        z[i + 3] = r3;                     \
+        c0 += r0 * 0;                      \
+        c1 += r1 * 0;                      \
+        c2 += r2 * 0;                      \
+        c3 += r3 * 0;                      \
+    }                                      \
+    for (; i < n; i++) {                   \
+        phloat r = OP(X(0), Y(0));         \
+        z[i] = r;                          \
+        c0 += r * 0;                       \
+    }                                      \
+    return c0 + c1 + c2 + c3 == 0;
+
+#define KERNEL_X(k) x[i + k]
+#define KERNEL_Y(k) y[i + k]
+#define KERNEL_X0(k) x[0]
+#define KERNEL_Y0(k) y[0]
+#define KERNEL_NONE(k) 0
+
+/* Like the mappable_rr functions, these compute y OP x; 'sv' means x is a
+ * scalar and y a matrix, 'vs' the other way around.
+ */
+#define BINARY_KERNELS(name, OP)                                                 \
+    static inline phloat name##_op(phloat x, phloat y) { return y OP x; }        \
+    static bool name##_vv(const phloat *x, const phloat *y, phloat *z, int4 n) { \
+        KERNEL_BODY(name##_op, KERNEL_X, KERNEL_Y)                               \
+    }                                                                            \
+    static bool name##_sv(const phloat *x, const phloat *y, phloat *z, int4 n) { \
+        KERNEL_BODY(name##_op, KERNEL_X0, KERNEL_Y)                              \
+    }                                                                            \
+    static bool name##_vs(const phloat *x, const phloat *y, phloat *z, int4 n) { \
+        KERNEL_BODY(name##_op, KERNEL_X, KERNEL_Y0)                              \
+    }
+
+#define UNARY_KERNEL(name, EXPR)                                      \
+    static inline phloat name##_op(phloat x, phloat) { return EXPR; } \
+    static bool name##_v(const phloat *x, phloat *z, int4 n) {        \
+        KERNEL_BODY(name##_op, KERNEL_X, KERNEL_NONE)                 \
+    }
+
+BINARY_KERNELS(add, +)
+BINARY_KERNELS(sub, -)
+BINARY_KERNELS(mul, *)
+BINARY_KERNELS(div, /)
+
+UNARY_KERNEL(sqrt, sqrt(x))
+UNARY_KERNEL(square, x * x)
+UNARY_KERNEL(inv, 1 / x)
+UNARY_KERNEL(ip, x < 0 ? -floor(-x) : floor(x))
+UNARY_KERNEL(fp, x < 0 ? x + floor(-x) : x - floor(x))
+
+struct unary_kernel {
+    mappable_r mr;
+    kernel_r v;
+};
+
+static const unary_kernel unary_kernels[] = {
+    { mappable_sqrt_r,   sqrt_v },
+    { mappable_square_r, square_v },
+    { mappable_inv_r,    inv_v },
+    { mappable_ip,       ip_v },
+    { mappable_fp,       fp_v },
+    { NULL, NULL }
+};
+
+struct binary_kernel {
+    mappable_rr mrr;
+    kernel_rr vv, sv, vs;
+};
+
+static const binary_kernel binary_kernels[] = {
+    { add_rr, add_vv, add_sv, add_vs },
+    { sub_rr, sub_vv, sub_sv, sub_vs },
+    { mul_rr, mul_vv, mul_sv, mul_vs },
+    { div_rr, div_vv, div_sv, div_vs },
+    { NULL, NULL, NULL, NULL }
+};
+
+static bool run_kernel(mappable_r mr, const phloat *x, phloat *z, int4 n) {
+    for (const unary_kernel *k = unary_kernels; k->mr != NULL; k++)
+        if (k->mr == mr)
+            return k->v(x, z, n);
+    return false;
+}
+
+/* 'x' and 'y' are the arguments of mrr; a null size means that one is a
+ * scalar.
+ */
+static bool run_kernel(mappable_rr mrr, const phloat *x, int4 xsize,
+                       const phloat *y, int4 ysize, phloat *z, int4 n) {
+    for (const binary_kernel *k = binary_kernels; k->mrr != NULL; k++)
+        if (k->mrr == mrr) {
+            kernel_rr kr = xsize == 0 ? k->sv : ysize == 0 ? k->vs : k->vv;
+            return kr(x, y, z, n);
+        }
+    return false;
+}
+
+#else
+
+static bool run_kernel(mappable_r mr, const phloat *x, phloat *z, int4 n) {
+    return false;
+}
+
+static bool run_kernel(mappable_rr mrr, const phloat *x, int4 xsize,
+                       const phloat *y, int4 ysize, phloat *z, int4 n) {
+    return false;
+}
+
+#endif
+
 int map_unary(const vartype *src, vartype **dst, mappable_r mr, mappable_c mc) {
     int error;
     switch (src->type) {
@@ -499,13 +642,14 @@ int map_unary(const vartype *src, vartype **dst, mappable_r mr, mappable_c mc) {
                 return ERR_ALPHA_DATA_IS_INVALID;
             }
             int4 size = sm->rows * sm->columns;
-            for (int4 i = 0; i < size; i++) {
-                int error = mr(sm->array->data[i], &dm->array->data[i]);
-                if (error != ERR_NONE) {
-                    free_vartype((vartype *) dm);
-                    return error;
+            if (!run_kernel(mr, sm->array->data, dm->array->data, size))
+                for (int4 i = 0; i < size; i++) {
+                    int error = mr(sm->array->data[i], &dm->array->data[i]);
+                    if (error != ERR_NONE) {
+                        free_vartype((vartype *) dm);
+                        return error;
+                    }
                 }
-            }
             *dst = (vartype *) dm;
             return ERR_NONE;
         }
@@ -576,15 +720,18 @@ int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
                         return ERR_ALPHA_DATA_IS_INVALID;
                     }
                     int4 size = sm->rows * sm->columns;
-                    for (int4 i = 0; i < size; i++) {
-                        int error = mrr(((vartype_real *) src1)->x,
-                                    sm->array->data[i],
-                                    &dm->array->data[i]);
-                        if (error != ERR_NONE) {
-                            free_vartype((vartype *) dm);
-                            return error;
+                    if (!run_kernel(mrr, &((vartype_real *) src1)->x, 0,
+                                    sm->array->data, size,
+                                    dm->array->data, size))
+                        for (int4 i = 0; i < size; i++) {
+                            int error = mrr(((vartype_real *) src1)->x,
+                                        sm->array->data[i],
+                                        &dm->array->data[i]);
+                            if (error != ERR_NONE) {
+                                free_vartype((vartype *) dm);
+                                return error;
+                            }
                         }
-                    }
                     *dst = (vartype *) dm;
                     return ERR_NONE;
                 }
@@ -708,15 +855,18 @@ int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
                         return ERR_ALPHA_DATA_IS_INVALID;
                     }
                     int4 size = sm->rows * sm->columns;
-                    for (int4 i = 0; i < size; i++) {
-                        int error = mrr(sm->array->data[i],
-                                    ((vartype_real *) src2)->x,
-                                    &dm->array->data[i]);
-                        if (error != ERR_NONE) {
-                            free_vartype((vartype *) dm);
-                            return error;
+                    if (!run_kernel(mrr, sm->array->data, size,
+                                    &((vartype_real *) src2)->x, 0,
+                                    dm->array->data, size))
+                        for (int4 i = 0; i < size; i++) {
+                            int error = mrr(sm->array->data[i],
+                                        ((vartype_real *) src2)->x,
+                                        &dm->array->data[i]);
+                            if (error != ERR_NONE) {
+                                free_vartype((vartype *) dm);
+                                return error;
+                            }
                         }
-                    }
                     *dst = (vartype *) dm;
                     return ERR_NONE;
                 }
@@ -761,15 +911,18 @@ int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
                         return ERR_ALPHA_DATA_IS_INVALID;
                     }
                     int4 size = sm1->rows * sm1->columns;
-                    for (int4 i = 0; i < size; i++) {
-                        int error = mrr(sm1->array->data[i],
-                                        sm2->array->data[i],
-                                        &dm->array->data[i]);
-                        if (error != ERR_NONE) {
-                            free_vartype((vartype *) dm);
-                            return error;
+                    if (!run_kernel(mrr, sm1->array->data, size,
+                                    sm2->array->data, size,
+                                    dm->array->data, size))
+                        for (int4 i = 0; i < size; i++) {
+                            int error = mrr(sm1->array->data[i],
+                                            sm2->array->data[i],
+                                            &dm->array->data[i]);
+                            if (error != ERR_NONE) {
+                                free_vartype((vartype *) dm);
+                                return error;
+                            }
                         }
-                    }
                     *dst = (vartype *) dm;
                     return ERR_NONE;
                 }
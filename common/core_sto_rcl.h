@@ -32,6 +32,14 @@ typedef int (*mappable_r)(phloat x, phloat *z);
 typedef int (*mappable_c)(phloat xre, phloat xim, phloat *zre, phloat *zim);
 
 
+/* These have element-wise kernels for real matrices in map_unary */
+int mappable_ip(phloat x, phloat *y);
+int mappable_fp(phloat x, phloat *y);
+int mappable_sqrt_r(phloat x, phloat *y);
+int mappable_square_r(phloat x, phloat *y);
+int mappable_inv_r(phloat x, phloat *y);
+
+
 /*************************************************/
 /* Signatures for functions mapped by map_binary */
 /*************************************************/
@@ -509,6 +509,9 @@ const command_spec cmd_array[] =
     /* For Plus42 Compatibility */
     { /* WIDTH */       docmd_width,       "WIDTH",               0x00, 0x00, 0xa2, 0x72,  5, ARG_NONE,   0, NA_T },
     { /* HEIGHT */      docmd_height,      "HEIGHT",              0x00, 0x00, 0xa2, 0x73,  6, ARG_NONE,   0, NA_T },
+
+    /* Random Numbers */
+    { /* RANM */        docmd_ranm,        "RANM",                0x00, 0x00, 0xa7, 0xfa,  4, ARG_NONE,   1, 0x05 },
 };
 
 /*
@@ -875,7 +878,7 @@ XROM         A[0-7] nn (bits 2-0 of byte 1 plus bits 7-6 of byte 2 are the ROM
 ===============================================================================
 */
 
-int handle(int cmd, arg_struct *arg) {
+int check_command_args(int cmd) {
     const command_spec *cs = cmd_array + cmd;
     if (flags.f.big_stack) {
         if (cs->argcount == -1) {
@@ -900,5 +903,12 @@ int handle(int cmd, arg_struct *arg) {
                     return ERR_INVALID_TYPE;
         }
     }
-    return cs->handler(arg);
+    return ERR_NONE;
+}
+
+int handle(int cmd, arg_struct *arg) {
+    int err = check_command_args(cmd);
+    if (err != ERR_NONE)
+        return err;
+    return cmd_array[cmd].handler(arg);
 }
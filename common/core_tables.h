@@ -476,8 +476,10 @@
 /* For Plus42 compatibility */
 #define CMD_WIDTH       428
 #define CMD_HEIGHT      429
+/* Random Numbers */
+#define CMD_RANM        430
 
-#define CMD_SENTINEL    430
+#define CMD_SENTINEL    431
 
 
 /* command_spec.argtype */
@@ -570,6 +572,11 @@ struct command_spec {
 
 extern const command_spec cmd_array[];
 
+/* Checks the stack depth and argument types required by the command; returns
+ * ERR_NONE if it's OK to call its handler. handle() does this, followed by
+ * calling the handler; code generated by raw2cc calls them separately.
+ */
+int check_command_args(int cmd);
 int handle(int cmd, arg_struct *arg);
 
 
@@ -18,6 +18,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "core_main.h"
 #include "core_globals.h"
 #include "core_helpers.h"
 #include "core_display.h"
@@ -29,12 +30,12 @@
 // cut down on the malloc/free overhead.
 
 #define POOLSIZE 10
-static vartype_real *realpool[POOLSIZE];
-static vartype_complex *complexpool[POOLSIZE];
-static vartype_string *stringpool[POOLSIZE];
-static int realpool_size = 0;
-static int complexpool_size = 0;
-static int stringpool_size = 0;
+static CORE_TLS vartype_real *realpool[POOLSIZE];
+static CORE_TLS vartype_complex *complexpool[POOLSIZE];
+static CORE_TLS vartype_string *stringpool[POOLSIZE];
+static CORE_TLS int realpool_size = 0;
+static CORE_TLS int complexpool_size = 0;
+static CORE_TLS int stringpool_size = 0;
 
 vartype *new_real(phloat value) {
     vartype_real *r;
@@ -47,6 +48,7 @@ vartype *new_real(phloat value) {
         r->type = TYPE_REAL;
     }
     r->x = value;
+    core_stats.allocations++;
     return (vartype *) r;
 }
 
@@ -62,6 +64,7 @@ vartype *new_complex(phloat re, phloat im) {
     }
     c->re = re;
     c->im = im;
+    core_stats.allocations++;
     return (vartype *) c;
 }
 
@@ -89,6 +92,7 @@ vartype *new_string(const char *text, int length) {
         s->t.ptr = dbuf;
     if (text != NULL)
         memcpy(length > SSLENV ? s->t.ptr : s->t.buf, text, length);
+    core_stats.allocations++;
     return (vartype *) s;
 }
 
@@ -128,6 +132,7 @@ vartype *new_realmatrix(int4 rows, int4 columns) {
         rm->array->data[i] = 0;
     memset(rm->array->is_string, 0, sz);
     rm->array->refcount = 1;
+    core_stats.allocations++;
     return (vartype *) rm;
 }
 
@@ -159,6 +164,7 @@ vartype *new_complexmatrix(int4 rows, int4 columns) {
     for (i = 0; i < sz; i++)
         cm->array->data[i] = 0;
     cm->array->refcount = 1;
+    core_stats.allocations++;
     return (vartype *) cm;
 }
 
@@ -181,6 +187,7 @@ vartype *new_list(int4 size) {
     }
     memset(list->array->data, 0, size * sizeof(vartype *));
     list->array->refcount = 1;
+    core_stats.allocations++;
     return (vartype *) list;
 }
 
@@ -330,6 +337,7 @@ vartype *dup_vartype(const vartype *v) {
                 return NULL;
             *rm2 = *rm;
             rm->array->refcount++;
+            core_stats.allocations++;
             return (vartype *) rm2;
         }
         case TYPE_COMPLEXMATRIX: {
@@ -340,6 +348,7 @@ vartype *dup_vartype(const vartype *v) {
                 return NULL;
             *cm2 = *cm;
             cm->array->refcount++;
+            core_stats.allocations++;
             return (vartype *) cm2;
         }
         case TYPE_STRING: {
@@ -353,6 +362,7 @@ vartype *dup_vartype(const vartype *v) {
                 return NULL;
             *list2 = *list;
             list->array->refcount++;
+            core_stats.allocations++;
             return (vartype *) list2;
         }
         default:
@@ -474,7 +484,200 @@ int disentangle(vartype *v) {
     }
 }
 
-int lookup_var(const char *name, int namelength) {
+/* Variable index
+ *
+ * To avoid scanning vars[] on every lookup, we keep two auxiliary
+ * structures alongside it:
+ * var_hash: an open-addressing hash table, keyed by name, holding the
+ *   index of the one visible (neither hidden nor private) variable with
+ *   that name. The name is stored in the slot, so entries can be found and
+ *   updated even while vars[] is being compacted.
+ * var_locals: the indexes of all local variables (level != -1), in
+ *   ascending order. Locals are only ever created at the current RTN level,
+ *   so the locals of the innermost frame are always at the top of this
+ *   stack, and RTN can pop them without looking at globals.
+ * Both are updated incrementally by the functions below; anything else that
+ * modifies vars[] wholesale (loading state) calls invalidate_var_index(),
+ * and the index is rebuilt on the next lookup. If memory for the index
+ * can't be allocated, we fall back on scanning vars[].
+ */
+
+struct var_hash_slot {
+    unsigned char length;
+    char name[7];
+    int index;
+};
+
+static CORE_TLS var_hash_slot *var_hash = NULL;
+static CORE_TLS int var_hash_size = 0;
+static CORE_TLS int var_hash_count = 0;
+static CORE_TLS int *var_locals = NULL;
+static CORE_TLS int var_locals_count = 0;
+static CORE_TLS int var_locals_capacity = 0;
+static CORE_TLS bool var_index_valid = false;
+
+static inline bool var_visible(int i) {
+    return (vars[i].flags & (VAR_HIDDEN | VAR_PRIVATE)) == 0;
+}
+
+static inline int var_name_hash(const char *name, int namelength) {
+    uint4 h = 2166136261U;
+    for (int i = 0; i < namelength; i++)
+        h = (h ^ (unsigned char) name[i]) * 16777619U;
+    return (int) (h & (var_hash_size - 1));
+}
+
+static var_hash_slot *var_hash_find(const char *name, int namelength) {
+    int h = var_name_hash(name, namelength);
+    while (true) {
+        var_hash_slot *slot = var_hash + h;
+        if (slot->index == -1)
+            return NULL;
+        if (slot->length == namelength
+                && memcmp(slot->name, name, namelength) == 0)
+            return slot;
+        h = (h + 1) & (var_hash_size - 1);
+    }
+}
+
+static void var_hash_set(const char *name, int namelength, int index) {
+    int h = var_name_hash(name, namelength);
+    while (true) {
+        var_hash_slot *slot = var_hash + h;
+        if (slot->index == -1) {
+            slot->length = namelength;
+            memcpy(slot->name, name, namelength);
+            var_hash_count++;
+            break;
+        }
+        if (slot->length == namelength
+                && memcmp(slot->name, name, namelength) == 0)
+            break;
+        h = (h + 1) & (var_hash_size - 1);
+    }
+    var_hash[h].index = index;
+}
+
+static void var_hash_remove(const char *name, int namelength) {
+    int h = var_name_hash(name, namelength);
+    while (true) {
+        var_hash_slot *slot = var_hash + h;
+        if (slot->index == -1)
+            return;
+        if (slot->length == namelength
+                && memcmp(slot->name, name, namelength) == 0)
+            break;
+        h = (h + 1) & (var_hash_size - 1);
+    }
+    /* Backward-shift deletion, so probe sequences stay unbroken */
+    int mask = var_hash_size - 1;
+    int hole = h;
+    int j = h;
+    while (true) {
+        j = (j + 1) & mask;
+        if (var_hash[j].index == -1)
+            break;
+        int home = var_name_hash(var_hash[j].name, var_hash[j].length);
+        if (((j - home) & mask) >= ((j - hole) & mask)) {
+            var_hash[hole] = var_hash[j];
+            hole = j;
+        }
+    }
+    var_hash[hole].index = -1;
+    var_hash_count--;
+}
+
+void invalidate_var_index() {
+    var_index_valid = false;
+}
+
+static bool rebuild_var_index() {
+    int size = 64;
+    while (size < vars_count * 2)
+        size <<= 1;
+    if (size != var_hash_size) {
+        var_hash_slot *new_hash = (var_hash_slot *) realloc(var_hash, size * sizeof(var_hash_slot));
+        if (new_hash == NULL)
+            return false;
+        var_hash = new_hash;
+        var_hash_size = size;
+    }
+    if (var_locals_capacity < vars_count) {
+        int *new_locals = (int *) realloc(var_locals, vars_count * sizeof(int));
+        if (new_locals == NULL)
+            return false;
+        var_locals = new_locals;
+        var_locals_capacity = vars_count;
+    }
+    for (int i = 0; i < var_hash_size; i++)
+        var_hash[i].index = -1;
+    var_hash_count = 0;
+    var_locals_count = 0;
+    for (int i = 0; i < vars_count; i++) {
+        if (var_visible(i))
+            var_hash_set(vars[i].name, vars[i].length, i);
+        if (vars[i].level != -1)
+            var_locals[var_locals_count++] = i;
+    }
+    var_index_valid = true;
+    return true;
+}
+
+static inline bool ensure_var_index() {
+    return var_index_valid || rebuild_var_index();
+}
+
+/* Called after vars[index] has been appended to vars[] */
+static void var_index_add(int index) {
+    if (!var_index_valid)
+        return;
+    if (vars[index].level != -1) {
+        if (var_locals_count == var_locals_capacity) {
+            int nc = var_locals_capacity + 25;
+            int *new_locals = (int *) realloc(var_locals, nc * sizeof(int));
+            if (new_locals == NULL) {
+                var_index_valid = false;
+                return;
+            }
+            var_locals = new_locals;
+            var_locals_capacity = nc;
+        }
+        var_locals[var_locals_count++] = index;
+    }
+    if (var_visible(index)) {
+        if ((var_hash_count + 1) * 2 > var_hash_size)
+            // Time to grow; rebuild on the next lookup
+            var_index_valid = false;
+        else
+            var_hash_set(vars[index].name, vars[index].length, index);
+    }
+}
+
+/* Called after vars[from] has been removed, and everything after it moved
+ * down by one; fixes up the indexes of the moved variables.
+ */
+static void var_index_removed(int from) {
+    if (!var_index_valid)
+        return;
+    for (int i = from; i < vars_count; i++)
+        if (var_visible(i))
+            var_hash_set(vars[i].name, vars[i].length, i);
+    int lo = 0, hi = var_locals_count;
+    while (lo < hi) {
+        int mid = (lo + hi) >> 1;
+        if (var_locals[mid] < from)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    int j = lo;
+    for (int i = lo; i < var_locals_count; i++)
+        if (var_locals[i] != from)
+            var_locals[j++] = var_locals[i] - 1;
+    var_locals_count = j;
+}
+
+static int lookup_var_linear(const char *name, int namelength) {
     int i, j;
     for (i = vars_count - 1; i >= 0; i--) {
         if ((vars[i].flags & (VAR_HIDDEN | VAR_PRIVATE)) != 0)
@@ -490,6 +693,13 @@ int lookup_var(const char *name, int namelength) {
     return -1;
 }
 
+int lookup_var(const char *name, int namelength) {
+    if (!ensure_var_index())
+        return lookup_var_linear(name, namelength);
+    var_hash_slot *slot = var_hash_find(name, namelength);
+    return slot == NULL ? -1 : slot->index;
+}
+
 vartype *recall_var(const char *name, int namelength) {
     int varindex = lookup_var(name, namelength);
     if (varindex == -1)
@@ -531,6 +741,7 @@ int store_var(const char *name, int namelength, vartype *value, bool local) {
             vars[varindex].name[i] = name[i];
         vars[varindex].level = local ? get_rtn_level() : -1;
         vars[varindex].flags = 0;
+        var_index_add(varindex);
     } else if (local && vars[varindex].level < get_rtn_level()) {
         /* Create local that hides an existing variable */
         if (vars_count == vars_capacity) {
@@ -548,6 +759,7 @@ int store_var(const char *name, int namelength, vartype *value, bool local) {
             vars[varindex].name[i] = name[i];
         vars[varindex].level = get_rtn_level();
         vars[varindex].flags = VAR_HIDING;
+        var_index_add(varindex);
     } else {
         /* Update existing variable */
         if (matedit_mode == 1 &&
@@ -599,16 +811,21 @@ bool purge_var(const char *name, int namelength, bool global, bool local) {
         matedit_stack_depth = 0;
     }
     free_vartype(vars[varindex].value);
+    if (var_index_valid)
+        var_hash_remove(name, namelength);
     if ((vars[varindex].flags & VAR_HIDING) != 0) {
         for (int i = varindex - 1; i >= 0; i--)
             if ((vars[i].flags & VAR_HIDDEN) != 0 && string_equals(vars[i].name, vars[i].length, name, namelength)) {
                 vars[i].flags &= ~VAR_HIDDEN;
+                if (var_index_valid)
+                    var_hash_set(name, namelength, i);
                 break;
             }
     }
     for (int i = varindex; i < vars_count - 1; i++)
         vars[i] = vars[i + 1];
     vars_count--;
+    var_index_removed(varindex);
     update_catalog();
     return true;
 }
@@ -618,6 +835,79 @@ void purge_all_vars() {
     for (i = 0; i < vars_count; i++)
         free_vartype(vars[i].value);
     vars_count = 0;
+    var_index_valid = false;
+}
+
+static void purge_local(int i) {
+    if ((matedit_mode == 1 || matedit_mode == 3)
+            && vars[i].level == matedit_level
+            && string_equals(vars[i].name, vars[i].length, matedit_name, matedit_length)) {
+        if (matedit_mode == 3) {
+            set_appmenu_exitcallback(0);
+            set_menu(MENULEVEL_APP, MENU_NONE);
+        }
+        matedit_mode = 0;
+        free(matedit_stack);
+        matedit_stack = NULL;
+        matedit_stack_depth = 0;
+    }
+    if (var_index_valid && var_visible(i))
+        var_hash_remove(vars[i].name, vars[i].length);
+    if ((vars[i].flags & VAR_HIDING) != 0) {
+        for (int j = i - 1; j >= 0; j--)
+            if ((vars[j].flags & VAR_HIDDEN) != 0 && string_equals(vars[i].name, vars[i].length, vars[j].name, vars[j].length)) {
+                vars[j].flags &= ~VAR_HIDDEN;
+                if (var_index_valid)
+                    var_hash_set(vars[j].name, vars[j].length, j);
+                break;
+            }
+    }
+    free_vartype(vars[i].value);
+    vars[i].length = 100;
+}
+
+void purge_locals(int level) {
+    /* Removes all local variables at or above the given RTN level. Since
+     * locals are created in level order, these are the ones at the top of
+     * the var_locals stack.
+     */
+    if (matedit_mode == 3 && matedit_level >= level)
+        leave_matrix_editor();
+    int last = -1;
+    if (ensure_var_index()) {
+        while (var_locals_count > 0) {
+            int i = var_locals[var_locals_count - 1];
+            if (vars[i].level < level)
+                break;
+            purge_local(i);
+            last = i;
+            var_locals_count--;
+        }
+    } else {
+        for (int i = vars_count - 1; i >= 0; i--) {
+            if (vars[i].level == -1)
+                continue;
+            if (vars[i].level < level)
+                break;
+            purge_local(i);
+            last = i;
+        }
+    }
+    if (last == -1)
+        return;
+    int from = last;
+    int to = last;
+    while (from < vars_count) {
+        if (vars[from].length != 100) {
+            vars[to] = vars[from];
+            if (var_index_valid && var_visible(to))
+                var_hash_set(vars[to].name, vars[to].length, to);
+            to++;
+        }
+        from++;
+    }
+    vars_count -= from - to;
+    update_catalog();
 }
 
 bool vars_exist(int section) {
@@ -715,6 +1005,17 @@ int matrix_copy(vartype *dst, const vartype *src) {
 static int lookup_private_var(const char *name, int namelength) {
     int level = get_rtn_level();
     int i, j;
+    if (ensure_var_index()) {
+        for (int k = var_locals_count - 1; k >= 0; k--) {
+            i = var_locals[k];
+            if (vars[i].level < level)
+                break;
+            if ((vars[i].flags & VAR_PRIVATE) != 0
+                    && string_equals(vars[i].name, vars[i].length, name, namelength))
+                return i;
+        }
+        return -1;
+    }
     for (i = vars_count - 1; i >= 0; i--) {
         int vlevel = vars[i].level;
         if (vlevel == -1)
@@ -750,6 +1051,7 @@ vartype *recall_and_purge_private_var(const char *name, int namelength) {
     for (int i = varindex; i < vars_count - 1; i++)
         vars[i] = vars[i + 1];
     vars_count--;
+    var_index_removed(varindex);
     return ret;
 }
 
@@ -771,6 +1073,7 @@ int store_private_var(const char *name, int namelength, vartype *value) {
             vars[varindex].name[i] = name[i];
         vars[varindex].level = get_rtn_level();
         vars[varindex].flags = VAR_PRIVATE;
+        var_index_add(varindex);
     } else {
         free_vartype(vars[varindex].value);
     }
@@ -131,6 +131,8 @@ bool ensure_var_space(int n);
 int store_var(const char *name, int namelength, vartype *value, bool local = false);
 bool purge_var(const char *name, int namelength, bool global = true, bool local = true);
 void purge_all_vars();
+void purge_locals(int level);
+void invalidate_var_index();
 bool vars_exist(int section);
 bool contains_strings(const vartype_realmatrix *rm);
 int matrix_copy(vartype *dst, const vartype *src);
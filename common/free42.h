@@ -41,6 +41,18 @@
 #define F42_BIG_ENDIAN 1
 #endif
 
+/* The state of the calculator is kept in variables with static storage
+ * duration. When CORE_THREADS is defined, those variables are thread-local,
+ * so every thread that calls core_init() gets a calculator of its own, and
+ * separate threads can run separate calculators concurrently. Shell
+ * callbacks may then be called from any of those threads.
+ */
+#ifdef CORE_THREADS
+#define CORE_TLS thread_local
+#else
+#define CORE_TLS
+#endif
+
 /* Magic number "24kF" for the state file. */
 #define FREE42_MAGIC 0x466b3432
 #define FREE42_MAGIC_STR "24kF"
@@ -0,0 +1,349 @@
+#include <string>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core_main.h"
+#include "core_globals.h"
+#include "core_display.h"
+#include "core_tables.h"
+#include "core_commands1.h"
+#include "core_commands2.h"
+#include "core_commands3.h"
+#include "core_commands4.h"
+#include "core_commands5.h"
+#include "core_commands6.h"
+#include "core_commands7.h"
+
+/* raw2cc: translates the programs in a .raw file to C++.
+ *
+ * Each program becomes a function that executes its instructions by calling
+ * their command handlers directly, in the same order, and with the same
+ * arguments, as the interpreter in continue_running() would. Conditionals
+ * (ISG, DSE, X=Y?, FS?, etc.) and local GTO and XEQ become jumps within that
+ * function. Anything that the generated code can't handle by itself, like
+ * errors, global XEQ, RTN, STOP, PSE, and GETKEY, is handed back to the
+ * interpreter, after the instruction in question has been executed; lines
+ * whose command has no handler are left to the interpreter entirely.
+ * The generated code registers itself with core_register_compiled_programs(),
+ * so all it takes to use it is to link it with the core; it kicks in whenever
+ * a program with the same text is run.
+ */
+
+#define H(h) { h, #h }
+
+static const struct {
+    int (*handler)(arg_struct *arg);
+    const char *name;
+} handlers[] = {
+    // One H(docmd_xxx) for each handler in cmd_array, extracted from
+    // core_tables.cc by the makefile, so this can't get out of step with it
+#include "raw2cc_handlers.h"
+};
+
+static const char *handler_name(int cmd) {
+    int (*handler)(arg_struct *) = cmd_array[cmd].handler;
+    if (handler == NULL)
+        return NULL;
+    for (size_t i = 0; i < sizeof(handlers) / sizeof(handlers[0]); i++)
+        if (handlers[i].handler == handler)
+            return handlers[i].name;
+    return NULL;
+}
+
+static std::string line_comment(int prgm, int4 pc) {
+    textbuf tb = { NULL, 0, 0, false };
+    tb_print_program_line(&tb, prgm, pc);
+    std::string res;
+    for (size_t i = 0; i < tb.size && res.length() < 60; i++) {
+        unsigned char c = tb.buf[i];
+        if (c >= 0x80 && c < 0xc0)
+            // UTF-8 continuation byte
+            continue;
+        res += c >= 32 && c < 127 && c != '\\' ? c : '?';
+    }
+    free(tb.buf);
+    return res;
+}
+
+struct line_info {
+    int4 pc;
+    int4 next_pc;
+    int cmd;
+    arg_struct arg;
+};
+
+static bool is_local_jump(const line_info *l) {
+    return (l->cmd == CMD_GTO || l->cmd == CMD_XEQ)
+            && (l->arg.type == ARGTYPE_NUM
+                || l->arg.type == ARGTYPE_LCLBL
+                || l->arg.type == ARGTYPE_STK);
+}
+
+static int4 write_program(FILE *out, int prgm) {
+    current_prgm = prgm;
+    prgm_struct *p = prgms + prgm;
+
+    fprintf(out, "\n// Program %d: %s\n\n", prgm, line_comment(prgm, 0).c_str());
+    fprintf(out, "static const unsigned char p%d_text[] = {", prgm);
+    for (int4 i = 0; i < p->size; i++)
+        fprintf(out, "%s%d,", i % 16 == 0 ? "\n    " : " ", p->text[i]);
+    fprintf(out, "\n};\n\n");
+
+    int4 count = 0;
+    for (int4 pc = 0; pc < p->size; pc += get_command_length(prgm, pc))
+        count++;
+    line_info *lines = new line_info[count];
+    bool backward = false;
+    int4 pc = 0;
+    for (int4 i = 0; i < count; i++) {
+        lines[i].pc = pc;
+        get_next_command(&pc, &lines[i].cmd, &lines[i].arg, 1, NULL);
+        lines[i].next_pc = pc;
+        if (!is_local_jump(lines + i) || lines[i].arg.target < 0)
+            lines[i].arg.target = -2;
+        else if (lines[i].arg.target <= lines[i].pc)
+            backward = true;
+    }
+
+    fprintf(out, "static int p%d_run(arg_struct *args, int4 *instr_pc) {\n", prgm);
+    fprintf(out, "    int self = current_prgm;\n");
+    fprintf(out, "    arg_struct arg;\n");
+    fprintf(out, "    int err = ERR_NONE;\n");
+    if (backward)
+        fprintf(out, "    int jumps = 64;\n");
+    fprintf(out, "    switch (pc) {\n");
+    for (int4 i = 0; i < count; i++)
+        fprintf(out, "        case %d: goto L%d;\n", lines[i].pc, lines[i].pc);
+    fprintf(out, "        default: *instr_pc = pc; return COMPILED_INTERPRET;\n");
+    fprintf(out, "    }\n");
+
+    for (int4 i = 0; i < count; i++) {
+        line_info *l = lines + i;
+        int cmd = l->cmd;
+        int4 this_pc = l->pc;
+        int4 next_pc = l->next_pc;
+        fprintf(out, "\n    L%d: // %s\n", this_pc, line_comment(prgm, this_pc).c_str());
+        const char *name = handler_name(cmd);
+        if (name == NULL) {
+            fprintf(out, "    *instr_pc = pc = %d;\n", this_pc);
+            fprintf(out, "    return COMPILED_INTERPRET;\n");
+            continue;
+        }
+        if (is_local_jump(l)) {
+            /* Resolve the target the first time the line is executed, like
+             * get_next_command_cached() does, so the cached target in the
+             * program text is updated at the same time.
+             */
+            fprintf(out, "    if (args[%d].target == -1) {\n", i);
+            fprintf(out, "        int4 p = %d;\n", this_pc);
+            fprintf(out, "        int c;\n");
+            fprintf(out, "        get_next_command(&p, &c, args + %d, 1, NULL);\n", i);
+            fprintf(out, "    }\n");
+        }
+        fprintf(out, "    pc = %d;\n", next_pc);
+        fprintf(out, "    mode_disable_stack_lift = false;\n");
+        fprintf(out, "    core_stats.instructions++;\n");
+        fprintf(out, "    arg = args[%d];\n", i);
+        if (cmd_array[cmd].argcount == 0)
+            fprintf(out, "    err = %s(&arg);\n", name);
+        else {
+            fprintf(out, "    err = check_command_args(%d);\n", cmd);
+            fprintf(out, "    if (err == ERR_NONE)\n");
+            fprintf(out, "        err = %s(&arg);\n", name);
+        }
+        int4 target = l->arg.target;
+        if (target >= 0) {
+            /* Backward jumps count against a budget, so we regularly go
+             * back to the interpreter loop, giving it a chance to check
+             * for events.
+             */
+            fprintf(out, "    if (!keep_going(err) || pc != %d || current_prgm != self%s) {\n",
+                    target, target > this_pc ? "" : " || --jumps == 0");
+            fprintf(out, "        *instr_pc = %d;\n", this_pc);
+            fprintf(out, "        return err;\n");
+            fprintf(out, "    }\n");
+            fprintf(out, "    flags.f.stack_lift_disable = mode_disable_stack_lift;\n");
+            fprintf(out, "    goto L%d;\n", target);
+            continue;
+        }
+        fprintf(out, "    if (!keep_going(err) || pc != %d || current_prgm != self) {\n", next_pc);
+        fprintf(out, "        *instr_pc = %d;\n", this_pc);
+        fprintf(out, "        return err;\n");
+        fprintf(out, "    }\n");
+        fprintf(out, "    flags.f.stack_lift_disable = mode_disable_stack_lift;\n");
+        if (i + 1 < count) {
+            int4 skip = p->is_end(next_pc) ? next_pc : lines[i + 1].next_pc;
+            fprintf(out, "    if (err == ERR_NO)\n");
+            fprintf(out, "        goto L%d;\n", skip);
+        } else {
+            fprintf(out, "    *instr_pc = %d;\n", this_pc);
+            fprintf(out, "    return err;\n");
+        }
+    }
+    fprintf(out, "}\n");
+    delete[] lines;
+    return count;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <raw-file>\nBuild date: %s\n", argv[0], __DATE__);
+        return 1;
+    }
+
+    // If the makefile's pattern ever misses a handler, lines using it would
+    // silently be left to the interpreter; refuse to run instead.
+    for (int cmd = 0; cmd < CMD_SENTINEL; cmd++)
+        if (cmd_array[cmd].handler != NULL && handler_name(cmd) == NULL) {
+            fprintf(stderr, "No name for the handler of command %d; rebuild raw2cc_handlers.h\n", cmd);
+            return 1;
+        }
+
+    FILE *in = fopen(argv[1], "rb");
+    if (in == NULL) {
+        fprintf(stderr, "Can't open input file: %s\n", strerror(errno));
+        return 1;
+    }
+    fclose(in);
+
+    core_init(0, 0, NULL, 0);
+
+    core_import_programs(0, argv[1]);
+
+    int len = strlen(argv[1]);
+    if (len >= 4 && strcasecmp(argv[1] + (len - 4), ".raw") == 0)
+        len -= 4;
+    std::string outname = std::string(argv[1], len) + ".cc";
+
+    FILE *out = fopen(outname.c_str(), "w");
+    if (out == NULL) {
+        fprintf(stderr, "Can't open output file: %s\n", strerror(errno));
+        return 1;
+    }
+
+    fprintf(out, "// Generated by raw2cc from %s; do not edit.\n\n", argv[1]);
+    fprintf(out, "#include \"core_main.h\"\n");
+    fprintf(out, "#include \"core_globals.h\"\n");
+    fprintf(out, "#include \"core_tables.h\"\n");
+    for (int i = 1; i <= 7; i++)
+        fprintf(out, "#include \"core_commands%d.h\"\n", i);
+    fprintf(out, "\n");
+    fprintf(out, "static inline bool keep_going(int err) {\n");
+    fprintf(out, "    return (err == ERR_NONE || err == ERR_YES || err == ERR_NO)\n");
+    fprintf(out, "        && mode_running && !mode_pause && !mode_getkey\n");
+    fprintf(out, "        && !(flags.f.trace_print && flags.f.printer_exists);\n");
+    fprintf(out, "}\n");
+
+    /* Programs consisting of nothing but END aren't worth compiling */
+    std::string table;
+    int n = 0;
+    for (int i = 0; i < prgms_count; i++) {
+        if (prgms[i].is_end(0))
+            continue;
+        int4 count = write_program(out, i);
+        char buf[100];
+        snprintf(buf, 100, "    { p%d_text, %d, %d, p%d_run },\n",
+                 i, prgms[i].size, count, i);
+        table += buf;
+        n++;
+    }
+    if (n == 0) {
+        fprintf(stderr, "No programs found in %s\n", argv[1]);
+        fclose(out);
+        remove(outname.c_str());
+        return 1;
+    }
+
+    fprintf(out, "\nstatic const core_compiled_program programs[] = {\n%s};\n\n", table.c_str());
+    fprintf(out, "static struct registrar {\n");
+    fprintf(out, "    registrar() {\n");
+    fprintf(out, "        core_register_compiled_programs(programs, %d);\n", n);
+    fprintf(out, "    }\n");
+    fprintf(out, "} the_registrar;\n");
+    fclose(out);
+    return 0;
+}
+
+const char *shell_platform() {
+    return NULL;
+}
+
+void shell_blitter(const char *bits, int bytesperline, int x, int y,
+                             int width, int height) {
+    //
+}
+
+void shell_beeper(int tone) {
+    //
+}
+
+void shell_annunciators(int updn, int shf, int prt, int run, int g, int rad) {
+    //
+}
+
+bool shell_wants_cpu() {
+    return false;
+}
+
+void shell_delay(int duration) {
+    //
+}
+
+void shell_request_timeout3(int delay) {
+    //
+}
+
+uint8 shell_get_mem() {
+    return 0;
+}
+
+bool shell_low_battery() {
+    return false;
+}
+
+void shell_powerdown() {
+    //
+}
+
+int8 shell_random_seed() {
+    return 0;
+}
+
+uint4 shell_milliseconds() {
+    return 0;
+}
+
+const char *shell_number_format() {
+    return localeconv()->decimal_point;
+}
+
+int shell_date_format() {
+    return 0;
+}
+
+bool shell_clk24() {
+    return false;
+}
+
+void shell_print(const char *text, int length,
+                 const char *bits, int bytesperline,
+                 int x, int y, int width, int height) {
+    //
+}
+
+void shell_get_time_date(uint4 *time, uint4 *date, int *weekday) {
+    *time = 0;
+    *date = 15821015;
+    *weekday = 5;
+}
+
+void shell_message(const char *message) {
+    //
+}
+
+void shell_log(const char *message) {
+    //
+}
@@ -165,7 +165,7 @@ struct gif_data {
     int height;
 };
 
-static gif_data *g;
+static CORE_TLS gif_data *g;
 
 
 int shell_start_gif(file_writer writer, int width, int provisional_height) {
@@ -0,0 +1,338 @@
+/*****************************************************************************
+ * Free42 -- an HP-42S calculator simulator
+ * Copyright (C) 2004-2025  Thomas Okken
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses/.
+ *****************************************************************************/
+
+/* batchrun: runs a program without a user interface, and prints the
+ * resulting stack, along with the run time, the number of instructions
+ * executed, and the number of variables allocated, as JSON. Meant for
+ * scripted testing and benchmarking, e.g. comparing Decimal and Binary
+ * builds, or interpreted and compiled programs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "core_main.h"
+#include "core_commands2.h"
+#include "core_globals.h"
+#include "core_helpers.h"
+#include "shell_spool.h"
+
+static double now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-s <state-file>] [-w <state-file>] [-r <raw-file>]... <label> [<x>...]\n"
+                    "The <x> values are entered in order, so the last one ends up in X.\n"
+                    "-w saves the state after the run.\n", name);
+    exit(1);
+}
+
+static void print_json_string(const char *text, int length) {
+    char *buf = (char *) malloc(5 * length + 1);
+    if (buf == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    int len = hp2ascii(buf, text, length);
+    putchar('"');
+    for (int i = 0; i < len; i++) {
+        unsigned char c = buf[i];
+        if (c == '"' || c == '\\')
+            printf("\\%c", c);
+        else if (c == '\n')
+            printf("\\n");
+        else if (c < 32)
+            printf("\\u%04x", c);
+        else
+            putchar(c);
+    }
+    putchar('"');
+    free(buf);
+}
+
+/* Numbers are printed with all their digits, so the output can be compared
+ * between runs; infinities and NaNs, which JSON doesn't have, become strings.
+ */
+static void print_json_number(phloat x) {
+    if (p_isnan(x)) {
+        printf("\"NaN\"");
+        return;
+    }
+    if (p_isinf(x)) {
+        printf(x > 0 ? "\"Infinity\"" : "\"-Infinity\"");
+        return;
+    }
+    char buf[50];
+    int len = phloat2string(x, buf, 49, 1, 0, 3, 0, MAX_MANT_DIGITS);
+    // JSON wants a digit on both sides of the decimal point, so "1." and
+    // "1.e-300" lose their points, and ".5" gets a leading zero.
+    for (int i = 0; i < len; i++) {
+        char c = buf[i];
+        if (c == 24)
+            putchar('e');
+        else if (c != '.')
+            putchar(c);
+        else if (i + 1 < len && buf[i + 1] >= '0' && buf[i + 1] <= '9') {
+            if (i == 0 || buf[i - 1] < '0' || buf[i - 1] > '9')
+                putchar('0');
+            putchar('.');
+        }
+    }
+}
+
+static void print_json_complex(phloat re, phloat im) {
+    printf("{\"re\": ");
+    print_json_number(re);
+    printf(", \"im\": ");
+    print_json_number(im);
+    printf("}");
+}
+
+static void print_json_value(const vartype *v) {
+    switch (v->type) {
+        case TYPE_REAL:
+            print_json_number(((vartype_real *) v)->x);
+            break;
+        case TYPE_COMPLEX: {
+            vartype_complex *c = (vartype_complex *) v;
+            print_json_complex(c->re, c->im);
+            break;
+        }
+        case TYPE_STRING: {
+            vartype_string *s = (vartype_string *) v;
+            print_json_string(s->txt(), s->length);
+            break;
+        }
+        case TYPE_REALMATRIX: {
+            vartype_realmatrix *rm = (vartype_realmatrix *) v;
+            putchar('[');
+            for (int4 r = 0; r < rm->rows; r++) {
+                printf(r == 0 ? "[" : ", [");
+                for (int4 c = 0; c < rm->columns; c++) {
+                    int4 i = r * rm->columns + c;
+                    if (c > 0)
+                        printf(", ");
+                    if (rm->array->is_string[i] == 0)
+                        print_json_number(rm->array->data[i]);
+                    else {
+                        const char *text;
+                        int4 len;
+                        get_matrix_string(rm, i, &text, &len);
+                        print_json_string(text, len);
+                    }
+                }
+                putchar(']');
+            }
+            putchar(']');
+            break;
+        }
+        case TYPE_COMPLEXMATRIX: {
+            vartype_complexmatrix *cm = (vartype_complexmatrix *) v;
+            putchar('[');
+            for (int4 r = 0; r < cm->rows; r++) {
+                printf(r == 0 ? "[" : ", [");
+                for (int4 c = 0; c < cm->columns; c++) {
+                    int4 i = 2 * (r * cm->columns + c);
+                    if (c > 0)
+                        printf(", ");
+                    print_json_complex(cm->array->data[i], cm->array->data[i + 1]);
+                }
+                putchar(']');
+            }
+            putchar(']');
+            break;
+        }
+        case TYPE_LIST: {
+            vartype_list *list = (vartype_list *) v;
+            putchar('[');
+            for (int4 i = 0; i < list->size; i++) {
+                if (i > 0)
+                    printf(", ");
+                print_json_value(list->array->data[i]);
+            }
+            putchar(']');
+            break;
+        }
+        default:
+            printf("null");
+            break;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const char *state_file = NULL;
+    const char *out_state_file = NULL;
+    int argp = 1;
+    while (argp < argc && (strcmp(argv[argp], "-s") == 0
+                || strcmp(argv[argp], "-w") == 0
+                || strcmp(argv[argp], "-r") == 0)) {
+        if (argp + 1 == argc)
+            usage(argv[0]);
+        if (argv[argp][1] == 's')
+            state_file = argv[argp + 1];
+        else if (argv[argp][1] == 'w')
+            out_state_file = argv[argp + 1];
+        argp += 2;
+    }
+    if (argp == argc)
+        usage(argv[0]);
+    const char *label = argv[argp];
+    int labellen = strlen(label);
+    if (labellen > 7) {
+        fprintf(stderr, "Label too long: %s\n", label);
+        return 1;
+    }
+
+    if (state_file == NULL)
+        core_init(0, 0, NULL, 0);
+    else
+        core_init(1, 26, state_file, 0);
+    // Now that the core is up, load the programs
+    for (int i = 1; i < argp; i += 2)
+        if (strcmp(argv[i], "-r") == 0)
+            core_import_programs(0, argv[i + 1]);
+
+    for (int i = argp + 1; i < argc; i++)
+        core_paste(argv[i]);
+
+    arg_struct arg;
+    arg.type = ARGTYPE_STR;
+    arg.length = labellen;
+    memcpy(arg.val.text, label, labellen);
+    core_stats.instructions = 0;
+    core_stats.allocations = 0;
+    core_stats.errors = 0;
+    double start = now();
+    int err = docmd_xeq(&arg);
+    if (err != ERR_RUN) {
+        fprintf(stderr, "XEQ \"%s\" failed: %.*s\n", label, errors[err].length, errors[err].text);
+        return 1;
+    }
+    set_running(true);
+    bool enqueued;
+    int repeat;
+    while (core_keydown(0, &enqueued, &repeat))
+        ;
+    double elapsed = now() - start;
+
+    printf("{\n  \"label\": ");
+    print_json_string(label, labellen);
+    printf(",\n  \"error\": %s,\n  \"stack\": [", core_stats.errors != 0 ? "true" : "false");
+    // X first, then Y, Z, T, and any levels above that
+    for (int i = sp; i >= 0; i--) {
+        printf(i == sp ? "\n    " : ",\n    ");
+        print_json_value(stack[i]);
+    }
+    printf("%s],\n", sp >= 0 ? "\n  " : "");
+    printf("  \"elapsed_ms\": %.3f,\n", elapsed * 1000);
+    printf("  \"instructions\": %llu,\n", core_stats.instructions);
+    printf("  \"allocations\": %llu\n}\n", core_stats.allocations);
+
+    if (out_state_file != NULL)
+        core_save_state(out_state_file);
+    core_cleanup();
+    return 0;
+}
+
+const char *shell_platform() {
+    // Written into the state file by -w
+    return "batchrun";
+}
+
+void shell_blitter(const char *bits, int bytesperline, int x, int y,
+                             int width, int height) {
+    //
+}
+
+void shell_beeper(int tone) {
+    //
+}
+
+void shell_annunciators(int updn, int shf, int prt, int run, int g, int rad) {
+    //
+}
+
+bool shell_wants_cpu() {
+    return false;
+}
+
+void shell_delay(int duration) {
+    //
+}
+
+void shell_request_timeout3(int delay) {
+    //
+}
+
+uint8 shell_get_mem() {
+    return 0;
+}
+
+bool shell_low_battery() {
+    return false;
+}
+
+void shell_powerdown() {
+    //
+}
+
+int8 shell_random_seed() {
+    return 0;
+}
+
+uint4 shell_milliseconds() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint4) (tv.tv_sec * 1000L + tv.tv_usec / 1000);
+}
+
+const char *shell_number_format() {
+    return ".";
+}
+
+int shell_date_format() {
+    return 0;
+}
+
+bool shell_clk24() {
+    return false;
+}
+
+void shell_print(const char *text, int length,
+                 const char *bits, int bytesperline,
+                 int x, int y, int width, int height) {
+    //
+}
+
+void shell_get_time_date(uint4 *time, uint4 *date, int *weekday) {
+    *time = 0;
+    *date = 15821015;
+    *weekday = 5;
+}
+
+void shell_message(const char *message) {
+    //
+}
+
+void shell_log(const char *message) {
+    //
+}
@@ -0,0 +1,858 @@
+/*****************************************************************************
+ * Free42 -- an HP-42S calculator simulator
+ * Copyright (C) 2004-2025  Thomas Okken
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses/.
+ *****************************************************************************/
+
+/* benchsuite: runs a fixed set of typical calculator workloads, and prints
+ * how many operations per second each one achieves, and its peak memory use.
+ * Each workload runs in a process of its own, forked after the core has been
+ * initialized, so that its peak is not hidden by that of an earlier,
+ * hungrier one. The workloads and their operation counts
+ * don't change between versions, so the numbers can be compared across
+ * builds, to catch performance regressions, and to measure optimizations.
+ * Build it with BCD_MATH=1 to measure the Decimal version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include "core_main.h"
+#include "core_commands2.h"
+#include "core_globals.h"
+#include "core_helpers.h"
+#include "core_variables.h"
+
+static const char *bench_prgms =
+    // Tight loop: 999 ISG iterations, repeated X times
+    "01 LBL \"ISG\"\n"
+    "02 STO 01\n"
+    "03 LBL 01\n"
+    "04 1.999\n"
+    "05 STO 00\n"
+    "06 LBL 02\n"
+    "07 ISG 00\n"
+    "08 GTO 02\n"
+    "09 DSE 01\n"
+    "10 GTO 01\n"
+    "11 RTN\n"
+    // Two levels of subroutine calls with local variables, X times
+    "12 LBL \"NEST\"\n"
+    "13 STO 00\n"
+    "14 LBL 03\n"
+    "15 RCL 00\n"
+    "16 XEQ 10\n"
+    "17 DSE 00\n"
+    "18 GTO 03\n"
+    "19 RTN\n"
+    "20 LBL 10\n"
+    "21 LSTO \"A\"\n"
+    "22 XEQ 11\n"
+    "23 RCL \"A\"\n"
+    "24 +\n"
+    "25 RTN\n"
+    "26 LBL 11\n"
+    "27 LSTO \"B\"\n"
+    "28 RCL× \"B\"\n"
+    "29 RTN\n"
+    // Solve x^2 = 2, X times
+    "30 LBL \"SOLV\"\n"
+    "31 STO 02\n"
+    "32 LBL 04\n"
+    "33 PGMSLV \"FX\"\n"
+    "34 1\n"
+    "35 STO \"X\"\n"
+    "36 2\n"
+    "37 SOLVE \"X\"\n"
+    "38 DSE 02\n"
+    "39 GTO 04\n"
+    "40 RTN\n"
+    "41 LBL \"FX\"\n"
+    "42 MVAR \"X\"\n"
+    "43 RCL \"X\"\n"
+    "44 X↑2\n"
+    "45 2\n"
+    "46 -\n"
+    "47 RTN\n"
+    // Integrate sin(t) from 0 to 1, X times
+    "48 LBL \"INT\"\n"
+    "49 STO 02\n"
+    "50 RAD\n"
+    "51 PGMINT \"FI\"\n"
+    "52 0\n"
+    "53 STO \"LLIM\"\n"
+    "54 1\n"
+    "55 STO \"ULIM\"\n"
+    "56 1E-6\n"
+    "57 STO \"ACC\"\n"
+    "58 LBL 05\n"
+    "59 INTEG \"T\"\n"
+    "60 DSE 02\n"
+    "61 GTO 05\n"
+    "62 RTN\n"
+    "63 LBL \"FI\"\n"
+    "64 MVAR \"T\"\n"
+    "65 RCL \"T\"\n"
+    "66 SIN\n"
+    "67 RTN\n"
+    // Matrix operations on A and B, which are set up by the caller
+    "68 LBL \"MMUL\"\n"
+    "69 RCL \"A\"\n"
+    "70 RCL \"B\"\n"
+    "71 ×\n"
+    "72 DROP\n"
+    "73 RTN\n"
+    "74 LBL \"MINV\"\n"
+    "75 RCL \"A\"\n"
+    "76 INVRT\n"
+    "77 DROP\n"
+    "78 RTN\n"
+    "79 LBL \"MDIV\"\n"
+    "80 RCL \"B\"\n"
+    "81 RCL \"A\"\n"
+    "82 ÷\n"
+    "83 DROP\n"
+    "84 RTN\n"
+    // Build a 99-character string, X times
+    "85 LBL \"STR\"\n"
+    "86 STO 00\n"
+    "87 LBL 06\n"
+    "88 49\n"
+    "89 STO 01\n"
+    "90 XSTR \"x\"\n"
+    "91 LBL 07\n"
+    "92 XSTR \"ab\"\n"
+    "93 APPEND\n"
+    "94 DSE 01\n"
+    "95 GTO 07\n"
+    "96 DROP\n"
+    "97 DSE 00\n"
+    "98 GTO 06\n"
+    "99 RTN\n"
+    // Build a 50-element list and reverse it, X times
+    "100 LBL \"LIST\"\n"
+    "101 STO 00\n"
+    "102 LBL 08\n"
+    "103 50\n"
+    "104 STO 01\n"
+    "105 NEWLIST\n"
+    "106 LBL 09\n"
+    "107 RCL 01\n"
+    "108 APPEND\n"
+    "109 DSE 01\n"
+    "110 GTO 09\n"
+    "111 REV\n"
+    "112 LENGTH\n"
+    "113 DROP\n"
+    "114 DSE 00\n"
+    "115 GTO 08\n"
+    "116 RTN\n"
+    // Accumulate X data points
+    "117 LBL \"SUM\"\n"
+    "118 STO 00\n"
+    "119 CLΣ\n"
+    "120 LBL 12\n"
+    "121 RCL 00\n"
+    "122 ENTER\n"
+    "123 X↑2\n"
+    "124 Σ+\n"
+    "125 DSE 00\n"
+    "126 GTO 12\n"
+    "127 RTN\n"
+    // Integrate 2t^3 - 3t^2 + t + 1 from 0 to 2, using Y^X, X times
+    "128 LBL \"POLY\"\n"
+    "129 STO 02\n"
+    "130 PGMINT \"FP\"\n"
+    "131 0\n"
+    "132 STO \"LLIM\"\n"
+    "133 2\n"
+    "134 STO \"ULIM\"\n"
+    "135 1E-6\n"
+    "136 STO \"ACC\"\n"
+    "137 LBL 13\n"
+    "138 INTEG \"T\"\n"
+    "139 DSE 02\n"
+    "140 GTO 13\n"
+    "141 RTN\n"
+    "142 LBL \"FP\"\n"
+    "143 MVAR \"T\"\n"
+    "144 RCL \"T\"\n"
+    "145 3\n"
+    "146 Y↑X\n"
+    "147 2\n"
+    "148 ×\n"
+    "149 RCL \"T\"\n"
+    "150 2\n"
+    "151 Y↑X\n"
+    "152 3\n"
+    "153 ×\n"
+    "154 -\n"
+    "155 RCL \"T\"\n"
+    "156 +\n"
+    "157 1\n"
+    "158 +\n"
+    "159 RTN\n"
+    // H.MMSS conversions and arithmetic, X times
+    "160 LBL \"HMS\"\n"
+    "161 STO 00\n"
+    "162 LBL 14\n"
+    "163 1.4523\n"
+    "164 →HR\n"
+    "165 →HMS\n"
+    "166 0.3045\n"
+    "167 HMS+\n"
+    "168 DROP\n"
+    "169 DSE 00\n"
+    "170 GTO 14\n"
+    "171 RTN\n"
+    // Degree/radian conversions and SIN in DEG mode, X times
+    "172 LBL \"ANG\"\n"
+    "173 STO 00\n"
+    "174 DEG\n"
+    "175 LBL 15\n"
+    "176 30\n"
+    "177 →RAD\n"
+    "178 →DEG\n"
+    "179 SIN\n"
+    "180 DROP\n"
+    "181 DSE 00\n"
+    "182 GTO 15\n"
+    "183 RAD\n"
+    "184 RTN\n"
+    // BASE arithmetic, converting to and from integers, X times
+    "185 LBL \"BASE\"\n"
+    "186 STO 00\n"
+    "187 LBL 16\n"
+    "188 12345\n"
+    "189 678\n"
+    "190 BASE+\n"
+    "191 255\n"
+    "192 AND\n"
+    "193 3\n"
+    "194 BASE×\n"
+    "195 DROP\n"
+    "196 DSE 00\n"
+    "197 GTO 16\n"
+    "198 RTN\n"
+    // RAN, X times
+    "199 LBL \"RAN\"\n"
+    "200 STO 00\n"
+    "201 LBL 17\n"
+    "202 RAN\n"
+    "203 DROP\n"
+    "204 DSE 00\n"
+    "205 GTO 17\n"
+    "206 RTN\n"
+    // Fill a 100x100 matrix with random numbers using RANM, X times
+    "207 LBL \"RANM\"\n"
+    "208 STO 00\n"
+    "209 100\n"
+    "210 ENTER\n"
+    "211 NEWMAT\n"
+    "212 LBL 18\n"
+    "213 RANM\n"
+    "214 DSE 00\n"
+    "215 GTO 18\n"
+    "216 DROP\n"
+    "217 RTN\n"
+    // Solve A X = B, keeping the solution in X
+    "218 LBL \"HILB\"\n"
+    "219 RCL \"B\"\n"
+    "220 RCL \"A\"\n"
+    "221 ÷\n"
+    "222 STO \"X\"\n"
+    "223 DROP\n"
+    "224 RTN\n"
+    // Determinant of A, which overflows at the larger sizes
+    "225 LBL \"MDET\"\n"
+    "226 SF 24\n"
+    "227 RCL \"A\"\n"
+    "228 DET\n"
+    "229 DROP\n"
+    "230 CF 24\n"
+    "231 RTN\n"
+    // Solve A X = C, with a single right-hand side
+    "232 LBL \"MSOL\"\n"
+    "233 RCL \"C\"\n"
+    "234 RCL \"A\"\n"
+    "235 ÷\n"
+    "236 DROP\n"
+    "237 RTN\n"
+    // Complex matrix operations on CA and CB, which are set up by the caller
+    "238 LBL \"CMUL\"\n"
+    "239 RCL \"CA\"\n"
+    "240 RCL \"CB\"\n"
+    "241 ×\n"
+    "242 DROP\n"
+    "243 RTN\n"
+    "244 LBL \"CDIV\"\n"
+    "245 RCL \"CB\"\n"
+    "246 RCL \"CA\"\n"
+    "247 ÷\n"
+    "248 DROP\n"
+    "249 RTN\n";
+
+struct workload {
+    const char *name;
+    const char *label;
+    int matrix_size;
+    int4 count;
+    int4 ops_per_count;
+    const char *op;
+};
+
+/* For the programs, 'count' goes in X; the matrix workloads run their
+ * program 'count' times, "SAVE" saves and reloads the state 'count' times,
+ * "CONV" formats and parses a set of sample numbers 'count' times, and
+ * "VARS" creates, recalls, and purges 10,000 named variables 'count' times,
+ * purging the newest first, and "PDOT", "PCMP", and "PSIN" run their phloat
+ * loop over PHLOAT_N numbers 'count' times.
+ */
+static workload workloads[] = {
+    { "isg-loop",   "ISG",     0,  1000, 999, "loop" },
+    { "nested-xeq", "NEST",    0, 50000,   2, "call" },
+    { "solve",      "SOLV",    0, 10000,   1, "solve" },
+    { "integ",      "INT",     0,  2000,   1, "integ" },
+    { "integ-poly", "POLY",    0,  2000,   1, "integ" },
+    { "mul-50",     "MMUL",   50,   100,   1, "mul" },
+    { "mul-100",    "MMUL",  100,    20,   1, "mul" },
+    { "mul-200",    "MMUL",  200,     3,   1, "mul" },
+    { "mul-300",    "MMUL",  300,     1,   1, "mul" },
+    { "inv-50",     "MINV",   50,   100,   1, "inv" },
+    { "inv-100",    "MINV",  100,    20,   1, "inv" },
+    { "inv-200",    "MINV",  200,     3,   1, "inv" },
+    { "inv-300",    "MINV",  300,     1,   1, "inv" },
+    { "inv-500",    "MINV",  500,     1,   1, "inv" },
+    { "simq-50",    "MDIV",   50,   100,   1, "simq" },
+    { "simq-100",   "MDIV",  100,    20,   1, "simq" },
+    { "simq-200",   "MDIV",  200,     3,   1, "simq" },
+    { "simq-300",   "MDIV",  300,     1,   1, "simq" },
+    { "simq-500",   "MDIV",  500,     1,   1, "simq" },
+    { "det-50",     "MDET",   50,   100,   1, "det" },
+    { "det-100",    "MDET",  100,    20,   1, "det" },
+    { "det-200",    "MDET",  200,     3,   1, "det" },
+    { "det-300",    "MDET",  300,     1,   1, "det" },
+    { "det-500",    "MDET",  500,     1,   1, "det" },
+    { "solve-50",   "MSOL",   50,   100,   1, "solve" },
+    { "solve-100",  "MSOL",  100,    20,   1, "solve" },
+    { "solve-200",  "MSOL",  200,     3,   1, "solve" },
+    { "solve-300",  "MSOL",  300,     1,   1, "solve" },
+    { "solve-500",  "MSOL",  500,     1,   1, "solve" },
+    { "cmul-50",    "CMUL",   50,    50,   1, "mul" },
+    { "cmul-100",   "CMUL",  100,    10,   1, "mul" },
+    { "cmul-200",   "CMUL",  200,     1,   1, "mul" },
+    { "csimq-50",   "CDIV",   50,    50,   1, "simq" },
+    { "csimq-100",  "CDIV",  100,    10,   1, "simq" },
+    { "csimq-200",  "CDIV",  200,     1,   1, "simq" },
+    { "string",     "STR",     0,  2000,  49, "append" },
+    { "list",       "LIST",    0,  2000,  50, "append" },
+    { "sigma",      "SUM",     0, 50000,   1, "Σ+" },
+    { "save-load",  "SAVE",    0,    50,   1, "cycle" },
+    { "convert",    "CONV",    0, 20000,  24, "conversion" },
+    { "hms",        "HMS",     0, 50000,   3, "conversion" },
+    { "angle",      "ANG",     0, 50000,   3, "conversion" },
+    { "base",       "BASE",    0, 50000,   3, "BASE op" },
+    { "ran",        "RAN",     0, 50000,   1, "number" },
+    { "ran-matrix", "RANM",    0,    50, 10000, "number" },
+    { "vars-10k",   "VARS",    0,   100, 30000, "STO/RCL/purge" },
+    { "phloat-dot", "PDOT",    0,  2000, 1000, "op" },
+    { "phloat-cmp", "PCMP",    0,  2000, 1000, "op" },
+    { "phloat-sin", "PSIN",    0,   200, 1000, "op" },
+    { "hilbert-10", "HILB",   10,   200,   1, "simq" },
+    { NULL, NULL, 0, 0, 0, NULL }
+};
+
+static const char *state_file_name = "benchsuite.f42";
+
+static double now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static long peak_kb() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+#ifdef __APPLE__
+    return ru.ru_maxrss / 1024;
+#else
+    return ru.ru_maxrss;
+#endif
+}
+
+/* Prints the rate with four significant digits, so the slow workloads,
+ * which take more than a second per operation, don't show up as 0.
+ */
+static void print_rate(double rate) {
+    int decimals = rate > 0 ? 3 - (int) floor(log10(rate)) : 0;
+    if (decimals < 0)
+        decimals = 0;
+    printf(" %13.*f", decimals, rate);
+}
+
+static void load_programs() {
+    flags.f.prgm_mode = 1;
+    core_paste(bench_prgms);
+    flags.f.prgm_mode = 0;
+}
+
+/* A is diagonally dominant, so it is well-conditioned at every size, and
+ * inverting it and dividing by it take the same path every time.
+ */
+static void setup_matrices(int n) {
+    vartype *a = new_realmatrix(n, n);
+    vartype *b = new_realmatrix(n, n);
+    vartype *c = new_realmatrix(n, 1);
+    if (a == NULL || b == NULL || c == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    phloat *ad = ((vartype_realmatrix *) a)->array->data;
+    phloat *bd = ((vartype_realmatrix *) b)->array->data;
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < n; j++) {
+            ad[i * n + j] = phloat(1) / (i + j + 1) + (i == j ? n : 0);
+            bd[i * n + j] = (i * 7 + j * 3) % 11 - 5;
+        }
+    phloat *cd = ((vartype_realmatrix *) c)->array->data;
+    for (int i = 0; i < n; i++)
+        cd[i] = i % 7 - 3;
+    store_var("A", 1, a);
+    store_var("B", 1, b);
+    store_var("C", 1, c);
+}
+
+/* The complex counterparts of A and B, in CA and CB; CA is diagonally
+ * dominant as well.
+ */
+static void setup_complex_matrices(int n) {
+    vartype *a = new_complexmatrix(n, n);
+    vartype *b = new_complexmatrix(n, n);
+    if (a == NULL || b == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    phloat *ad = ((vartype_complexmatrix *) a)->array->data;
+    phloat *bd = ((vartype_complexmatrix *) b)->array->data;
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < n; j++) {
+            ad[2 * (i * n + j)] = phloat(1) / (i + j + 1) + (i == j ? n : 0);
+            ad[2 * (i * n + j) + 1] = phloat(1) / (i + 2 * j + 2);
+            bd[2 * (i * n + j)] = (i * 7 + j * 3) % 11 - 5;
+            bd[2 * (i * n + j) + 1] = (i * 3 + j * 5) % 13 - 6;
+        }
+    store_var("CA", 2, a);
+    store_var("CB", 2, b);
+}
+
+/* A is the n x n Hilbert matrix, scaled by the least common multiple of
+ * 1 through 2n - 1 so that all its elements are integers, and B is A times
+ * (1, 2, ..., n); both are exact in Binary and Decimal alike. A is
+ * ill-conditioned (about 10^13 for n = 10), so the error in the solution
+ * shows how much precision the LU decomposition and back-substitution lose.
+ */
+static void setup_hilbert(int n) {
+    vartype *a = new_realmatrix(n, n);
+    vartype *b = new_realmatrix(n, 1);
+    if (a == NULL || b == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    int8 lcm = 1;
+    for (int8 k = 2; k < 2 * n; k++) {
+        int8 x = lcm, y = k;
+        while (y != 0) {
+            int8 t = x % y;
+            x = y;
+            y = t;
+        }
+        lcm = lcm / x * k;
+    }
+    phloat *ad = ((vartype_realmatrix *) a)->array->data;
+    phloat *bd = ((vartype_realmatrix *) b)->array->data;
+    for (int i = 0; i < n; i++) {
+        int8 sum = 0;
+        for (int j = 0; j < n; j++) {
+            int8 aij = lcm / (i + j + 1);
+            ad[i * n + j] = aij;
+            sum += aij * (j + 1);
+        }
+        bd[i] = sum;
+    }
+    store_var("A", 1, a);
+    store_var("B", 1, b);
+}
+
+/* The largest relative error in the solution found by "HILB" */
+static double hilbert_error() {
+    vartype_realmatrix *x = (vartype_realmatrix *) recall_var("X", 1);
+    if (x == NULL || x->type != TYPE_REALMATRIX)
+        return -1;
+    double max = 0;
+    for (int4 i = 0; i < x->rows; i++) {
+        double err = to_double(x->array->data[i] / (i + 1) - 1);
+        if (err < 0)
+            err = -err;
+        if (err > max)
+            max = err;
+    }
+    return max;
+}
+
+static bool run_prgm(const char *label, int4 x) {
+    if (x != 0) {
+        char buf[20];
+        snprintf(buf, 20, "%d", x);
+        core_paste(buf);
+    }
+    arg_struct arg;
+    arg.type = ARGTYPE_STR;
+    arg.length = strlen(label);
+    memcpy(arg.val.text, label, arg.length);
+    core_stats.errors = 0;
+    if (docmd_xeq(&arg) != ERR_RUN)
+        return false;
+    set_running(true);
+    bool enqueued;
+    int repeat;
+    while (core_keydown(0, &enqueued, &repeat))
+        ;
+    return core_stats.errors == 0;
+}
+
+/* Each sample is formatted for the display, in FIX 4 with thousands
+ * separators, and with all digits, the way core_copy() does it, and the
+ * latter is parsed back, which must give the same number again.
+ */
+static bool run_convert(int4 count) {
+    phloat samples[8] = {
+        1, -42, phloat(1) / 10, phloat(12345678) / 1000,
+        phloat(1) / 3, phloat(-22) / 7, 1000000, phloat(1) / 1024
+    };
+    char buf[50];
+    for (int4 i = 0; i < count; i++)
+        for (int j = 0; j < 8; j++) {
+            phloat2string(samples[j], buf, 50, 0, 4, 0, 1, 12);
+            int len = phloat2string(samples[j], buf, 50, 0, 0, 3, 0, MAX_MANT_DIGITS);
+            phloat x;
+            if (string2phloat(buf, len, &x) != 0 || x != samples[j])
+                return false;
+        }
+    return true;
+}
+
+#define STRESS_VARS 10000
+
+static bool run_vars(int4 count) {
+    char name[8];
+    for (int4 c = 0; c < count; c++) {
+        for (int i = 0; i < STRESS_VARS; i++) {
+            int len = snprintf(name, 8, "V%d", i);
+            vartype *v = new_real(i);
+            if (v == NULL)
+                return false;
+            if (store_var(name, len, v) != ERR_NONE) {
+                free_vartype(v);
+                return false;
+            }
+        }
+        for (int i = 0; i < STRESS_VARS; i++) {
+            int len = snprintf(name, 8, "V%d", i);
+            vartype *v = recall_var(name, len);
+            if (v == NULL || v->type != TYPE_REAL
+                    || ((vartype_real *) v)->x != i)
+                return false;
+        }
+        for (int i = STRESS_VARS - 1; i >= 0; i--) {
+            int len = snprintf(name, 8, "V%d", i);
+            if (!purge_var(name, len))
+                return false;
+        }
+    }
+    return true;
+}
+
+#define PHLOAT_N 1000
+
+static volatile double phloat_sink;
+
+/* Microbenchmarks for phloat itself, which in the Decimal build measure the
+ * overhead of the Phloat wrapper around the BID library: s += a[i] * b[i],
+ * x = x + a[i] followed by x > b[i], and s += sin(a[i]).
+ */
+static bool run_phloat(const char *label, int4 count) {
+    static phloat a[PHLOAT_N], b[PHLOAT_N];
+    for (int i = 0; i < PHLOAT_N; i++) {
+        a[i] = phloat(i + 1) / 7;
+        b[i] = phloat(PHLOAT_N - i) / 13;
+    }
+    phloat s = 0;
+    int4 hits = 0;
+    for (int4 c = 0; c < count; c++) {
+        if (strcmp(label, "PDOT") == 0) {
+            for (int i = 0; i < PHLOAT_N; i++)
+                s += a[i] * b[i];
+        } else if (strcmp(label, "PCMP") == 0) {
+            phloat x = 0;
+            for (int i = 0; i < PHLOAT_N; i++) {
+                x = x + a[i];
+                if (x > b[i])
+                    hits++;
+            }
+        } else {
+            for (int i = 0; i < PHLOAT_N; i++)
+                s += sin(a[i]);
+        }
+    }
+    // Keep the results, so the loops can't be optimized away
+    phloat_sink = to_double(s) + hits;
+    return true;
+}
+
+static bool run_workload(const workload *w, int4 count) {
+    if (strcmp(w->label, "CONV") == 0)
+        return run_convert(count);
+    if (strcmp(w->label, "VARS") == 0)
+        return run_vars(count);
+    if (strcmp(w->label, "PDOT") == 0 || strcmp(w->label, "PCMP") == 0
+            || strcmp(w->label, "PSIN") == 0)
+        return run_phloat(w->label, count);
+    if (strcmp(w->label, "SAVE") == 0) {
+        for (int4 i = 0; i < count; i++) {
+            core_save_state(state_file_name);
+            core_cleanup();
+            core_init(1, 26, state_file_name, 0);
+        }
+        return true;
+    }
+    if (w->matrix_size == 0)
+        return run_prgm(w->label, count);
+    for (int4 i = 0; i < count; i++) {
+        if (!run_prgm(w->label, 0))
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    bool binary_engine = false;
+    bool mixed_precision = false;
+    bool transcendental_cache = true;
+    int accumulation = ACCUMULATE_PLAIN;
+    bool calibrate = false;
+    int threads = 1;
+    double scale = 1;
+    while (argc > 1 && argv[1][0] == '-') {
+        if (strcmp(argv[1], "-b") == 0)
+            binary_engine = true;
+        else if (strcmp(argv[1], "-m") == 0)
+            mixed_precision = true;
+        else if (strcmp(argv[1], "-n") == 0)
+            transcendental_cache = false;
+        else if (strcmp(argv[1], "-f") == 0)
+            accumulation = ACCUMULATE_FMA;
+        else if (strcmp(argv[1], "-c") == 0)
+            accumulation = ACCUMULATE_COMPENSATED;
+        else if (strcmp(argv[1], "-t") == 0)
+            calibrate = true;
+        else if (strncmp(argv[1], "-j", 2) == 0)
+            threads = atoi(argv[1] + 2);
+        else
+            scale = 0;
+        argv++;
+        argc--;
+    }
+    if (argc > 1)
+        scale = atof(argv[1]);
+    if (scale <= 0) {
+        fprintf(stderr, "Usage: %s [-b] [-m] [-n] [-f|-c] [-t] [-j<threads>] [<scale> [<workload>...]]\n", argv[0]);
+        return 1;
+    }
+
+    core_init(0, 0, NULL, 0);
+    core_settings.binary_engine = binary_engine;
+    core_settings.mixed_precision = mixed_precision;
+    core_settings.transcendental_cache = transcendental_cache;
+    core_settings.accumulation = accumulation;
+    // The workloads run in forked children, which don't inherit any matrix
+    // threads, so those must not be started before then
+    core_settings.matrix_threads = 1;
+    if (calibrate)
+        core_calibrate_matrix_block_size();
+    core_settings.matrix_threads = threads;
+    load_programs();
+
+#ifdef BCD_MATH
+    printf(binary_engine ? "Decimal build, binary engine" : "Decimal build");
+    if (mixed_precision)
+        printf(", mixed precision");
+    if (!transcendental_cache)
+        printf(", no transcendental cache");
+#else
+    printf("Binary build");
+#endif
+    if (accumulation == ACCUMULATE_FMA)
+        printf(", FMA accumulation");
+    else if (accumulation == ACCUMULATE_COMPENSATED)
+        printf(", compensated accumulation");
+    printf(", block size %d", core_settings.matrix_block_size);
+#ifdef LINALG_THREADS
+    printf(threads == 1 ? ", 1 thread" : threads == 0 ? ", all processors"
+                        : ", %d threads", threads);
+#endif
+    printf("\n");
+    printf("workload          ops     time (s)         ops/s  peak (KB)\n");
+    for (workload *w = workloads; w->name != NULL; w++) {
+        if (argc > 2) {
+            bool selected = false;
+            for (int i = 2; i < argc; i++)
+                if (strcmp(argv[i], w->name) == 0)
+                    selected = true;
+            if (!selected)
+                continue;
+        }
+        int4 count = (int4) (w->count * scale);
+        if (count < 1)
+            count = 1;
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == -1) {
+            perror("fork");
+            return 1;
+        }
+        if (pid != 0) {
+            int status;
+            if (waitpid(pid, &status, 0) == -1
+                    || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+                return 1;
+            continue;
+        }
+        bool hilbert = strcmp(w->label, "HILB") == 0;
+        if (hilbert)
+            setup_hilbert(w->matrix_size);
+        else if (strcmp(w->label, "CMUL") == 0 || strcmp(w->label, "CDIV") == 0)
+            setup_complex_matrices(w->matrix_size);
+        else if (w->matrix_size != 0)
+            setup_matrices(w->matrix_size);
+        double start = now();
+        bool ok = run_workload(w, count);
+        double t = now() - start;
+        if (!ok) {
+            fprintf(stderr, "Workload %s failed\n", w->name);
+            _exit(1);
+        }
+        double ops = (double) count * w->ops_per_count;
+        printf("%-12s %8.0f %12.3f", w->name, ops, t);
+        print_rate(ops / t);
+        printf(" %10ld  (%s", peak_kb(), w->op);
+        if (hilbert)
+            printf(", error %.1e", hilbert_error());
+        printf(")\n");
+        fflush(stdout);
+        _exit(0);
+    }
+    remove(state_file_name);
+    core_cleanup();
+    return 0;
+}
+
+const char *shell_platform() {
+    // Written to the state file by the save-load workload
+    return "benchsuite";
+}
+
+void shell_blitter(const char *bits, int bytesperline, int x, int y,
+                             int width, int height) {
+    //
+}
+
+void shell_beeper(int tone) {
+    //
+}
+
+void shell_annunciators(int updn, int shf, int prt, int run, int g, int rad) {
+    //
+}
+
+bool shell_wants_cpu() {
+    return false;
+}
+
+void shell_delay(int duration) {
+    //
+}
+
+void shell_request_timeout3(int delay) {
+    //
+}
+
+uint8 shell_get_mem() {
+    return 0;
+}
+
+bool shell_low_battery() {
+    return false;
+}
+
+void shell_powerdown() {
+    //
+}
+
+int8 shell_random_seed() {
+    return 0;
+}
+
+uint4 shell_milliseconds() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint4) (tv.tv_sec * 1000L + tv.tv_usec / 1000);
+}
+
+const char *shell_number_format() {
+    return ".";
+}
+
+int shell_date_format() {
+    return 0;
+}
+
+bool shell_clk24() {
+    return false;
+}
+
+void shell_print(const char *text, int length,
+                 const char *bits, int bytesperline,
+                 int x, int y, int width, int height) {
+    //
+}
+
+void shell_get_time_date(uint4 *time, uint4 *date, int *weekday) {
+    *time = 0;
+    *date = 15821015;
+    *weekday = 5;
+}
+
+void shell_message(const char *message) {
+    //
+}
+
+void shell_log(const char *message) {
+    //
+}
@@ -0,0 +1,484 @@
+/*****************************************************************************
+ * Free42 -- an HP-42S calculator simulator
+ * Copyright (C) 2004-2025  Thomas Okken
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses/.
+ *****************************************************************************/
+
+/* coretest: checks parts of the core that have fast paths against their
+ * reference implementations. Each test prints the number of cases it
+ * checked and the first few mismatches; the exit status is nonzero if any
+ * test failed. Naming tests runs only those.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "core_main.h"
+#include "core_globals.h"
+#include "core_linalg2.h"
+#include "core_tables.h"
+
+#define MAX_REPORTED 10
+
+static int4 cases, failures;
+
+static void report(const char *fmt, ...) {
+    if (++failures > MAX_REPORTED)
+        return;
+    va_list ap;
+    va_start(ap, fmt);
+    printf("  ");
+    vprintf(fmt, ap);
+    printf("\n");
+    va_end(ap);
+}
+
+static const char *hex_name(const char *name, int len) {
+    static char buf[100];
+    int p = 0;
+    for (int i = 0; i < len && p < 90; i++)
+        p += snprintf(buf + p, 100 - p, "%02x", (unsigned char) name[i]);
+    buf[p] = 0;
+    return buf;
+}
+
+
+/***** builtin: find_builtin() against find_builtin_linear() *****/
+
+static void check_builtin(const char *name, int len) {
+    cases++;
+    int cmd = find_builtin(name, len);
+    int ref = find_builtin_linear(name, len);
+    if (cmd != ref)
+        report("name %s: %d, expected %d", hex_name(name, len), cmd, ref);
+}
+
+/* The name of every command, each of those with its last character
+ * removed, changed, or with the high bit set in one of its characters,
+ * every name of one or two characters, and some names that aren't.
+ */
+static void test_builtin() {
+    char name[20];
+    for (int i = 0; i < CMD_SENTINEL; i++) {
+        const command_spec *cs = cmd_array + i;
+        int len = cs->name_length;
+        memcpy(name, cs->name, len);
+        check_builtin(name, len);
+        if (len > 0)
+            check_builtin(name, len - 1);
+        for (int j = 0; j < len; j++) {
+            name[j] ^= 128;
+            check_builtin(name, len);
+            name[j] ^= 128;
+        }
+        if (len > 0) {
+            name[len - 1]++;
+            check_builtin(name, len);
+            name[len - 1]--;
+        }
+        name[len] = 'X';
+        check_builtin(name, len + 1);
+    }
+    for (int c1 = 0; c1 < 256; c1++) {
+        name[0] = (char) c1;
+        check_builtin(name, 1);
+        for (int c2 = 0; c2 < 256; c2++) {
+            name[1] = (char) c2;
+            check_builtin(name, 2);
+        }
+    }
+    const char *others[] = {
+        "", "ENTER^", "RCL*", "RCLx", "STO/", "X<=Y?", "X#0?", "0<>?",
+        "sin", "Sin", "LBL ", "XEQ\"", "FOOBAR", "ABCDEFGHIJKL", NULL
+    };
+    for (int i = 0; others[i] != NULL; i++)
+        check_builtin(others[i], (int) strlen(others[i]));
+}
+
+
+/***** roundtrip: phloat2string() and string2phloat() against the library
+ ***** conversions *****/
+
+#define ROUNDTRIP_STRINGS 20000
+
+static uint4 rnd_state = 1;
+
+static uint4 rnd(uint4 n) {
+    rnd_state = rnd_state * 1103515245 + 12345;
+    return (rnd_state >> 8) % n;
+}
+
+/* The string in res, with char(24), the exponent separator, shown as E */
+static const char *show(const char *buf, int len, char *res) {
+    int n = len < 99 ? len : 99;
+    for (int i = 0; i < n; i++)
+        res[i] = buf[i] == 24 ? 'E' : buf[i];
+    res[n] = 0;
+    return res;
+}
+
+/* A number the way the user might type or paste it: an optional sign, up to
+ * a few digits more than MAX_MANT_DIGITS, with leading zeroes, a decimal
+ * point, and thousands separators now and then, and an optional exponent
+ * large enough to overflow or underflow.
+ */
+static int random_number(char *buf) {
+    char dot = flags.f.decimal_point ? '.' : ',';
+    char sep = flags.f.decimal_point ? ',' : '.';
+    int len = 0;
+    if (rnd(3) == 0)
+        buf[len++] = '-';
+    int digits = rnd(4) == 0 ? 1 + rnd(MAX_MANT_DIGITS + 3) : 1 + rnd(6);
+    int dot_pos = rnd(3) == 0 ? -1 : (int) rnd(digits + 1);
+    bool zeroes = rnd(5) == 0;
+    bool seps = rnd(8) == 0;
+    for (int i = 0; i < digits; i++) {
+        if (i == dot_pos)
+            buf[len++] = dot;
+        else if (seps && dot_pos == -1 && i > 0 && (digits - i) % 3 == 0)
+            buf[len++] = sep;
+        buf[len++] = zeroes && i < digits / 2 ? '0' : (char) ('0' + rnd(10));
+    }
+    if (dot_pos == digits)
+        buf[len++] = dot;
+    if (rnd(2) == 0) {
+        buf[len++] = 24;
+        if (rnd(2) == 0)
+            buf[len++] = '-';
+        int e = rnd(4) == 0 ? rnd(10000) : rnd(rnd(2) == 0 ? 400 : 30);
+        len += snprintf(buf + len, 10, "%d", e);
+    }
+    return len;
+}
+
+static bool same_phloat(const phloat &a, const phloat &b) {
+    return memcmp(&a, &b, sizeof(phloat)) == 0;
+}
+
+/* Formats x in every display mode, with a few digit counts, with and without
+ * separators, and in 12 and MAX_MANT_DIGITS digits.
+ */
+static void check_format(const phloat &x, const char *str, int str_len) {
+    char buf1[100], buf2[100];
+    for (int dispmode = 0; dispmode < 4; dispmode++)
+        for (int digits = 0; digits <= 11; digits += 4)
+            for (int sep = 0; sep < 2; sep++)
+                for (int mmd = 12; mmd <= MAX_MANT_DIGITS; mmd += MAX_MANT_DIGITS - 12) {
+                    cases++;
+                    phloat_direct_conversions(true);
+                    int len1 = phloat2string(x, buf1, 100, 0, digits, dispmode, sep, mmd);
+                    phloat_direct_conversions(false);
+                    int len2 = phloat2string(x, buf2, 100, 0, digits, dispmode, sep, mmd);
+                    if (len1 != len2 || memcmp(buf1, buf2, len1) != 0) {
+                        char s[100], s1[100], s2[100];
+                        report("format %s, mode %d %d %d %d: %s, expected %s",
+                               show(str, str_len, s), dispmode, digits, sep, mmd,
+                               show(buf1, len1, s1), show(buf2, len2, s2));
+                    }
+                }
+}
+
+/* Random number strings are parsed, and if they are in range, the result is
+ * formatted in all modes, both with and without the direct conversions,
+ * which must give identical results. Formatting with all digits, the way
+ * core_copy() does it, and parsing that again, must give the same number.
+ */
+static void test_roundtrip() {
+    char str[100], buf[100], s[100], s1[100];
+    bool decimal_point = flags.f.decimal_point;
+    for (int dp = 0; dp < 2; dp++) {
+        flags.f.decimal_point = dp;
+        for (int i = 0; i < ROUNDTRIP_STRINGS; i++) {
+            int len = random_number(str);
+            cases++;
+            phloat x1, x2;
+            phloat_direct_conversions(true);
+            int err1 = string2phloat(str, len, &x1);
+            phloat_direct_conversions(false);
+            int err2 = string2phloat(str, len, &x2);
+            if (err1 != err2) {
+                report("parse %s: error %d, expected %d", show(str, len, s), err1, err2);
+                continue;
+            }
+            if (err1 == 0 && !same_phloat(x1, x2)) {
+                report("parse %s: not the number the library gives", show(str, len, s));
+                continue;
+            }
+            if (err1 != 0)
+                continue;
+            check_format(x1, str, len);
+            cases++;
+            phloat_direct_conversions(true);
+            int blen = phloat2string(x1, buf, 100, 0, 0, 3, 0, MAX_MANT_DIGITS);
+            phloat y;
+            if (string2phloat(buf, blen, &y) != 0 || y != x1)
+                report("round trip %s: %s", show(str, len, s), show(buf, blen, s1));
+        }
+    }
+    flags.f.decimal_point = decimal_point;
+    phloat_direct_conversions(true);
+}
+
+#ifdef BCD_MATH
+
+/***** refine: lu_solve_rr_refined() against lu_decomp_r() and
+ ***** lu_backsubst_rr() *****/
+
+static vartype_realmatrix *refine_reference;
+static bool refine_solved;
+
+static int run_interruptible(int err) {
+    while (err == ERR_INTERRUPTIBLE)
+        err = mode_interruptible(false);
+    mode_interruptible = NULL;
+    return err;
+}
+
+static int refine_completion(int error, const vartype_realmatrix *a,
+                             vartype_realmatrix *x, bool solved) {
+    refine_solved = solved;
+    return error;
+}
+
+static int backsubst_completion(int error, vartype_realmatrix *a, int4 *perm,
+                                vartype_realmatrix *b) {
+    return error;
+}
+
+static int decomp_completion(int error, vartype_realmatrix *a, int4 *perm,
+                             phloat det) {
+    if (error != ERR_NONE)
+        return error;
+    return lu_backsubst_rr(a, perm, refine_reference, backsubst_completion);
+}
+
+/* Systems with integer solutions, whose right-hand sides are exact: random
+ * integer matrices (kind 0), the same with their rows scaled by powers of
+ * ten (1), and with the last row nearly equal to the one before, making the
+ * condition number around 1e12 (2). The refinement must succeed, and each
+ * element of its solution must be as close to the exact one as the Decimal
+ * decomposition's, give or take a unit in the last digit. Hilbert matrices
+ * (3) and singular ones (4) must be left to the Decimal decomposition.
+ */
+static void check_refine(int kind, int4 n, int4 q) {
+    cases++;
+    vartype_realmatrix *a = (vartype_realmatrix *) new_realmatrix(n, n);
+    vartype_realmatrix *lu = (vartype_realmatrix *) new_realmatrix(n, n);
+    vartype_realmatrix *xt = (vartype_realmatrix *) new_realmatrix(n, q);
+    vartype_realmatrix *b = (vartype_realmatrix *) new_realmatrix(n, q);
+    vartype_realmatrix *x = (vartype_realmatrix *) new_realmatrix(n, q);
+    vartype_realmatrix *ref = (vartype_realmatrix *) new_realmatrix(n, q);
+    int4 *perm = (int4 *) malloc(n * sizeof(int4));
+    phloat *ad = a->array->data;
+    phloat *xd = xt->array->data;
+    phloat *bd = b->array->data;
+    for (int4 i = 0; i < n; i++) {
+        phloat scale = kind == 1 ? p_pow10(rnd(41) - 20) : phloat(1);
+        for (int4 j = 0; j < n; j++)
+            if (kind == 3)
+                ad[i * n + j] = phloat(1) / (i + j + 1);
+            else if ((kind == 2 || kind == 4) && i == n - 1)
+                ad[i * n + j] = kind == 4 ? ad[(i - 1) * n + j]
+                        : ad[(i - 1) * n + j] + phloat((int) rnd(3) - 1) / 1000000;
+            else
+                ad[i * n + j] = phloat((int) rnd(1999) - 999) * scale;
+    }
+    for (int4 i = 0; i < n * q; i++)
+        xd[i] = phloat((int) rnd(99) + 1) * (rnd(2) == 0 ? 1 : -1);
+    for (int4 i = 0; i < n; i++)
+        for (int4 k = 0; k < q; k++) {
+            phloat sum = 0;
+            for (int4 j = 0; j < n; j++)
+                sum += ad[i * n + j] * xd[j * q + k];
+            bd[i * q + k] = sum;
+        }
+
+    refine_solved = false;
+    int err = run_interruptible(lu_solve_rr_refined(a, b, x, refine_completion));
+    matrix_copy((vartype *) lu, (vartype *) a);
+    matrix_copy((vartype *) ref, (vartype *) b);
+    refine_reference = ref;
+    int ref_err = run_interruptible(lu_decomp_r(lu, perm, decomp_completion));
+    if (err != ERR_NONE)
+        report("kind %d, %dx%d: error %d", kind, (int) n, (int) q, err);
+    else if (kind >= 3) {
+        if (refine_solved)
+            report("kind %d, %dx%d: refined, expected to be left to Decimal",
+                   kind, (int) n, (int) q);
+    } else if (!refine_solved)
+        report("kind %d, %dx%d: not refined", kind, (int) n, (int) q);
+    else if (ref_err != ERR_NONE)
+        report("kind %d, %dx%d: Decimal decomposition error %d",
+               kind, (int) n, (int) q, ref_err);
+    else
+        for (int4 i = 0; i < n * q; i++) {
+            phloat e = fabs(x->array->data[i] - xd[i]);
+            phloat e_ref = fabs(ref->array->data[i] - xd[i]);
+            if (e > e_ref + fabs(xd[i]) / p_pow10(33)) {
+                char s1[100], s2[100];
+                int len1 = phloat2string(e, s1, 100, 0, 0, 3, 0, MAX_MANT_DIGITS);
+                int len2 = phloat2string(e_ref, s2, 100, 0, 0, 3, 0, MAX_MANT_DIGITS);
+                char t1[100], t2[100];
+                report("kind %d, %dx%d: element %d off by %s, Decimal by %s",
+                       kind, (int) n, (int) q, (int) i,
+                       show(s1, len1, t1), show(s2, len2, t2));
+                break;
+            }
+        }
+
+    free_vartype((vartype *) a);
+    free_vartype((vartype *) lu);
+    free_vartype((vartype *) xt);
+    free_vartype((vartype *) b);
+    free_vartype((vartype *) x);
+    free_vartype((vartype *) ref);
+    free(perm);
+}
+
+static void test_refine() {
+    for (int kind = 0; kind < 5; kind++) {
+        check_refine(kind, 65, 1);
+        check_refine(kind, 100, 1);
+        check_refine(kind, 130, 2);
+    }
+}
+
+#endif
+
+
+struct test {
+    const char *name;
+    void (*run)();
+};
+
+static test tests[] = {
+    { "builtin", test_builtin },
+    { "roundtrip", test_roundtrip },
+#ifdef BCD_MATH
+    { "refine", test_refine },
+#endif
+    { NULL, NULL }
+};
+
+int main(int argc, char *argv[]) {
+    core_init(0, 0, NULL, 0);
+    int4 total_failures = 0;
+    for (test *t = tests; t->name != NULL; t++) {
+        if (argc > 1) {
+            bool selected = false;
+            for (int i = 1; i < argc; i++)
+                if (strcmp(argv[i], t->name) == 0)
+                    selected = true;
+            if (!selected)
+                continue;
+        }
+        cases = 0;
+        failures = 0;
+        t->run();
+        printf("%-12s %10d cases  %s", t->name, (int) cases,
+               failures == 0 ? "ok" : "FAILED");
+        if (failures != 0)
+            printf(" (%d mismatches)", (int) failures);
+        printf("\n");
+        total_failures += failures;
+    }
+    core_cleanup();
+    return total_failures == 0 ? 0 : 1;
+}
+
+const char *shell_platform() {
+    return NULL;
+}
+
+void shell_blitter(const char *bits, int bytesperline, int x, int y,
+                             int width, int height) {
+    //
+}
+
+void shell_beeper(int tone) {
+    //
+}
+
+void shell_annunciators(int updn, int shf, int prt, int run, int g, int rad) {
+    //
+}
+
+bool shell_wants_cpu() {
+    return false;
+}
+
+void shell_delay(int duration) {
+    //
+}
+
+void shell_request_timeout3(int delay) {
+    //
+}
+
+uint8 shell_get_mem() {
+    return 0;
+}
+
+bool shell_low_battery() {
+    return false;
+}
+
+void shell_powerdown() {
+    //
+}
+
+int8 shell_random_seed() {
+    return 0;
+}
+
+uint4 shell_milliseconds() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint4) (tv.tv_sec * 1000L + tv.tv_usec / 1000);
+}
+
+const char *shell_number_format() {
+    return ".";
+}
+
+int shell_date_format() {
+    return 0;
+}
+
+bool shell_clk24() {
+    return false;
+}
+
+void shell_print(const char *text, int length,
+                 const char *bits, int bytesperline,
+                 int x, int y, int width, int height) {
+    //
+}
+
+void shell_get_time_date(uint4 *time, uint4 *date, int *weekday) {
+    *time = 0;
+    *date = 15821015;
+    *weekday = 5;
+}
+
+void shell_message(const char *message) {
+    //
+}
+
+void shell_log(const char *message) {
+    //
+}
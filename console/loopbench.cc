@@ -0,0 +1,207 @@
+/*****************************************************************************
+ * Free42 -- an HP-42S calculator simulator
+ * Copyright (C) 2004-2025  Thomas Okken
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses/.
+ *****************************************************************************/
+
+/* loopbench: measures how fast a tight program loop runs, with the core
+ * calling shell_wants_cpu() after every instruction, and with the adaptive
+ * instruction budget controlled by core_settings.poll_latency_ms.
+ * shell_wants_cpu() below does what the GTK shell does, i.e. it reads the
+ * time of day on every call and only looks for events every 10 ms, so the
+ * numbers reflect the per-call overhead of a real shell.
+ * With -d, each loop is also run with core_settings.decode_cache turned off,
+ * so the rates with and without the decode cache can be compared.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "core_main.h"
+#include "core_commands2.h"
+#include "core_globals.h"
+
+static const char *loop_prgm =
+    "01 LBL \"LOOP\"\n"
+    "02 STO 00\n"
+    "03 0\n"
+    "04 LBL 01\n"
+    "05 1\n"
+    "06 +\n"
+    "07 DSE 00\n"
+    "08 GTO 01\n"
+    "09 RTN\n";
+
+#define LOOP_INSTRUCTIONS 5
+
+static int wants_cpu_calls;
+
+static double now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static double run_loop(int iterations) {
+    char buf[20];
+    snprintf(buf, 20, "%d", iterations);
+    core_paste(buf);
+    arg_struct arg;
+    arg.type = ARGTYPE_STR;
+    arg.length = 4;
+    memcpy(arg.val.text, "LOOP", 4);
+    double start = now();
+    if (docmd_xeq(&arg) != ERR_RUN) {
+        fprintf(stderr, "XEQ \"LOOP\" failed\n");
+        exit(1);
+    }
+    set_running(true);
+    bool enqueued;
+    int repeat;
+    while (core_keydown(0, &enqueued, &repeat))
+        ;
+    return now() - start;
+}
+
+int main(int argc, char *argv[]) {
+    bool compare = argc > 1 && strcmp(argv[1], "-d") == 0;
+    if (compare) {
+        argv++;
+        argc--;
+    }
+    int iterations = argc > 1 ? atoi(argv[1]) : 1000000;
+    if (iterations <= 0) {
+        fprintf(stderr, "Usage: %s [-d] [<iterations>]\n", argv[0]);
+        return 1;
+    }
+
+    core_init(0, 0, NULL, 0);
+    flags.f.prgm_mode = 1;
+    core_paste(loop_prgm);
+    flags.f.prgm_mode = 0;
+
+    int latencies[] = { 0, 1, 10, 50 };
+    printf("latency (ms)   loops/s    instr/s  shell_wants_cpu() calls");
+    if (compare)
+        printf("  loops/s without decode cache");
+    printf("\n");
+    for (int i = 0; i < 4; i++) {
+        core_settings.poll_latency_ms = latencies[i];
+        core_settings.decode_cache = true;
+        wants_cpu_calls = 0;
+        double t = run_loop(iterations);
+        printf("%12d %9.0f %10.0f  %23d", latencies[i], iterations / t,
+               iterations * (double) LOOP_INSTRUCTIONS / t, wants_cpu_calls);
+        if (compare) {
+            core_settings.decode_cache = false;
+            t = run_loop(iterations);
+            printf("  %28.0f", iterations / t);
+        }
+        printf("\n");
+    }
+    return 0;
+}
+
+const char *shell_platform() {
+    return NULL;
+}
+
+void shell_blitter(const char *bits, int bytesperline, int x, int y,
+                             int width, int height) {
+    //
+}
+
+void shell_beeper(int tone) {
+    //
+}
+
+void shell_annunciators(int updn, int shf, int prt, int run, int g, int rad) {
+    //
+}
+
+bool shell_wants_cpu() {
+    static uint4 lastCount = 0;
+    wants_cpu_calls++;
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    uint4 count = tv.tv_sec * 1000L + tv.tv_usec / 1000;
+    if (count - lastCount < 10)
+        return false;
+    lastCount = count;
+    return false;
+}
+
+void shell_delay(int duration) {
+    //
+}
+
+void shell_request_timeout3(int delay) {
+    //
+}
+
+uint8 shell_get_mem() {
+    return 0;
+}
+
+bool shell_low_battery() {
+    return false;
+}
+
+void shell_powerdown() {
+    //
+}
+
+int8 shell_random_seed() {
+    return 0;
+}
+
+uint4 shell_milliseconds() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint4) (tv.tv_sec * 1000L + tv.tv_usec / 1000);
+}
+
+const char *shell_number_format() {
+    return ".";
+}
+
+int shell_date_format() {
+    return 0;
+}
+
+bool shell_clk24() {
+    return false;
+}
+
+void shell_print(const char *text, int length,
+                 const char *bits, int bytesperline,
+                 int x, int y, int width, int height) {
+    //
+}
+
+void shell_get_time_date(uint4 *time, uint4 *date, int *weekday) {
+    *time = 0;
+    *date = 15821015;
+    *weekday = 5;
+}
+
+void shell_message(const char *message) {
+    //
+}
+
+void shell_log(const char *message) {
+    //
+}
@@ -496,6 +496,28 @@ void main_loop_curses() {
 
 #define LINELEN 256
 
+/* Handles the "prof" commands: "prof on" and "prof off" turn the execution
+ * profiler on and off, "prof reset" discards the collected data, and "prof"
+ * by itself prints the report.
+ */
+void profiler_command(const char *s) {
+  while (*s == ' ')
+    s++;
+  if (strncmp(s, "on", 2) == 0)
+    core_profiler_enable(true);
+  else if (strncmp(s, "off", 3) == 0)
+    core_profiler_enable(false);
+  else if (strncmp(s, "reset", 5) == 0)
+    core_profiler_reset();
+  else {
+    char *report = core_profiler_report();
+    if (report != NULL) {
+      fputs(report, stdout);
+      free(report);
+    }
+  }
+}
+
 void main_loop() {
   core_init(0,0, NULL, 0);
   for(;;) {
@@ -508,6 +530,11 @@ void main_loop() {
     if ( !fgets(s, LINELEN, stdin) )
       break;
 
+    if (strncmp(s, "prof", 4) == 0) {
+      profiler_command(s + 4);
+      continue;
+    }
+
     int key = atoi(s);
     if ( key > 0 && key <= 37 ) {
       // Press key
@@ -0,0 +1,208 @@
+/*****************************************************************************
+ * Free42 -- an HP-42S calculator simulator
+ * Copyright (C) 2004-2025  Thomas Okken
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses/.
+ *****************************************************************************/
+
+/* threadbench: runs independent calculators on 1, 2, 4, ... threads, each
+ * running the same program loop, and prints the combined throughput, to show
+ * how well it scales with the number of cores. Requires a core built with
+ * CORE_THREADS, so each thread gets a calculator of its own.
+ */
+
+#ifndef CORE_THREADS
+#error "threadbench requires CORE_THREADS; build it using 'make CORE_THREADS=1 threadbench'"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <thread>
+#include <vector>
+
+#include "core_main.h"
+#include "core_commands2.h"
+#include "core_globals.h"
+#include "core_helpers.h"
+
+static const char *loop_prgm =
+    "01 LBL \"LOOP\"\n"
+    "02 STO 00\n"
+    "03 0\n"
+    "04 STO \"S\"\n"
+    "05 LBL 01\n"
+    "06 RCL 00\n"
+    "07 STO+ \"S\"\n"
+    "08 DSE 00\n"
+    "09 GTO 01\n"
+    "10 RCL \"S\"\n"
+    "11 RTN\n";
+
+#define LOOP_INSTRUCTIONS 5
+
+static double now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void calculator(int iterations, bool *ok) {
+    core_init(0, 0, NULL, 0);
+    flags.f.prgm_mode = 1;
+    core_paste(loop_prgm);
+    flags.f.prgm_mode = 0;
+    char buf[20];
+    snprintf(buf, 20, "%d", iterations);
+    core_paste(buf);
+    arg_struct arg;
+    arg.type = ARGTYPE_STR;
+    arg.length = 4;
+    memcpy(arg.val.text, "LOOP", 4);
+    *ok = false;
+    if (docmd_xeq(&arg) == ERR_RUN) {
+        set_running(true);
+        bool enqueued;
+        int repeat;
+        while (core_keydown(0, &enqueued, &repeat))
+            ;
+        // The result is the sum of 1..iterations
+        phloat expected = (phloat) iterations * (iterations + 1) / 2;
+        *ok = sp >= 0 && stack[sp]->type == TYPE_REAL
+                && ((vartype_real *) stack[sp])->x == expected;
+    }
+    core_cleanup();
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 1000000;
+    int max_threads = argc > 2 ? atoi(argv[2]) : std::thread::hardware_concurrency();
+    if (iterations <= 0 || argc > 3) {
+        fprintf(stderr, "Usage: %s [<iterations> [<max-threads>]]\n", argv[0]);
+        return 1;
+    }
+    if (max_threads <= 0)
+        max_threads = 1;
+
+    printf("threads   instr/s  per thread  scaling\n");
+    double base = 0;
+    for (int n = 1; ; n *= 2) {
+        if (n > max_threads)
+            n = max_threads;
+        std::vector<std::thread> threads;
+        bool *ok = new bool[n];
+        double start = now();
+        for (int i = 0; i < n; i++)
+            threads.push_back(std::thread(calculator, iterations, ok + i));
+        for (int i = 0; i < n; i++)
+            threads[i].join();
+        double t = now() - start;
+        for (int i = 0; i < n; i++)
+            if (!ok[i]) {
+                fprintf(stderr, "Calculator %d of %d returned the wrong result\n", i + 1, n);
+                return 1;
+            }
+        delete[] ok;
+        double rate = (double) n * iterations * LOOP_INSTRUCTIONS / t;
+        if (n == 1)
+            base = rate;
+        printf("%7d %9.0f %11.0f  %6.2fx\n", n, rate, rate / n, rate / base);
+        if (n == max_threads)
+            break;
+    }
+    return 0;
+}
+
+const char *shell_platform() {
+    return NULL;
+}
+
+void shell_blitter(const char *bits, int bytesperline, int x, int y,
+                             int width, int height) {
+    //
+}
+
+void shell_beeper(int tone) {
+    //
+}
+
+void shell_annunciators(int updn, int shf, int prt, int run, int g, int rad) {
+    //
+}
+
+bool shell_wants_cpu() {
+    return false;
+}
+
+void shell_delay(int duration) {
+    //
+}
+
+void shell_request_timeout3(int delay) {
+    //
+}
+
+uint8 shell_get_mem() {
+    return 0;
+}
+
+bool shell_low_battery() {
+    return false;
+}
+
+void shell_powerdown() {
+    //
+}
+
+int8 shell_random_seed() {
+    return 0;
+}
+
+uint4 shell_milliseconds() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint4) (tv.tv_sec * 1000L + tv.tv_usec / 1000);
+}
+
+const char *shell_number_format() {
+    return ".";
+}
+
+int shell_date_format() {
+    return 0;
+}
+
+bool shell_clk24() {
+    return false;
+}
+
+void shell_print(const char *text, int length,
+                 const char *bits, int bytesperline,
+                 int x, int y, int width, int height) {
+    //
+}
+
+void shell_get_time_date(uint4 *time, uint4 *date, int *weekday) {
+    *time = 0;
+    *date = 15821015;
+    *weekday = 5;
+}
+
+void shell_message(const char *message) {
+    //
+}
+
+void shell_log(const char *message) {
+    //
+}
@@ -142,6 +142,7 @@ void get_keymap(keymap_entry **map, int *length) {
 
 static bool keyboardShortcutsShowing = false;
 static GtkCheckMenuItem *keyboardShortcutsMenuItem;
+static GtkCheckMenuItem *profilerMenuItem;
 
 
 /* Private functions */
@@ -171,6 +172,9 @@ static void paperAdvanceCB();
 static void copyPrintAsTextCB();
 static void copyPrintAsImageCB();
 static void clearPrintOutCB();
+static void profilerCB();
+static void copyProfileCB();
+static void resetProfileCB();
 static void preferencesCB();
 static void appendSuffix(char *path, char *suffix);
 static void copyCB();
@@ -319,6 +323,25 @@ static const char *mainWindowXml =
                         "<accelerator key='D' signal='activate' modifiers='GDK_CONTROL_MASK'/>"
                       "</object>"
                     "</child>"
+                    "<child>"
+                      "<object class='GtkSeparatorMenuItem' id='sep_profiler'>"
+                      "</object>"
+                    "</child>"
+                    "<child>"
+                      "<object class='GtkCheckMenuItem' id='profiler_item'>"
+                        "<property name='label'>Profile Programs</property>"
+                      "</object>"
+                    "</child>"
+                    "<child>"
+                      "<object class='GtkMenuItem' id='copy_profile_item'>"
+                        "<property name='label'>Copy Profile Report</property>"
+                      "</object>"
+                    "</child>"
+                    "<child>"
+                      "<object class='GtkMenuItem' id='reset_profile_item'>"
+                        "<property name='label'>Reset Profile</property>"
+                      "</object>"
+                    "</child>"
                   "</object>"
                 "</child>"
               "</object>"
@@ -693,6 +716,12 @@ static void activate(GtkApplication *theApp, gpointer userData) {
     g_signal_connect(G_OBJECT(item), "activate", G_CALLBACK(copyPrintAsImageCB), NULL);
     item = GTK_MENU_ITEM(gtk_builder_get_object(builder, "clear_printout_item"));
     g_signal_connect(G_OBJECT(item), "activate", G_CALLBACK(clearPrintOutCB), NULL);
+    profilerMenuItem = GTK_CHECK_MENU_ITEM(gtk_builder_get_object(builder, "profiler_item"));
+    g_signal_connect(G_OBJECT(profilerMenuItem), "toggled", G_CALLBACK(profilerCB), NULL);
+    item = GTK_MENU_ITEM(gtk_builder_get_object(builder, "copy_profile_item"));
+    g_signal_connect(G_OBJECT(item), "activate", G_CALLBACK(copyProfileCB), NULL);
+    item = GTK_MENU_ITEM(gtk_builder_get_object(builder, "reset_profile_item"));
+    g_signal_connect(G_OBJECT(item), "activate", G_CALLBACK(resetProfileCB), NULL);
     item = GTK_MENU_ITEM(gtk_builder_get_object(builder, "documentation_item"));
     g_signal_connect(G_OBJECT(item), "activate", G_CALLBACK(documentationCB), NULL);
     item = GTK_MENU_ITEM(gtk_builder_get_object(builder, "website_item"));
@@ -2322,6 +2351,23 @@ static void clearPrintOutCB() {
     }
 }
 
+static void profilerCB() {
+    core_profiler_enable(gtk_check_menu_item_get_active(profilerMenuItem));
+}
+
+static void copyProfileCB() {
+    char *buf = core_profiler_report();
+    if (buf == NULL)
+        return;
+    GtkClipboard *clip = gtk_clipboard_get(GDK_SELECTION_CLIPBOARD);
+    gtk_clipboard_set_text(clip, buf, -1);
+    free(buf);
+}
+
+static void resetProfileCB() {
+    core_profiler_reset();
+}
+
 struct browse_file_info {
     const char *title;
     const char *patterns;
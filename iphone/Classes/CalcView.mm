@@ -884,7 +884,7 @@ static void read_key_map(const char *keymapfilename) {
 /////                   Here beginneth thy olde C code                    /////
 ///////////////////////////////////////////////////////////////////////////////
 
-extern bool off_enable_flag;
+extern CORE_TLS bool off_enable_flag;
 
 static int read_shell_state(int *ver) {
     int magic;